@@ -4,15 +4,19 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -31,18 +35,32 @@
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
 //      readseq       -- read N times sequentially
+//      readseqbatch  -- read N times sequentially, in NextBatch batches
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      readrandompinned -- read N times in random order, into PinnableSlices
+//      multireadrandom -- read N times in random order, in MultiGet batches
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
+//      seekmissing   -- N random seeks to missing keys
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      filterprobe   -- probe a filter of N keys with missing keys in random
+//                       order; reports the false positive rate
+//      snappycomp    -- repeated snappy compression of 4K of data
+//      snappyuncomp  -- repeated snappy uncompression of 4K of data
+//      zstdcomp      -- repeated zstd compression of 4K of data
+//      zstduncomp    -- repeated zstd uncompression of 4K of data
+//      lz4comp       -- repeated LZ4 compression of 4K of data
+//      lz4uncomp     -- repeated LZ4 uncompression of 4K of data
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      blockcachestats -- Print block cache and secondary cache hits/misses
+//      writestallstats -- Print writes delayed or stopped by compactions
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -60,7 +78,11 @@ static const char* FLAGS_benchmarks =
     "fill100K,"
     "crc32c,"
     "snappycomp,"
-    "snappyuncomp,";
+    "snappyuncomp,"
+    "zstdcomp,"
+    "zstduncomp,"
+    "lz4comp,"
+    "lz4uncomp,";
 
 // Number of key/values to place in database
 static int FLAGS_num = 1000000;
@@ -68,6 +90,12 @@ static int FLAGS_num = 1000000;
 // Number of read operations to do.  If negative, do FLAGS_num reads.
 static int FLAGS_reads = -1;
 
+// Number of keys per MultiGet call in multireadrandom.
+static int FLAGS_multiget_batch_size = 32;
+
+// Number of entries per Iterator::NextBatch call in readseqbatch.
+static int FLAGS_next_batch_size = 64;
+
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
@@ -88,6 +116,10 @@ static bool FLAGS_comparisons = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Bytes per second that writes slow down to when compactions fall behind
+// (initialized to default value by "main")
+static int FLAGS_delayed_write_rate = 0;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
@@ -96,17 +128,74 @@ static int FLAGS_max_file_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// If true, data blocks carry a hash index for point lookups.
+static bool FLAGS_data_block_hash_index = false;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Block cache implementation: "lru" or "clock" (lock-free lookups).
+static const char* FLAGS_cache_type = "lru";
+
+// Log2 of the number of shards of a "clock" cache.
+static int FLAGS_cache_shard_bits = 4;
+
+// Fraction of an "lru" cache reserved for the entries read more than once;
+// 0 means plain LRU.
+static double FLAGS_cache_protected_ratio = 0.8;
+
+// Fraction of an "lru" cache reserved for index and filter blocks with
+// --cache_index_and_filter_blocks.
+static double FLAGS_cache_high_pri_pool_ratio = 0.5;
+
+// If true, keep the index and filter blocks of tables in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// Tier consulted on block cache misses: "none", "compressed" (in memory,
+// compressed with --compression) or "file" (in a directory next to --db).
+static const char* FLAGS_secondary_cache_type = "none";
+
+// Number of bytes of the secondary cache.
+static int FLAGS_secondary_cache_size = 64 << 20;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// Maximum number of compactions allowed to run concurrently.
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+
+// Maximum number of pieces a single compaction may be split into.
+// (initialized to default value by "main")
+static int FLAGS_max_subcompactions = 0;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Bloom filter implementation: "standard", "blocked" (all probes of a key
+// within one cache line) or "ribbon" (a Ribbon filter with the false
+// positive rate of a bloom filter with --bloom_bits).
+static const char* FLAGS_bloom_type = "standard";
+
+// Comma-separated filter implementation of each level, e.g.
+// "standard,standard,ribbon", where "none" means no filter.  Empty means
+// use --bloom_type for all levels.
+static const char* FLAGS_filter_policy_per_level = "";
+
+// Layout of the bloom filters: "block", "full" or "partitioned".
+static const char* FLAGS_filter_format = "full";
+
+// Approximate size of each partition of a "partitioned" filter.
+static int FLAGS_filter_partition_size = 4096;
+
+// Layout of the index blocks: "block", "fixed" or "partitioned".
+static const char* FLAGS_index_format = "block";
+
+// Approximate size of each partition of a "partitioned" index.
+static int FLAGS_index_partition_size = 4096;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
@@ -118,6 +207,37 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, overlap the log write of a write group with the memtable insert
+// of the previous one.
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, the writers of a write group insert into the memtable in parallel.
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// Block compression: "none", "snappy", "zstd" or "lz4".
+static const char* FLAGS_compression = "snappy";
+
+// Comma-separated block compression of each level, e.g. "lz4,lz4,zstd".
+// Empty means use --compression for all levels.
+static const char* FLAGS_compression_per_level = "";
+
+// Compression level for zstd.
+static int FLAGS_zstd_compression_level = 1;
+
+// Maximum size of the zstd dictionary of each table written by a
+// compaction.  Zero disables dictionaries.
+static int FLAGS_zstd_max_dict_bytes = 0;
+
+// Memtable representation: "skiplist", "vector" or "hash".
+static const char* FLAGS_memtable_rep = "skiplist";
+
+// Length of the key prefixes that the "hash" memtable groups keys by.
+// Zero means hash whole keys.
+static int FLAGS_prefix_size = 0;
+
+// If true, the seek benchmarks set ReadOptions::prefix_same_as_start.
+static bool FLAGS_prefix_same_as_start = false;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -369,7 +489,10 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  SecondaryCache* secondary_cache_;
   const FilterPolicy* filter_policy_;
+  std::vector<const FilterPolicy*> filter_policies_per_level_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -460,10 +583,13 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(FLAGS_cache_size >= 0 ? NewCacheOfType(FLAGS_cache_type)
+                                     : nullptr),
+        secondary_cache_(NewSecondaryCacheOfType(FLAGS_secondary_cache_type)),
+        filter_policy_(NewFilterPolicyOfType(FLAGS_bloom_type)),
+        prefix_extractor_(FLAGS_prefix_size > 0
+                              ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                              : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -482,12 +608,26 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    Slice per_level(FLAGS_filter_policy_per_level);
+    while (!per_level.empty()) {
+      const char* sep = strchr(per_level.data(), ',');
+      std::string type = (sep == nullptr)
+                             ? per_level.ToString()
+                             : std::string(per_level.data(), sep);
+      filter_policies_per_level_.push_back(NewFilterPolicyOfType(type.c_str()));
+      per_level.remove_prefix(type.size() + (sep == nullptr ? 0 : 1));
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete secondary_cache_;
     delete filter_policy_;
+    for (const FilterPolicy* policy : filter_policies_per_level_) {
+      delete policy;
+    }
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -546,14 +686,22 @@ class Benchmark {
         method = &Benchmark::WriteRandom;
       } else if (name == Slice("readseq")) {
         method = &Benchmark::ReadSequential;
+      } else if (name == Slice("readseqbatch")) {
+        method = &Benchmark::ReadSequentialBatch;
       } else if (name == Slice("readreverse")) {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
+      } else if (name == Slice("readrandompinned")) {
+        method = &Benchmark::ReadRandomPinned;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
+      } else if (name == Slice("seekmissing")) {
+        method = &Benchmark::SeekMissing;
       } else if (name == Slice("seekordered")) {
         method = &Benchmark::SeekOrdered;
       } else if (name == Slice("readhot")) {
@@ -572,16 +720,30 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("filterprobe")) {
+        method = &Benchmark::FilterProbe;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
         method = &Benchmark::SnappyUncompress;
+      } else if (name == Slice("zstdcomp")) {
+        method = &Benchmark::ZstdCompress;
+      } else if (name == Slice("zstduncomp")) {
+        method = &Benchmark::ZstdUncompress;
+      } else if (name == Slice("lz4comp")) {
+        method = &Benchmark::LZ4Compress;
+      } else if (name == Slice("lz4uncomp")) {
+        method = &Benchmark::LZ4Uncompress;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("blockcachestats")) {
+        PrintStats("leveldb.block-cache-stats");
+      } else if (name == Slice("writestallstats")) {
+        PrintStats("leveldb.write-stall-stats");
       } else {
         if (!name.empty()) {  // No error message for empty name
           std::fprintf(stderr, "unknown benchmark '%s'\n",
@@ -709,7 +871,58 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
-  void SnappyCompress(ThreadState* thread) {
+  void FilterProbe(ThreadState* thread) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(no filter policy: use --bloom_bits)");
+      return;
+    }
+    // Build one filter over keys [0, num_)
+    std::string keys;
+    std::vector<size_t> starts;
+    KeyBuffer key;
+    for (int i = 0; i < num_; i++) {
+      key.Set(i);
+      starts.push_back(keys.size());
+      keys.append(key.slice().data(), key.slice().size());
+    }
+    std::vector<Slice> key_slices;
+    const size_t key_size = key.slice().size();
+    for (size_t start : starts) {
+      key_slices.emplace_back(keys.data() + start, key_size);
+    }
+    std::string filter;
+    filter_policy_->CreateFilter(key_slices.data(), num_, &filter);
+
+    // Probe it with keys from [num_, 2 * num_), formatted ahead of time
+    std::string probes;
+    probes.reserve(static_cast<size_t>(reads_) * key_size);
+    for (int i = 0; i < reads_; i++) {
+      key.Set(num_ + thread->rand.Uniform(num_));
+      probes.append(key.slice().data(), key_size);
+    }
+    int matches = 0;
+    const uint64_t start = g_env->NowMicros();
+    for (int i = 0; i < reads_; i++) {
+      if (filter_policy_->KeyMayMatch(
+              Slice(probes.data() + i * key_size, key_size), filter)) {
+        matches++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    const uint64_t micros = g_env->NowMicros() - start;
+
+    char msg[100];
+    std::snprintf(msg, sizeof(msg),
+                  "(%.3f%% false positives, %.1f ns/lookup, %d bytes)",
+                  100.0 * matches / std::max(reads_, 1),
+                  1000.0 * micros / std::max(reads_, 1),
+                  static_cast<int>(filter.size()));
+    thread->stats.AddMessage(msg);
+  }
+
+  void Compress(
+      ThreadState* thread, std::string name,
+      std::function<bool(const char*, size_t, std::string*)> compress_func) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     int64_t bytes = 0;
@@ -717,14 +930,14 @@ class Benchmark {
     bool ok = true;
     std::string compressed;
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+      ok = compress_func(input.data(), input.size(), &compressed);
       produced += compressed.size();
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      thread->stats.AddMessage("(" + name + " failure)");
     } else {
       char buf[100];
       std::snprintf(buf, sizeof(buf), "(output: %.1f%%)",
@@ -734,43 +947,183 @@ class Benchmark {
     }
   }
 
-  void SnappyUncompress(ThreadState* thread) {
+  void Uncompress(
+      ThreadState* thread, std::string name,
+      std::function<bool(const char*, size_t, std::string*)> compress_func,
+      std::function<bool(const char*, size_t, char*)> uncompress_func) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     std::string compressed;
-    bool ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+    bool ok = compress_func(input.data(), input.size(), &compressed);
     int64_t bytes = 0;
     char* uncompressed = new char[input.size()];
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok = port::Snappy_Uncompress(compressed.data(), compressed.size(),
-                                   uncompressed);
+      ok = uncompress_func(compressed.data(), compressed.size(), uncompressed);
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
     delete[] uncompressed;
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      thread->stats.AddMessage("(" + name + " failure)");
     } else {
       thread->stats.AddBytes(bytes);
     }
   }
 
+  void SnappyCompress(ThreadState* thread) {
+    Compress(thread, "snappy", &port::Snappy_Compress);
+  }
+
+  void SnappyUncompress(ThreadState* thread) {
+    Uncompress(thread, "snappy", &port::Snappy_Compress,
+               &port::Snappy_Uncompress);
+  }
+
+  void ZstdCompress(ThreadState* thread) {
+    Compress(thread, "zstd", &ZstdCompressAtLevel);
+  }
+
+  void ZstdUncompress(ThreadState* thread) {
+    Uncompress(thread, "zstd", &ZstdCompressAtLevel, &port::Zstd_Uncompress);
+  }
+
+  void LZ4Compress(ThreadState* thread) {
+    Compress(thread, "lz4", &port::LZ4_Compress);
+  }
+
+  void LZ4Uncompress(ThreadState* thread) {
+    Uncompress(thread, "lz4", &port::LZ4_Compress, &port::LZ4_Uncompress);
+  }
+
+  static bool ZstdCompressAtLevel(const char* input, size_t length,
+                                  std::string* output) {
+    return port::Zstd_Compress(FLAGS_zstd_compression_level, input, length,
+                               output);
+  }
+
+  // Returns nullptr for "none" or without --bloom_bits.
+  static const FilterPolicy* NewFilterPolicyOfType(const char* type) {
+    if (FLAGS_bloom_bits < 0 || strcmp(type, "none") == 0) {
+      return nullptr;
+    } else if (strcmp(type, "standard") == 0) {
+      return NewBloomFilterPolicy(FLAGS_bloom_bits);
+    } else if (strcmp(type, "blocked") == 0) {
+      return NewBlockedBloomFilterPolicy(FLAGS_bloom_bits);
+    } else if (strcmp(type, "ribbon") == 0) {
+      return NewRibbonFilterPolicy(FLAGS_bloom_bits);
+    }
+    std::fprintf(stderr, "unknown filter type '%s'\n", type);
+    std::exit(1);
+  }
+
+  static Cache* NewCacheOfType(const char* type) {
+    if (strcmp(type, "lru") == 0) {
+      LRUCacheOptions options;
+      options.protected_ratio = FLAGS_cache_protected_ratio;
+      options.high_pri_pool_ratio = FLAGS_cache_high_pri_pool_ratio;
+      return NewLRUCache(FLAGS_cache_size, options);
+    } else if (strcmp(type, "clock") == 0) {
+      return NewClockCache(FLAGS_cache_size, FLAGS_cache_shard_bits,
+                           FLAGS_block_size);
+    }
+    std::fprintf(stderr, "unknown cache type '%s'\n", type);
+    std::exit(1);
+  }
+
+  static SecondaryCache* NewSecondaryCacheOfType(const char* type) {
+    if (strcmp(type, "none") == 0) {
+      return nullptr;
+    } else if (strcmp(type, "compressed") == 0) {
+      return NewCompressedSecondaryCache(FLAGS_secondary_cache_size,
+                                         ParseCompression(FLAGS_compression));
+    } else if (strcmp(type, "file") == 0) {
+      return NewFileSecondaryCache(g_env,
+                                   std::string(FLAGS_db) + "_secondary_cache",
+                                   FLAGS_secondary_cache_size);
+    }
+    std::fprintf(stderr, "unknown secondary cache type '%s'\n", type);
+    std::exit(1);
+  }
+
+  static CompressionType ParseCompression(const char* name) {
+    if (strcmp(name, "none") == 0) {
+      return kNoCompression;
+    } else if (strcmp(name, "snappy") == 0) {
+      return kSnappyCompression;
+    } else if (strcmp(name, "zstd") == 0) {
+      return kZstdCompression;
+    } else if (strcmp(name, "lz4") == 0) {
+      return kLZ4Compression;
+    }
+    std::fprintf(stderr, "unknown compression '%s'\n", name);
+    std::exit(1);
+  }
+
   void Open() {
     assert(db_ == nullptr);
     Options options;
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.cache_index_and_filter_blocks = FLAGS_cache_index_and_filter_blocks;
+    options.secondary_cache = secondary_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.delayed_write_rate = FLAGS_delayed_write_rate;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
     options.filter_policy = filter_policy_;
+    options.filter_policy_per_level = filter_policies_per_level_;
+    if (strcmp(FLAGS_filter_format, "block") == 0) {
+      options.filter_format = kBlockBasedFilter;
+    } else if (strcmp(FLAGS_filter_format, "partitioned") == 0) {
+      options.filter_format = kPartitionedFilter;
+    } else if (strcmp(FLAGS_filter_format, "full") != 0) {
+      std::fprintf(stderr, "unknown filter_format '%s'\n", FLAGS_filter_format);
+      std::exit(1);
+    }
+    options.filter_partition_size = FLAGS_filter_partition_size;
+    if (strcmp(FLAGS_index_format, "fixed") == 0) {
+      options.index_format = kFixedIndex;
+    } else if (strcmp(FLAGS_index_format, "partitioned") == 0) {
+      options.index_format = kPartitionedIndex;
+    } else if (strcmp(FLAGS_index_format, "block") != 0) {
+      std::fprintf(stderr, "unknown index_format '%s'\n", FLAGS_index_format);
+      std::exit(1);
+    }
+    options.index_partition_size = FLAGS_index_partition_size;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    if (strcmp(FLAGS_memtable_rep, "vector") == 0) {
+      options.memtable_rep = kVectorRep;
+    } else if (strcmp(FLAGS_memtable_rep, "hash") == 0) {
+      options.memtable_rep = kHashSkipListRep;
+    } else if (strcmp(FLAGS_memtable_rep, "skiplist") != 0) {
+      std::fprintf(stderr, "unknown memtable_rep '%s'\n", FLAGS_memtable_rep);
+      std::exit(1);
+    }
+    options.prefix_extractor = prefix_extractor_;
+    options.compression = ParseCompression(FLAGS_compression);
+    options.zstd_compression_level = FLAGS_zstd_compression_level;
+    options.zstd_max_dict_bytes = FLAGS_zstd_max_dict_bytes;
+    Slice per_level(FLAGS_compression_per_level);
+    while (!per_level.empty()) {
+      const char* sep = strchr(per_level.data(), ',');
+      std::string name = (sep == nullptr)
+                             ? per_level.ToString()
+                             : std::string(per_level.data(), sep);
+      options.compression_per_level.push_back(ParseCompression(name.c_str()));
+      per_level.remove_prefix(name.size() + (sep == nullptr ? 0 : 1));
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -833,6 +1186,26 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  void ReadSequentialBatch(ThreadState* thread) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    IteratorBatch batch;
+    int i = 0;
+    int64_t bytes = 0;
+    iter->SeekToFirst();
+    while (i < reads_ && iter->Valid()) {
+      batch.Clear();
+      const int count =
+          iter->NextBatch(std::min(FLAGS_next_batch_size, reads_ - i), &batch);
+      for (int j = 0; j < count; j++) {
+        bytes += batch.key(j).size() + batch.value(j).size();
+        thread->stats.FinishedSingleOp();
+      }
+      i += count;
+    }
+    delete iter;
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadReverse(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -864,6 +1237,53 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void ReadRandomPinned(ThreadState* thread) {
+    ReadOptions options;
+    PinnableSlice value;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      if (db_->Get(options, key.slice(), &value).ok()) {
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> key_storage(FLAGS_multiget_batch_size);
+    std::vector<Slice> keys;
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    KeyBuffer key;
+    int found = 0;
+    for (int i = 0; i < reads_; i += FLAGS_multiget_batch_size) {
+      const int batch = std::min(FLAGS_multiget_batch_size, reads_ - i);
+      keys.clear();
+      for (int j = 0; j < batch; j++) {
+        key.Set(thread->rand.Uniform(FLAGS_num));
+        key_storage[j] = key.slice().ToString();
+        keys.push_back(key_storage[j]);
+      }
+      db_->MultiGet(options, keys, &values, &statuses);
+      for (int j = 0; j < batch; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -892,6 +1312,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_same_as_start = FLAGS_prefix_same_as_start;
     int found = 0;
     KeyBuffer key;
     for (int i = 0; i < reads_; i++) {
@@ -910,6 +1331,7 @@ class Benchmark {
 
   void SeekOrdered(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_same_as_start = FLAGS_prefix_same_as_start;
     Iterator* iter = db_->NewIterator(options);
     int found = 0;
     int k = 0;
@@ -926,6 +1348,28 @@ class Benchmark {
     std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
     thread->stats.AddMessage(msg);
   }
+  void SeekMissing(ThreadState* thread) {
+    ReadOptions options;
+    options.prefix_same_as_start = FLAGS_prefix_same_as_start;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      Iterator* iter = db_->NewIterator(options);
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      // Sorts just before the key, which has the same length.
+      std::string missing = key.slice().ToString();
+      missing.back() = '/';
+      iter->Seek(missing);
+      if (iter->Valid()) found++;
+      delete iter;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
 
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
@@ -1020,9 +1464,13 @@ class Benchmark {
 
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+  FLAGS_delayed_write_rate = leveldb::Options().delayed_write_rate;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
+  FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -1045,28 +1493,105 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0) {
+      FLAGS_compression_per_level = argv[i] + 24;
+    } else if (sscanf(argv[i], "--zstd_compression_level=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_zstd_compression_level = n;
+    } else if (sscanf(argv[i], "--zstd_max_dict_bytes=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_zstd_max_dict_bytes = n;
+    } else if (strncmp(argv[i], "--memtable_rep=", 15) == 0) {
+      FLAGS_memtable_rep = argv[i] + 15;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
+    } else if (sscanf(argv[i], "--prefix_same_as_start=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_prefix_same_as_start = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
       FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--multiget_batch_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_multiget_batch_size = n;
+    } else if (sscanf(argv[i], "--next_batch_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_next_batch_size = n;
     } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
       FLAGS_threads = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--delayed_write_rate=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_delayed_write_rate = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+      FLAGS_cache_type = argv[i] + 13;
+    } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shard_bits = n;
+    } else if (sscanf(argv[i], "--cache_protected_ratio=%lf%c", &d, &junk) ==
+               1) {
+      FLAGS_cache_protected_ratio = d;
+    } else if (sscanf(argv[i], "--cache_high_pri_pool_ratio=%lf%c", &d,
+                      &junk) == 1) {
+      FLAGS_cache_high_pri_pool_ratio = d;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (strncmp(argv[i], "--secondary_cache_type=", 23) == 0) {
+      FLAGS_secondary_cache_type = argv[i] + 23;
+    } else if (sscanf(argv[i], "--secondary_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_secondary_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strncmp(argv[i], "--bloom_type=", 13) == 0) {
+      FLAGS_bloom_type = argv[i] + 13;
+    } else if (strncmp(argv[i], "--filter_policy_per_level=", 26) == 0) {
+      FLAGS_filter_policy_per_level = argv[i] + 26;
+    } else if (strncmp(argv[i], "--filter_format=", 16) == 0) {
+      FLAGS_filter_format = argv[i] + 16;
+    } else if (sscanf(argv[i], "--filter_partition_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_filter_partition_size = n;
+    } else if (strncmp(argv[i], "--index_format=", 15) == 0) {
+      FLAGS_index_format = argv[i] + 15;
+    } else if (sscanf(argv[i], "--index_partition_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_index_partition_size = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
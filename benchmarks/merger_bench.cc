@@ -0,0 +1,116 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "table/merger.h"
+
+namespace leveldb {
+
+namespace {
+
+// Number of keys in each merge, spread evenly over the children.
+constexpr int kNumKeys = 1 << 16;
+
+// Iterates over a sorted vector of keys, so that the benchmark measures
+// the cost of merging rather than the cost of the children.
+class KeyVectorIterator : public Iterator {
+ public:
+  explicit KeyVectorIterator(const std::vector<std::string>* keys)
+      : keys_(keys), pos_(keys->size()) {}
+
+  bool Valid() const override { return pos_ < keys_->size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = keys_->empty() ? keys_->size() : keys_->size() - 1;
+  }
+  void Seek(const Slice& target) override {
+    pos_ = 0;
+    while (pos_ < keys_->size() &&
+           Slice((*keys_)[pos_]).compare(target) < 0) {
+      pos_++;
+    }
+  }
+  void Next() override { pos_++; }
+  void Prev() override { pos_ = (pos_ == 0) ? keys_->size() : pos_ - 1; }
+  Slice key() const override { return (*keys_)[pos_]; }
+  Slice value() const override { return Slice(); }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const std::vector<std::string>* const keys_;
+  size_t pos_;
+};
+
+// Deals kNumKeys consecutive keys round-robin to "fan_in" children, which
+// is the worst case for the merge: every step moves to another child.
+std::vector<std::vector<std::string>> MakeChildKeys(int fan_in) {
+  std::vector<std::vector<std::string>> child_keys(fan_in);
+  for (int i = 0; i < kNumKeys; i++) {
+    char buf[20];
+    std::snprintf(buf, sizeof(buf), "%016d", i);
+    child_keys[i % fan_in].push_back(buf);
+  }
+  return child_keys;
+}
+
+Iterator* NewMerger(const std::vector<std::vector<std::string>>& child_keys) {
+  std::vector<Iterator*> children;
+  for (const std::vector<std::string>& keys : child_keys) {
+    children.push_back(new KeyVectorIterator(&keys));
+  }
+  return NewMergingIterator(BytewiseComparator(), children.data(),
+                            children.size());
+}
+
+// Reports the time per merged key, e.g. "time/key=20ns".
+void SetTimePerKey(benchmark::State& state) {
+  state.counters["time/key"] = benchmark::Counter(
+      kNumKeys, benchmark::Counter::kIsIterationInvariantRate |
+                    benchmark::Counter::kInvert);
+}
+
+void BM_MergeForward(benchmark::State& state) {
+  std::vector<std::vector<std::string>> child_keys =
+      MakeChildKeys(state.range(0));
+  Iterator* iter = NewMerger(child_keys);
+  for (auto st : state) {
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  delete iter;
+  SetTimePerKey(state);
+}
+
+void BM_MergeReverse(benchmark::State& state) {
+  std::vector<std::vector<std::string>> child_keys =
+      MakeChildKeys(state.range(0));
+  Iterator* iter = NewMerger(child_keys);
+  for (auto st : state) {
+    int count = 0;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      count++;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  delete iter;
+  SetTimePerKey(state);
+}
+
+BENCHMARK(BM_MergeForward)->Arg(4)->Arg(16)->Arg(64);
+BENCHMARK(BM_MergeReverse)->Arg(4)->Arg(16)->Arg(64);
+
+}  // namespace
+
+}  // namespace leveldb
+
+BENCHMARK_MAIN();
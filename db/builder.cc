@@ -6,6 +6,7 @@
 
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -15,13 +16,19 @@
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() ||
+      (range_del_iter != nullptr && range_del_iter->Valid())) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -29,7 +36,11 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    bool empty = true;
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+      empty = false;
+    }
     Slice key;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
@@ -39,11 +50,45 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
       meta->largest.DecodeFrom(key);
     }
 
-    // Finish and check for builder errors
-    s = builder->Finish();
-    if (s.ok()) {
-      meta->file_size = builder->FileSize();
-      assert(meta->file_size > 0);
+    // Widen the key range of the table to the range tombstones so that
+    // reads of the keys they cover look at the table.
+    for (; range_del_iter != nullptr && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      RangeTombstone t;
+      if (!ParseRangeTombstone(range_del_iter->key(), range_del_iter->value(),
+                               &t)) {
+        s = Status::Corruption("bad range tombstone in memtable");
+        break;
+      }
+      const InternalKey start = t.start_key();
+      const InternalKey end = t.end_key();
+      if (options.comparator->Compare(start.Encode(), end.Encode()) >= 0) {
+        continue;  // Empty range
+      }
+      builder->AddRangeTombstone(range_del_iter->key(),
+                                 range_del_iter->value());
+      meta->has_range_deletions = true;
+      if (empty || options.comparator->Compare(start.Encode(),
+                                               meta->smallest.Encode()) < 0) {
+        meta->smallest = start;
+      }
+      if (empty || options.comparator->Compare(end.Encode(),
+                                               meta->largest.Encode()) > 0) {
+        meta->largest = end;
+      }
+      empty = false;
+    }
+
+    // Finish and check for builder errors.  The table is left out if all
+    // it would hold are empty ranges.
+    if (s.ok() && !empty) {
+      s = builder->Finish();
+      if (s.ok()) {
+        meta->file_size = builder->FileSize();
+        assert(meta->file_size > 0);
+      }
+    } else {
+      builder->Abandon();
     }
     delete builder;
 
@@ -57,7 +102,7 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     delete file;
     file = nullptr;
 
-    if (s.ok()) {
+    if (s.ok() && meta->file_size > 0) {
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
                                               meta->file_size);
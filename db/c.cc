@@ -25,7 +25,9 @@ using leveldb::CompressionType;
 using leveldb::DB;
 using leveldb::Env;
 using leveldb::FileLock;
+using leveldb::FilterFormat;
 using leveldb::FilterPolicy;
+using leveldb::IndexFormat;
 using leveldb::Iterator;
 using leveldb::kMajorVersion;
 using leveldb::kMinorVersion;
@@ -33,6 +35,7 @@ using leveldb::Logger;
 using leveldb::NewBloomFilterPolicy;
 using leveldb::NewLRUCache;
 using leveldb::Options;
+using leveldb::PinnableSlice;
 using leveldb::RandomAccessFile;
 using leveldb::Range;
 using leveldb::ReadOptions;
@@ -85,6 +88,9 @@ struct leveldb_logger_t {
 struct leveldb_filelock_t {
   FileLock* rep;
 };
+struct leveldb_pinnableslice_t {
+  PinnableSlice rep;
+};
 
 struct leveldb_comparator_t : public Comparator {
   ~leveldb_comparator_t() override { (*destructor_)(state_); }
@@ -216,6 +222,21 @@ char* leveldb_get(leveldb_t* db, const leveldb_readoptions_t* options,
   return result;
 }
 
+leveldb_pinnableslice_t* leveldb_get_pinned(
+    leveldb_t* db, const leveldb_readoptions_t* options, const char* key,
+    size_t keylen, char** errptr) {
+  leveldb_pinnableslice_t* result = new leveldb_pinnableslice_t;
+  Status s = db->rep->Get(options->rep, Slice(key, keylen), &result->rep);
+  if (!s.ok()) {
+    delete result;
+    result = nullptr;
+    if (!s.IsNotFound()) {
+      SaveError(errptr, s);
+    }
+  }
+  return result;
+}
+
 leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db, const leveldb_readoptions_t* options) {
   leveldb_iterator_t* result = new leveldb_iterator_t;
@@ -321,6 +342,14 @@ void leveldb_iter_get_error(const leveldb_iterator_t* iter, char** errptr) {
   SaveError(errptr, iter->rep->status());
 }
 
+void leveldb_pinnableslice_destroy(leveldb_pinnableslice_t* v) { delete v; }
+
+const char* leveldb_pinnableslice_value(const leveldb_pinnableslice_t* v,
+                                        size_t* vlen) {
+  *vlen = v->rep.size();
+  return v->rep.data();
+}
+
 leveldb_writebatch_t* leveldb_writebatch_create() {
   return new leveldb_writebatch_t;
 }
@@ -414,6 +443,11 @@ void leveldb_options_set_cache(leveldb_options_t* opt, leveldb_cache_t* c) {
   opt->rep.block_cache = c->rep;
 }
 
+void leveldb_options_set_cache_index_and_filter_blocks(leveldb_options_t* opt,
+                                                       uint8_t v) {
+  opt->rep.cache_index_and_filter_blocks = v;
+}
+
 void leveldb_options_set_block_size(leveldb_options_t* opt, size_t s) {
   opt->rep.block_size = s;
 }
@@ -422,14 +456,42 @@ void leveldb_options_set_block_restart_interval(leveldb_options_t* opt, int n) {
   opt->rep.block_restart_interval = n;
 }
 
+void leveldb_options_set_data_block_hash_index(leveldb_options_t* opt,
+                                               uint8_t v) {
+  opt->rep.data_block_hash_index = v;
+}
+
 void leveldb_options_set_max_file_size(leveldb_options_t* opt, size_t s) {
   opt->rep.max_file_size = s;
 }
 
+void leveldb_options_set_index_format(leveldb_options_t* opt, int f) {
+  opt->rep.index_format = static_cast<IndexFormat>(f);
+}
+
+void leveldb_options_set_index_partition_size(leveldb_options_t* opt,
+                                              size_t s) {
+  opt->rep.index_partition_size = s;
+}
+
 void leveldb_options_set_compression(leveldb_options_t* opt, int t) {
   opt->rep.compression = static_cast<CompressionType>(t);
 }
 
+void leveldb_options_set_zstd_compression_level(leveldb_options_t* opt,
+                                                int level) {
+  opt->rep.zstd_compression_level = level;
+}
+
+void leveldb_options_set_filter_format(leveldb_options_t* opt, int f) {
+  opt->rep.filter_format = static_cast<FilterFormat>(f);
+}
+
+void leveldb_options_set_filter_partition_size(leveldb_options_t* opt,
+                                               size_t s) {
+  opt->rep.filter_partition_size = s;
+}
+
 leveldb_comparator_t* leveldb_comparator_create(
     void* state, void (*destructor)(void*),
     int (*compare)(void*, const char* a, size_t alen, const char* b,
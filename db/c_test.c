@@ -65,6 +65,26 @@ static void CheckGet(
   Free(&val);
 }
 
+static void CheckGetPinned(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* key,
+    const char* expected) {
+  char* err = NULL;
+  size_t val_len;
+  const char* val;
+  leveldb_pinnableslice_t* p;
+  p = leveldb_get_pinned(db, options, key, strlen(key), &err);
+  CheckNoError(err);
+  if (p == NULL) {
+    CheckEqual(expected, NULL, 0);
+  } else {
+    val = leveldb_pinnableslice_value(p, &val_len);
+    CheckEqual(expected, val, val_len);
+    leveldb_pinnableslice_destroy(p);
+  }
+}
+
 static void CheckIter(leveldb_iterator_t* iter,
                       const char* key, const char* val) {
   size_t len;
@@ -168,6 +188,7 @@ int main(int argc, char** argv) {
   leveldb_options_set_comparator(options, cmp);
   leveldb_options_set_error_if_exists(options, 1);
   leveldb_options_set_cache(options, cache);
+  leveldb_options_set_cache_index_and_filter_blocks(options, 1);
   leveldb_options_set_env(options, env);
   leveldb_options_set_info_log(options, NULL);
   leveldb_options_set_write_buffer_size(options, 100000);
@@ -175,6 +196,7 @@ int main(int argc, char** argv) {
   leveldb_options_set_max_open_files(options, 10);
   leveldb_options_set_block_size(options, 1024);
   leveldb_options_set_block_restart_interval(options, 8);
+  leveldb_options_set_data_block_hash_index(options, 1);
   leveldb_options_set_max_file_size(options, 3 << 20);
   leveldb_options_set_compression(options, leveldb_no_compression);
 
@@ -205,15 +227,18 @@ int main(int argc, char** argv) {
   db = leveldb_open(options, dbname, &err);
   CheckNoError(err);
   CheckGet(db, roptions, "foo", NULL);
+  CheckGetPinned(db, roptions, "foo", NULL);
 
   StartPhase("put");
   leveldb_put(db, woptions, "foo", 3, "hello", 5, &err);
   CheckNoError(err);
   CheckGet(db, roptions, "foo", "hello");
+  CheckGetPinned(db, roptions, "foo", "hello");
 
   StartPhase("compactall");
   leveldb_compact_range(db, NULL, 0, NULL, 0);
   CheckGet(db, roptions, "foo", "hello");
+  CheckGetPinned(db, roptions, "foo", "hello");
 
   StartPhase("compactrange");
   leveldb_compact_range(db, "a", 1, "z", 1);
@@ -330,7 +355,7 @@ int main(int argc, char** argv) {
 
   StartPhase("filter");
   for (run = 0; run < 2; run++) {
-    // First run uses custom filter, second run uses bloom filter
+    // First run uses custom filter, second run uses partitioned bloom filter
     CheckNoError(err);
     leveldb_filterpolicy_t* policy;
     if (run == 0) {
@@ -338,6 +363,10 @@ int main(int argc, char** argv) {
           NULL, FilterDestroy, FilterCreate, FilterKeyMatch, FilterName);
     } else {
       policy = leveldb_filterpolicy_create_bloom(10);
+      leveldb_options_set_filter_format(options, leveldb_partitioned_filter);
+      leveldb_options_set_filter_partition_size(options, 64);
+      leveldb_options_set_index_format(options, leveldb_partitioned_index);
+      leveldb_options_set_index_partition_size(options, 64);
     }
 
     // Create new database
@@ -366,6 +395,7 @@ int main(int argc, char** argv) {
       CheckGet(db, roptions, "bar", "barvalue");
     }
     leveldb_options_set_filter_policy(options, NULL);
+    leveldb_options_set_filter_format(options, leveldb_full_filter);
     leveldb_filterpolicy_destroy(policy);
   }
 
@@ -8,8 +8,10 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "db/builder.h"
@@ -19,11 +21,13 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/secondary_cache.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -34,6 +38,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
@@ -42,21 +47,103 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        last_sequence(0),
+        memtable(nullptr),
+        leader(nullptr),
+        pending_inserts(0),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  SequenceNumber last_sequence;  // Of the group led by this writer
+
+  // Concurrent memtable writes: set by the group leader when this writer
+  // should insert its own batch into "memtable".
+  MemTable* memtable;
+  Writer* leader;
+  int pending_inserts;  // Leader only: inserts by other writers left
+
   port::CondVar cv;
 };
 
+namespace {
+
+// Value of local_super_version_ while its thread reads through it.
+char super_version_in_use;
+void* const kSuperVersionInUse = &super_version_in_use;
+
+}  // anonymous namespace
+
+// The memtables and the Version that reads see.  A SuperVersion holds a
+// reference to each, which are dropped under "mu" with its last reference.
+//
+// DBImpl::super_version_ holds one reference, and so does the copy cached
+// by each thread that has read since it was installed.  Reads take that
+// copy without locking mu, so that the DB mutex is only taken when a
+// thread reads for the first time after a flush or compaction.
+struct SuperVersion {
+  SuperVersion(port::Mutex* mu, MemTable* mem, MemTable* imm, Version* current)
+      EXCLUSIVE_LOCKS_REQUIRED(mu)
+      : mu(mu), mem(mem), imm(imm), current(current), refs(1) {
+    mem->Ref();
+    if (imm != nullptr) imm->Ref();
+    current->Ref();
+  }
+
+  void Ref() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+  void Unref() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      MutexLock l(mu);
+      Release();
+    }
+  }
+
+  void UnrefLocked() EXCLUSIVE_LOCKS_REQUIRED(mu) {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      Release();
+    }
+  }
+
+  port::Mutex* const mu;
+  MemTable* const mem;
+  MemTable* const imm;  // nullptr if there is none
+  Version* const current;
+
+ private:
+  void Release() EXCLUSIVE_LOCKS_REQUIRED(mu) {
+    mem->Unref();
+    if (imm != nullptr) imm->Unref();
+    current->Unref();
+    delete this;
+  }
+
+  std::atomic<int> refs;
+};
+
+// Cleanup function of iterators and values that hold a SuperVersion.
+static void UnrefSuperVersion(void* arg1, void* arg2) {
+  reinterpret_cast<SuperVersion*>(arg1)->Unref();
+}
+
+static void ReleaseCachedSuperVersion(void* ptr) {
+  if (ptr != kSuperVersionInUse) {
+    reinterpret_cast<SuperVersion*>(ptr)->Unref();
+  }
+}
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_deletions;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
@@ -64,9 +151,39 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        has_start(false),
+        has_limit(false),
+        range_tombstones(nullptr),
+        output_tombstones(nullptr),
+        has_output_start(false),
+        close_output(false),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        total_bytes(0),
+        imm_micros(0) {}
+
+  // Store in *result the parts of the output_tombstones that fall into
+  // the user key range of the next output, [output_start, *limit), where
+  // limit==nullptr means after all keys.
+  void ClipRangeTombstones(const Comparator* ucmp, const Slice* limit,
+                           std::vector<RangeTombstone>* result) const {
+    for (const RangeTombstone& t : *output_tombstones) {
+      if (limit != nullptr && ucmp->Compare(t.begin, *limit) >= 0) {
+        break;  // Sorted by begin, so no later tombstone overlaps
+      }
+      Slice begin = t.begin;
+      if (has_output_start && ucmp->Compare(begin, output_start) < 0) {
+        begin = output_start;
+      }
+      Slice end = t.end;
+      if (limit != nullptr && ucmp->Compare(end, *limit) > 0) {
+        end = *limit;
+      }
+      if (ucmp->Compare(begin, end) < 0) {
+        result->emplace_back(begin, end, t.sequence);
+      }
+    }
+  }
 
   Compaction* const compaction;
 
@@ -76,6 +193,31 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // User key range [start, limit) handled by this state when the
+  // compaction is split into subcompactions.
+  bool has_start;
+  bool has_limit;
+  std::string start;
+  std::string limit;
+
+  // Position of this state's scan over the compaction inputs.
+  Compaction::Cursor cursor;
+
+  // Range tombstones of all compaction inputs, used to drop the entries
+  // they delete, and the subset, sorted by begin key, that still deletes
+  // data in other files and so has to be written to the outputs.
+  const RangeTombstoneList* range_tombstones;
+  const std::vector<RangeTombstone>* output_tombstones;
+
+  // Outputs cover adjacent user key ranges; the next one starts at
+  // output_start.  The output_tombstones are split at the same keys.
+  bool has_output_start;
+  std::string output_start;
+
+  // Set when the current output should be finished before the next
+  // user key.
+  bool close_output;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -83,6 +225,17 @@ struct DBImpl::CompactionState {
   TableBuilder* builder;
 
   uint64_t total_bytes;
+  int64_t imm_micros;  // Micros spent doing imm_ compactions
+};
+
+// One piece of a compaction that was split by key range, run on a
+// thread of its own.
+struct DBImpl::SubcompactionJob {
+  DBImpl* db;
+  CompactionState* state;
+  Iterator* input;
+  Status status;
+  int* remaining;  // Jobs still running; guarded by db->mutex_
 };
 
 // Fix user-supplied options to be reasonable
@@ -91,17 +244,35 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
   if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
   if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
 }
-Options SanitizeOptions(const std::string& dbname,
-                        const InternalKeyComparator* icmp,
-                        const InternalFilterPolicy* ipolicy,
-                        const Options& src) {
+Options SanitizeOptions(
+    const std::string& dbname, const InternalKeyComparator* icmp,
+    const InternalFilterPolicy* ipolicy, const Options& src,
+    const std::vector<InternalFilterPolicy>* ipolicies_per_level) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.filter_policy_per_level.clear();
+  if (ipolicies_per_level != nullptr) {
+    assert(ipolicies_per_level->size() == src.filter_policy_per_level.size());
+    for (size_t i = 0; i < src.filter_policy_per_level.size(); i++) {
+      result.filter_policy_per_level.push_back(
+          src.filter_policy_per_level[i] != nullptr
+              ? &(*ipolicies_per_level)[i]
+              : nullptr);
+    }
+  }
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  if (result.delayed_write_rate == 0) {
+    result.delayed_write_rate = Options().delayed_write_rate;
+  }
+  if (result.memtable_rep == kHashSkipListRep) {
+    result.allow_concurrent_memtable_write = false;
+  }
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -118,18 +289,53 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+// Returns the options to build a table of "level" with, which differ
+// from "options" only in the compression and filter policy chosen by
+// options.compression_per_level and options.filter_policy_per_level.
+static Options TableOptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  const std::vector<CompressionType>& per_level = options.compression_per_level;
+  if (!per_level.empty()) {
+    const size_t index =
+        std::min(static_cast<size_t>(level), per_level.size() - 1);
+    result.compression = per_level[index];
+  }
+  const std::vector<const FilterPolicy*>& filter_per_level =
+      options.filter_policy_per_level;
+  if (!filter_per_level.empty()) {
+    const size_t index =
+        std::min(static_cast<size_t>(level), filter_per_level.size() - 1);
+    result.filter_policy = filter_per_level[index];
+  }
+  return result;
+}
+
 // TableCache的大小单位为SST的个数
 static int TableCacheSize(const Options& sanitized_options) {
   // Reserve ten files or so for other uses and give the rest to TableCache.
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
 }
 
+// Wraps each of options.filter_policy_per_level, which may be null.
+static std::vector<InternalFilterPolicy> InternalFilterPoliciesPerLevel(
+    const Options& options) {
+  std::vector<InternalFilterPolicy> result;
+  for (const FilterPolicy* policy : options.filter_policy_per_level) {
+    result.emplace_back(policy, options.prefix_extractor);
+  }
+  return result;
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
+      internal_filter_policies_per_level_(
+          InternalFilterPoliciesPerLevel(raw_options)),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_, raw_options,
+                               &internal_filter_policies_per_level_)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -137,27 +343,47 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       db_lock_(nullptr),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
+      manifest_write_finished_signal_(&mutex_),
       mem_(nullptr),
       imm_(nullptr),
       has_imm_(false),
+      flushing_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      super_version_(nullptr),
+      local_super_version_(new ThreadLocalPtr(&ReleaseCachedSuperVersion)),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      write_controller_(options_.delayed_write_rate),
+      memtable_writers_empty_signal_(&mutex_),
+      background_compactions_scheduled_(0),
+      background_flush_scheduled_(false),
+      compaction_pick_blocked_(false),
+      manifest_write_in_progress_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)) {
+  if (options_.max_background_compactions > 1) {
+    // One thread per compaction plus one for memtable flushes.
+    env_->SetBackgroundThreads(options_.max_background_compactions + 1);
+  }
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
+  if (super_version_ != nullptr) {
+    DropCachedSuperVersions();
+    super_version_->UnrefLocked();
+    super_version_ = nullptr;
+  }
   mutex_.Unlock();
+  delete local_super_version_;
 
   if (db_lock_ != nullptr) {
     env_->UnlockFile(db_lock_);
@@ -440,7 +666,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_);
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -486,7 +712,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_);
         mem_->Ref();
       }
     }
@@ -505,28 +731,39 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* pending_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  mem->MarkReadOnly();
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+  Options table_options = TableOptionsForLevel(options_, 0);
+  // Keep flushes fast: only compactions train zstd dictionaries.
+  table_options.zstd_max_dict_bytes = 0;
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, table_options, table_cache_, iter,
+                   range_del_iter, &meta);
     mutex_.Lock();
   }
 
   Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s",
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
+  delete range_del_iter;
   delete iter;
-  pending_outputs_.erase(meta.number);
+  if (pending_number != nullptr) {
+    *pending_number = meta.number;
+  } else {
+    pending_outputs_.erase(meta.number);
+  }
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -535,10 +772,13 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
     if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+      // Compactions running in other threads may have installed newer
+      // versions while the table was being built.
+      level = versions_->current()->PickLevelForMemTableOutput(min_user_key,
+                                                               max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest, meta.has_range_deletions);
   }
 
   CompactionStats stats;
@@ -551,12 +791,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
+  assert(!flushing_imm_.load(std::memory_order_relaxed));
+  flushing_imm_.store(true, std::memory_order_relaxed);
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t pending_number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &pending_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -567,14 +810,17 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
+  pending_outputs_.erase(pending_number);
+  flushing_imm_.store(false, std::memory_order_relaxed);
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.store(false, std::memory_order_release);
+    InstallSuperVersion();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -661,20 +907,42 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  // VersionSet::LogAndApply() releases the mutex while writing, and
+  // flushes and compactions may finish in several threads at once.
+  while (manifest_write_in_progress_) {
+    manifest_write_finished_signal_.Wait();
+  }
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_write_in_progress_ = false;
+  manifest_write_finished_signal_.SignalAll();
+  // Open() installs the first SuperVersion once mem_ is set up.
+  if (s.ok() && super_version_ != nullptr) {
+    InstallSuperVersion();
+  }
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    if (imm_ != nullptr && !background_flush_scheduled_) {
+      background_flush_scheduled_ = true;
+      env_->ScheduleHighPriority(&DBImpl::BGFlushWork, this);
+    }
+    while (background_compactions_scheduled_ <
+               options_.max_background_compactions &&
+           !compaction_pick_blocked_ &&
+           (manual_compaction_ != nullptr || versions_->NeedsCompaction())) {
+      background_compactions_scheduled_++;
+      env_->Schedule(&DBImpl::BGWork, this);
+    }
   }
 }
 
@@ -682,9 +950,32 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr && !flushing_imm_.load(std::memory_order_relaxed)) {
+    CompactMemTable();
+    // The new level-0 file may make a compaction possible that does not
+    // conflict with the running ones.
+    compaction_pick_blocked_ = false;
+  }
+
+  background_flush_scheduled_ = false;
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
@@ -693,7 +984,7 @@ void DBImpl::BackgroundCall() {
     BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
   // so reschedule another compaction if needed.
@@ -704,15 +995,15 @@ void DBImpl::BackgroundCall() {
 void DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
-  }
-
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
   if (is_manual) {
+    if (versions_->NumRunningCompactions() > 0) {
+      // Manual compactions run alone.  Retry once the others are done.
+      compaction_pick_blocked_ = true;
+      return;
+    }
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
@@ -726,6 +1017,10 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr && versions_->NumRunningCompactions() > 0) {
+      // Whatever is left conflicts with the running compactions.
+      compaction_pick_blocked_ = true;
+    }
   }
 
   Status status;
@@ -737,8 +1032,8 @@ void DBImpl::BackgroundCompaction() {
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+                       f->largest, f->has_range_deletions);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -757,7 +1052,11 @@ void DBImpl::BackgroundCompaction() {
     c->ReleaseInputs();
     RemoveObsoleteFiles();
   }
-  delete c;
+  if (c != nullptr) {
+    delete c;
+    // Compactions that conflicted with this one may be possible now.
+    compaction_pick_blocked_ = false;
+  }
 
   if (status.ok()) {
     // Done
@@ -811,6 +1110,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -819,20 +1119,51 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(
+        TableOptionsForLevel(options_, compact->compaction->level() + 1),
+        compact->outfile);
   }
   return s;
 }
 
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* limit) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
 
-  const uint64_t output_number = compact->current_output()->number;
+  CompactionState::Output* out = compact->current_output();
+  const uint64_t output_number = out->number;
   assert(output_number != 0);
 
+  // Add the pieces of the range tombstones that fall into the key range
+  // of this output; the next output starts at "limit".
+  std::vector<RangeTombstone> tombstones;
+  compact->ClipRangeTombstones(user_comparator(), limit, &tombstones);
+  for (const RangeTombstone& t : tombstones) {
+    const InternalKey start = t.start_key();
+    const InternalKey end = t.end_key();
+    compact->builder->AddRangeTombstone(start.Encode(), t.end);
+    if (compact->builder->NumEntries() == 0 && !out->has_range_deletions) {
+      out->smallest = start;
+      out->largest = end;
+    } else {
+      if (internal_comparator_.Compare(start, out->smallest) < 0) {
+        out->smallest = start;
+      }
+      if (internal_comparator_.Compare(end, out->largest) > 0) {
+        out->largest = end;
+      }
+    }
+    out->has_range_deletions = true;
+  }
+  if (limit != nullptr) {
+    compact->has_output_start = true;
+    compact->output_start.assign(limit->data(), limit->size());
+  }
+  compact->close_output = false;
+
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
@@ -842,7 +1173,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
     compact->builder->Abandon();
   }
   const uint64_t current_bytes = compact->builder->FileSize();
-  compact->current_output()->file_size = current_bytes;
+  out->file_size = current_bytes;
   compact->total_bytes += current_bytes;
   delete compact->builder;
   compact->builder = nullptr;
@@ -857,7 +1188,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = nullptr;
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() && (current_entries > 0 || out->has_range_deletions)) {
     // Verify that the table is usable
     Iterator* iter =
         table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
@@ -886,14 +1217,14 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+                                         out.smallest, out.largest,
+                                         out.has_range_deletions);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
@@ -909,40 +1240,179 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
+  // Files of the next level that lie entirely inside a range tombstone
+  // of the level being compacted are deleted without being read.
+  Compaction* const c = compact->compaction;
+  std::vector<RangeTombstone> tombstones;
+  Status status = versions_->AddInputRangeTombstones(c, 0, &tombstones);
+  if (status.ok() && !tombstones.empty()) {
+    const int dropped =
+        c->DropCoveredInputs(tombstones, compact->smallest_snapshot);
+    if (dropped > 0) {
+      Log(options_.info_log, "Dropped %d@%d files covered by range deletions",
+          dropped, c->level() + 1);
+    }
+  }
+  if (status.ok()) {
+    status = versions_->AddInputRangeTombstones(c, 1, &tombstones);
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  RangeTombstoneList range_tombstones(user_comparator(),
+                                      std::move(tombstones));
+  // A tombstone that every snapshot sees and that covers no data below
+  // the output level has done its work once the inputs are merged.
+  std::vector<RangeTombstone> output_tombstones;
+  for (const RangeTombstone& t : range_tombstones.tombstones()) {
+    if (t.sequence > compact->smallest_snapshot ||
+        !c->IsBaseLevelForRange(t.begin, t.end)) {
+      output_tombstones.push_back(t);
+    }
+  }
+  compact->range_tombstones = &range_tombstones;
+  compact->output_tombstones = &output_tombstones;
+
+  // Split the key range of large compactions into pieces that are
+  // written in parallel.  The calling thread runs the first piece.
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+  std::vector<SubcompactionJob> jobs(boundaries.size());
+  for (size_t i = 0; i < jobs.size(); i++) {
+    CompactionState* sub = new CompactionState(compact->compaction);
+    sub->smallest_snapshot = compact->smallest_snapshot;
+    sub->range_tombstones = compact->range_tombstones;
+    sub->output_tombstones = compact->output_tombstones;
+    sub->has_start = true;
+    sub->start = boundaries[i];
+    if (i + 1 < boundaries.size()) {
+      sub->has_limit = true;
+      sub->limit = boundaries[i + 1];
+    }
+    jobs[i].db = this;
+    jobs[i].state = sub;
+    jobs[i].input = versions_->MakeInputIterator(compact->compaction);
+  }
+  if (!boundaries.empty()) {
+    compact->has_limit = true;
+    compact->limit = boundaries[0];
+    Log(options_.info_log, "Compaction split into %d subcompactions",
+        static_cast<int>(boundaries.size() + 1));
+  }
+
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  int remaining = static_cast<int>(jobs.size());
+  for (size_t i = 0; i < jobs.size(); i++) {
+    jobs[i].remaining = &remaining;
+    env_->StartThread(&DBImpl::BGSubcompactionWork, &jobs[i]);
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
+  status = DoCompactionRange(compact, input);
+  delete input;
+  input = nullptr;
+  mutex_.Lock();
+
+  while (remaining > 0) {
+    background_work_finished_signal_.Wait();
+  }
+  // Gather the outputs of all pieces, in key order, so that they are
+  // installed (or cleaned up) together with the first one.
+  for (size_t i = 0; i < jobs.size(); i++) {
+    CompactionState* sub = jobs[i].state;
+    if (status.ok()) {
+      status = jobs[i].status;
+    }
+    if (sub->builder != nullptr) {
+      sub->builder->Abandon();
+      delete sub->builder;
+    }
+    delete sub->outfile;
+    compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                            sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    compact->imm_micros += sub->imm_micros;
+    delete sub;
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - compact->imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  stats_[compact->compaction->level() + 1].Add(stats);
 
-  input->SeekToFirst();
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::BGSubcompactionWork(void* arg) {
+  SubcompactionJob* job = reinterpret_cast<SubcompactionJob*>(arg);
+  DBImpl* db = job->db;
+  job->status = db->DoCompactionRange(job->state, job->input);
+  delete job->input;
+  job->input = nullptr;
+
+  MutexLock l(&db->mutex_);
+  --*job->remaining;
+  db->background_work_finished_signal_.SignalAll();
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact, Iterator* input) {
+  if (compact->has_start) {
+    InternalKey start(compact->start, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+    compact->has_output_start = true;
+    compact->output_start = compact->start;
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    // Prioritize immutable compaction work, unless another thread is
+    // already writing it out.
+    if (has_imm_.load(std::memory_order_relaxed) &&
+        !flushing_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (imm_ != nullptr && !flushing_imm_.load(std::memory_order_relaxed)) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      compact->imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_limit && key.size() >= 8 &&
+        user_comparator()->Compare(ExtractUserKey(key), compact->limit) >= 0) {
+      // The rest of the range belongs to the next subcompaction.
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
-      }
+      compact->close_output = true;
     }
-
     // Handle key/value, add to state, etc.
     bool drop = false;
     if (!ParseInternalKey(key, &ikey)) {
@@ -958,14 +1428,29 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
+
+        // Outputs are only cut between user keys, where the range
+        // tombstones are split between them too.
+        if (compact->close_output) {
+          status = FinishCompactionOutputFile(compact, input, &ikey.user_key);
+          if (!status.ok()) {
+            break;
+          }
+        }
       }
 
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;  // (A)
+      } else if (compact->range_tombstones->MaxCoveringSequence(
+                     ikey.user_key, compact->smallest_snapshot) >
+                 ikey.sequence) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                     &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -984,7 +1469,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -1005,10 +1491,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
           compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+        compact->close_output = true;
       }
     }
 
@@ -1018,88 +1501,115 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  const Slice limit(compact->limit);
+  const Slice* const output_limit = compact->has_limit ? &limit : nullptr;
+  if (status.ok() && compact->builder == nullptr) {
+    // Tombstones past the last key still need an output to live in.
+    std::vector<RangeTombstone> tombstones;
+    compact->ClipRangeTombstones(user_comparator(), output_limit, &tombstones);
+    if (!tombstones.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, output_limit);
   }
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
+  return status;
+}
 
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* old = super_version_;
+  super_version_ =
+      new SuperVersion(&mutex_, mem_, imm_, versions_->current());
+  DropCachedSuperVersions();
+  if (old != nullptr) {
+    old->UnrefLocked();
   }
+}
 
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
+void DBImpl::DropCachedSuperVersions() {
+  // A thread that is reading through its copy finds null when it gives
+  // it back, and drops it then.
+  std::vector<void*> cached;
+  local_super_version_->Scrape(&cached, nullptr);
+  for (void* ptr : cached) {
+    if (ptr != kSuperVersionInUse) {
+      reinterpret_cast<SuperVersion*>(ptr)->UnrefLocked();
+    }
   }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
 }
 
-namespace {
-
-struct IterState {
-  port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
-
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
-};
-
-static void CleanupIteratorState(void* arg1, void* arg2) {
-  IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
-  delete state;
+SuperVersion* DBImpl::GetSuperVersion() {
+  void* ptr = local_super_version_->Swap(kSuperVersionInUse);
+  assert(ptr != kSuperVersionInUse);
+  if (ptr != nullptr) {
+    return reinterpret_cast<SuperVersion*>(ptr);
+  }
+  // First read of this thread since the last InstallSuperVersion()
+  MutexLock l(&mutex_);
+  super_version_->Ref();
+  return super_version_;
 }
 
-}  // anonymous namespace
+void DBImpl::ReturnSuperVersion(SuperVersion* sv) {
+  void* expected = kSuperVersionInUse;
+  if (!local_super_version_->CompareAndSwap(sv, &expected)) {
+    // Replaced while we were reading
+    assert(expected == nullptr);
+    sv->Unref();
+  }
+}
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
-  mutex_.Lock();
+                                      uint32_t* seed,
+                                      RangeTombstoneLists** range_tombstones,
+                                      const PrefixSeekState* prefix_seek) {
+  // The iterator keeps a reference of its own.
+  SuperVersion* sv = GetSuperVersion();
+  sv->Ref();
+  ReturnSuperVersion(sv);
+  // Read after the memtables: the snapshot holds no writes to a memtable
+  // newer than sv->mem.
   *latest_snapshot = versions_->LastSequence();
 
+  if (range_tombstones != nullptr) {
+    // Each source caches its fragmented list, so that the iterator only
+    // takes references to them.
+    *range_tombstones = nullptr;
+    std::shared_ptr<const RangeTombstoneList> version_tombstones;
+    Status s = sv->current->GetRangeTombstones(&version_tombstones);
+    if (!s.ok()) {
+      sv->Unref();
+      return NewErrorIterator(s);
+    }
+    RangeTombstoneLists lists;
+    lists.Add(sv->mem->GetRangeTombstones());
+    if (sv->imm != nullptr) {
+      lists.Add(sv->imm->GetRangeTombstones());
+    }
+    lists.Add(std::move(version_tombstones));
+    if (!lists.empty()) {
+      *range_tombstones = new RangeTombstoneLists(std::move(lists));
+    }
+  }
+
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  list.push_back(sv->mem->NewIterator());
+  if (sv->imm != nullptr) {
+    list.push_back(sv->imm->NewIterator());
   }
-  versions_->current()->AddIterators(options, &list);
+  sv->current->AddIterators(options, &list, prefix_seek);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
-
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
-  internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+  internal_iter->RegisterCleanup(UnrefSuperVersion, sv, nullptr);
 
-  *seed = ++seed_;
-  mutex_.Unlock();
+  *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
   return internal_iter;
 }
 
@@ -1116,8 +1626,29 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  // Values that cannot be pinned are copied straight into *value.
+  // Memtable values are always copied: pinning them would cost two atomic
+  // updates of the SuperVersion's shared reference count.
+  PinnableSlice pinnable(value);
+  Status s = GetImpl(options, key, &pinnable, false);
+  if (s.ok() && pinnable.IsPinned()) {
+    value->assign(pinnable.data(), pinnable.size());
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   PinnableSlice* value) {
+  return GetImpl(options, key, value, true);
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options, const Slice& key,
+                       PinnableSlice* value, bool pin_memtable_values) {
+  value->Reset();
   Status s;
-  MutexLock l(&mutex_);
+  SuperVersion* sv = GetSuperVersion();
+  // Read after the memtables: the snapshot holds no writes to a memtable
+  // newer than sv->mem.
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1126,51 +1657,141 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
-  bool have_stat_update = false;
   Version::GetStats stats;
+  stats.seek_file = nullptr;  // Set by Version::Get() if it runs
+
+  // First look in the memtable, then in the immutable memtable (if any).
+  // Values found there are pinned by a reference to the SuperVersion.
+  LookupKey lkey(key, snapshot);
+  Slice mem_value;
+  if (sv->mem->Get(lkey, &mem_value, &s) ||
+      (sv->imm != nullptr && sv->imm->Get(lkey, &mem_value, &s))) {
+    if (s.ok() && pin_memtable_values) {
+      sv->Ref();
+      value->PinSlice(mem_value, &UnrefSuperVersion, sv, nullptr);
+    } else if (s.ok()) {
+      value->PinSelf(mem_value);
+    }
+  } else {
+    s = sv->current->Get(options, lkey, value, &stats);
+  }
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+  // Only lookups that had to search several files charge a seek.
+  if (stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (sv->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnSuperVersion(sv);
+  if (!s.ok()) {
+    value->Reset();
+  }
+  return s;
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const size_t n = keys.size();
+  values->clear();
+  values->resize(n);
+  statuses->assign(n, Status());
+
+  SuperVersion* sv = GetSuperVersion();
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  std::vector<Version::GetStats> stats;
+
+  // Visit the keys in sorted order so that neighbouring keys share
+  // tables and data blocks in the batched lookup below.
+  std::vector<size_t> order(n);
+  for (size_t i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  const Comparator* ucmp = user_comparator();
+  std::stable_sort(order.begin(), order.end(),
+                   [ucmp, &keys](size_t a, size_t b) {
+                     return ucmp->Compare(keys[a], keys[b]) < 0;
+                   });
+
+  // First look in the memtable, then in the immutable memtable (if any).
+  std::deque<LookupKey> lkeys;
+  std::vector<const LookupKey*> pending_keys;
+  std::vector<std::string*> pending_values;
+  std::vector<size_t> pending;
+  for (size_t i : order) {
+    lkeys.emplace_back(keys[i], snapshot);
+    const LookupKey& lkey = lkeys.back();
+    Status* s = &(*statuses)[i];
+    std::string* value = &(*values)[i];
+    if (sv->mem->Get(lkey, value, s)) {
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    } else if (sv->imm != nullptr && sv->imm->Get(lkey, value, s)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+      pending_keys.push_back(&lkey);
+      pending_values.push_back(value);
+      pending.push_back(i);
     }
-    mutex_.Lock();
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  if (!pending.empty()) {
+    std::vector<Status> pending_statuses(pending.size());
+    stats.resize(pending.size());
+    sv->current->MultiGet(options, pending.size(), pending_keys.data(),
+                          pending_values.data(), pending_statuses.data(),
+                          stats.data());
+    for (size_t j = 0; j < pending.size(); j++) {
+      (*statuses)[pending[j]] = pending_statuses[j];
+    }
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
-  return s;
+
+  // Only lookups that had to search several files charge a seek.
+  bool charge_seeks = false;
+  for (size_t i = 0; i < stats.size(); i++) {
+    if (stats[i].seek_file != nullptr) {
+      charge_seeks = true;
+    }
+  }
+  if (charge_seeks) {
+    MutexLock l(&mutex_);
+    bool need_compaction = false;
+    for (size_t i = 0; i < stats.size(); i++) {
+      if (sv->current->UpdateStats(stats[i])) {
+        need_compaction = true;
+      }
+    }
+    if (need_compaction) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnSuperVersion(sv);
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeTombstoneLists* range_tombstones;
+  PrefixSeekState* prefix_seek = nullptr;
+  if (options.prefix_same_as_start && options_.prefix_extractor != nullptr) {
+    prefix_seek = new PrefixSeekState(options_.prefix_extractor);
+  }
+  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed,
+                                       &range_tombstones, prefix_seek);
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, range_tombstones, prefix_seek);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1199,6 +1820,11 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end) {
+  return DB::DeleteRange(options, begin, end);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   Writer w(&mutex_);
   w.batch = updates;
@@ -1207,21 +1833,52 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  // A pipelined group leaves writers_ before it is done.
+  while (!w.done && (writers_.empty() || &w != writers_.front())) {
+    if (w.memtable != nullptr) {
+      // Our group is in the log; insert our part of it.
+      MemTable* mem = w.memtable;
+      w.memtable = nullptr;
+      mutex_.Unlock();
+      w.status = WriteBatchInternal::InsertIntoConcurrently(updates, mem);
+      mutex_.Lock();
+      if (--w.leader->pending_inserts == 0) {
+        w.leader->cv.Signal();
+      }
+      continue;
+    }
     w.cv.Wait();
   }
   if (w.done) {
     return w.status;
   }
 
-  // May temporarily unlock and wait.
-  Status status = MakeRoomForWrite(updates == nullptr);
-  uint64_t last_sequence = versions_->LastSequence();
+  const bool pipelined = options_.enable_pipelined_write;
   Writer* last_writer = &w;
-  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+  // A pipelined group's batch must outlive its time at the front of
+  // writers_, so it cannot share tmp_batch_.
+  WriteBatch group_batch;
+  WriteBatch* write_batch = nullptr;
+  if (updates != nullptr) {  // nullptr batch is for compactions
+    write_batch =
+        BuildBatchGroup(&last_writer, pipelined ? &group_batch : tmp_batch_);
+  }
+
+  // May temporarily unlock and wait.  A delay is charged for the group.
+  Status status = MakeRoomForWrite(
+      updates == nullptr,
+      (write_batch != nullptr) ? WriteBatchInternal::ByteSize(write_batch) : 0);
+  // Groups that still have to be inserted into mem_ have not published
+  // their sequence numbers yet.
+  uint64_t last_sequence = memtable_writers_.empty()
+                               ? versions_->LastSequence()
+                               : memtable_writers_.back()->last_sequence;
+  if (status.ok() && updates != nullptr) {
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
+    // Whether the writers of a group insert their own batches.
+    const bool concurrent =
+        options_.allow_concurrent_memtable_write && write_batch != updates;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1237,7 +1894,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !pipelined && !concurrent) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
@@ -1248,10 +1905,22 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
-    if (write_batch == tmp_batch_) tmp_batch_->Clear();
+    if (pipelined) {
+      return WriteMemTable(&w, last_writer, write_batch, last_sequence,
+                           status);
+    }
+    if (status.ok() && concurrent) {
+      std::vector<Writer*> group;
+      for (Writer* writer : writers_) {
+        group.push_back(writer);
+        if (writer == last_writer) break;
+      }
+      status = InsertConcurrently(group, write_batch, mem_);
+    }
 
     versions_->SetLastSequence(last_sequence);
   }
+  if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
   while (true) {
     Writer* ready = writers_.front();
@@ -1272,9 +1941,103 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// REQUIRES: "leader" is at the front of writers_ and has appended the
+// batch of its group, which ends with "last_writer", to the log.
+Status DBImpl::WriteMemTable(Writer* leader, Writer* last_writer,
+                             WriteBatch* write_batch,
+                             SequenceNumber last_sequence, Status status) {
+  mutex_.AssertHeld();
+  leader->last_sequence = last_sequence;
+  memtable_writers_.push_back(leader);
+
+  // Let the next group write the log while this one fills the memtable.
+  std::vector<Writer*> group;
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    group.push_back(ready);
+    if (ready == last_writer) break;
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // Insert and publish the sequence numbers in log order.
+  while (leader != memtable_writers_.front()) {
+    leader->cv.Wait();
+  }
+  if (status.ok() && options_.allow_concurrent_memtable_write &&
+      write_batch != leader->batch) {
+    status = InsertConcurrently(group, write_batch, mem_);
+  } else if (status.ok()) {
+    MemTable* mem = mem_;
+    mutex_.Unlock();
+    status = WriteBatchInternal::InsertInto(write_batch, mem);
+    mutex_.Lock();
+  }
+  versions_->SetLastSequence(last_sequence);
+  memtable_writers_.pop_front();
+  if (memtable_writers_.empty()) {
+    memtable_writers_empty_signal_.SignalAll();
+  } else {
+    memtable_writers_.front()->cv.Signal();
+  }
+
+  for (Writer* ready : group) {
+    if (ready != leader) {
+      ready->status = status;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+  }
+  return status;
+}
+
+// REQUIRES: group[0] leads "group", whose batches make up "write_batch"
+// and are in the log.
+Status DBImpl::InsertConcurrently(const std::vector<Writer*>& group,
+                                  WriteBatch* write_batch, MemTable* mem) {
+  mutex_.AssertHeld();
+  Writer* const leader = group[0];
+  SequenceNumber sequence = WriteBatchInternal::Sequence(write_batch);
+  leader->pending_inserts = 0;
+  for (Writer* w : group) {
+    if (w->batch == nullptr) {
+      continue;
+    }
+    // Each batch gets the sequence numbers it has in write_batch.
+    WriteBatchInternal::SetSequence(w->batch, sequence);
+    sequence += WriteBatchInternal::Count(w->batch);
+    if (w != leader) {
+      w->memtable = mem;
+      w->leader = leader;
+      leader->pending_inserts++;
+      w->cv.Signal();
+    }
+  }
+
+  mutex_.Unlock();
+  Status status =
+      WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+  mutex_.Lock();
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  for (Writer* w : group) {
+    if (!status.ok()) {
+      break;
+    }
+    if (w != leader && w->batch != nullptr) {
+      status = w->status;
+    }
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1311,7 +2074,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1324,28 +2087,39 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(bool force, uint64_t group_size) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
+  // Forced memtable switches are not writes, so their waits are not stalls.
+  bool stopped = false;
+  bool* const stall = force ? nullptr : &stopped;
   Status s;
+  if (!ShouldDelayWrite()) {
+    write_controller_.EndDelay();
+  }
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+    } else if (allow_delay && ShouldDelayWrite()) {
+      // We are getting close to a point where writes have to stop.
+      // Rather than stopping a single write for a long time when we get
+      // there, pace the writes at a rate that follows the compaction debt
+      // to reduce latency variance.  Also, the delays hand over some CPU
+      // to the compaction thread in case it is sharing the same core as
+      // the writer.
+      const uint64_t delay = write_controller_.GetDelay(
+          env_->NowMicros(), versions_->CompactionDebt(), group_size);
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
+      if (delay > 0) {
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(delay));
+        mutex_.Lock();
+        stall_stats_.delayed_writes++;
+        stall_stats_.delayed_micros += delay;
+      }
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1354,11 +2128,14 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
-      background_work_finished_signal_.Wait();
+      WaitForRoom(stall);
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
-      background_work_finished_signal_.Wait();
+      WaitForRoom(stall);
+    } else if (!memtable_writers_.empty()) {
+      // Pipelined writes are still being inserted into mem_.
+      memtable_writers_empty_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1376,9 +2153,11 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
       imm_ = mem_;
+      imm_->MarkReadOnly();
       has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = new MemTable(internal_comparator_, options_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1386,6 +2165,30 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+bool DBImpl::ShouldDelayWrite() {
+  mutex_.AssertHeld();
+  // Either L0 is about to hit config::kL0_StopWritesTrigger, or mem_ is
+  // filling up faster than imm_ is flushed.
+  return versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger ||
+         (imm_ != nullptr &&
+          mem_->ApproximateMemoryUsage() > options_.write_buffer_size / 2);
+}
+
+void DBImpl::WaitForRoom(bool* stopped) {
+  mutex_.AssertHeld();
+  if (stopped == nullptr) {
+    background_work_finished_signal_.Wait();
+    return;
+  }
+  if (!*stopped) {
+    *stopped = true;
+    stall_stats_.stopped_writes++;
+  }
+  const uint64_t start_micros = env_->NowMicros();
+  background_work_finished_signal_.Wait();
+  stall_stats_.stopped_micros += env_->NowMicros() - start_micros;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1443,6 +2246,41 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "block-cache-stats") {
+    const Cache* cache = options_.block_cache;
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "block cache: %llu hits, %llu misses, %llu bytes\n",
+                  static_cast<unsigned long long>(cache->LookupHits()),
+                  static_cast<unsigned long long>(cache->LookupMisses()),
+                  static_cast<unsigned long long>(cache->TotalCharge()));
+    value->append(buf);
+    const SecondaryCache* secondary = options_.secondary_cache;
+    if (secondary != nullptr) {
+      std::snprintf(buf, sizeof(buf),
+                    "secondary cache: %llu hits, %llu misses, %llu bytes\n",
+                    static_cast<unsigned long long>(secondary->LookupHits()),
+                    static_cast<unsigned long long>(secondary->LookupMisses()),
+                    static_cast<unsigned long long>(secondary->TotalCharge()));
+      value->append(buf);
+    }
+    return true;
+  } else if (in == "write-stall-stats") {
+    char buf[200];
+    std::snprintf(
+        buf, sizeof(buf),
+        "delayed writes: %llu, %.3f sec\n"
+        "stopped writes: %llu, %.3f sec\n"
+        "delayed write rate: %llu bytes/sec\n"
+        "compaction debt: %llu bytes\n",
+        static_cast<unsigned long long>(stall_stats_.delayed_writes),
+        stall_stats_.delayed_micros / 1e6,
+        static_cast<unsigned long long>(stall_stats_.stopped_writes),
+        stall_stats_.stopped_micros / 1e6,
+        static_cast<unsigned long long>(write_controller_.rate()),
+        static_cast<unsigned long long>(versions_->CompactionDebt()));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1480,6 +2318,35 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  std::string copy;
+  Status s = Get(options, key, &copy);
+  if (s.ok()) {
+    value->PinSelf(copy);
+  }
+  return s;
+}
+
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->clear();
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(options, keys[i], &(*values)[i]);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1502,16 +2369,17 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = new MemTable(impl->internal_comparator_, impl->options_);
       impl->mem_->Ref();
     }
   }
   if (s.ok() && save_manifest) {
     edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
     edit.SetLogNumber(impl->logfile_number_);
-    s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+    s = impl->LogAndApply(&edit);
   }
   if (s.ok()) {
+    impl->InstallSuperVersion();
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -21,7 +23,11 @@
 namespace leveldb {
 
 class MemTable;
+struct PrefixSeekState;
+class RangeTombstoneLists;
+struct SuperVersion;
 class TableCache;
+class ThreadLocalPtr;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -39,9 +45,16 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, const Slice& begin,
+                     const Slice& end) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -74,6 +87,7 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionJob;
   struct Writer;
 
   // Information for a manual compaction
@@ -101,9 +115,45 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
-  Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+  // Writes that MakeRoomForWrite() delayed to let compactions catch up,
+  // and writes that it stopped until a memtable flush or an L0 compaction
+  // finished.
+  struct WriteStallStats {
+    WriteStallStats()
+        : delayed_writes(0),
+          delayed_micros(0),
+          stopped_writes(0),
+          stopped_micros(0) {}
+
+    uint64_t delayed_writes;
+    uint64_t delayed_micros;
+    uint64_t stopped_writes;
+    uint64_t stopped_micros;
+  };
+
+  // Implements both Get()s.  Values found in a memtable are copied into
+  // *value unless "pin_memtable_values" is set.
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 PinnableSlice* value, bool pin_memtable_values);
+
+  // If "range_tombstones" is non-null, also stores there the range
+  // tombstones that the returned iterator does not yield (or nullptr if
+  // there are none), which the caller must delete.  The table iterators
+  // follow "prefix_seek" if it is non-null.
+  Iterator* NewInternalIterator(
+      const ReadOptions&, SequenceNumber* latest_snapshot, uint32_t* seed,
+      RangeTombstoneLists** range_tombstones = nullptr,
+      const PrefixSeekState* prefix_seek = nullptr);
+
+  // Replaces super_version_ after a change of mem_, imm_ or the current
+  // Version, and drops the copies cached by threads.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns the current SuperVersion, usually from the cache of the
+  // calling thread without taking mutex_.  The same thread must give it
+  // back with ReturnSuperVersion().
+  SuperVersion* GetSuperVersion() LOCKS_EXCLUDED(mutex_);
+  void ReturnSuperVersion(SuperVersion* sv) LOCKS_EXCLUDED(mutex_);
+  void DropCachedSuperVersions() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status NewDB();
 
@@ -127,27 +177,64 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // If "pending_number" is non-null the new table stays in pending_outputs_
+  // and its number is stored there; the caller must erase it once "edit"
+  // has been applied, since other compactions may delete obsolete files
+  // in the meantime.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* pending_number = nullptr)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */)
+  // Makes room in mem_ for the write group of the writer at the front of
+  // writers_, which holds "group_size" bytes, delaying it if needed.
+  Status MakeRoomForWrite(bool force /* compact even if there is room? */,
+                          uint64_t group_size) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Whether MakeRoomForWrite() should delay writes to let background work
+  // catch up before writes have to stop.
+  bool ShouldDelayWrite() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Waits in MakeRoomForWrite() for background work to finish.  Unless
+  // "stopped" is null, the wait counts as a stall of the write, which is
+  // only counted once while *stopped is set.
+  void WaitForRoom(bool* stopped) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Second stage of a pipelined write: insert the group led by "leader"
+  // into mem_ once all earlier groups are in.  Returns the group's status.
+  Status WriteMemTable(Writer* leader, Writer* last_writer,
+                       WriteBatch* write_batch, SequenceNumber last_sequence,
+                       Status status) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Have the writers of "group" insert their own batches into "mem" in
+  // parallel.  Returns the first error.
+  Status InsertConcurrently(const std::vector<Writer*>& group,
+                            WriteBatch* write_batch, MemTable* mem)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
+  // Apply *edit to the current version through versions_, waiting for any
+  // other thread that is writing to the MANIFEST first.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
+  static void BGFlushWork(void* db);
   void BackgroundCall();
+  void BackgroundFlushCall();
   void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Compact the part of the inputs that falls into compact's key range.
+  // Called without mutex_ held, possibly from several threads at once.
+  Status DoCompactionRange(CompactionState* compact, Iterator* input);
+  static void BGSubcompactionWork(void* arg);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Finish the current output of "compact", whose key range ends before
+  // user key "*limit" (nullptr: after all keys of its range).
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* limit);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -159,6 +246,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const std::vector<InternalFilterPolicy> internal_filter_policies_per_level_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -174,26 +262,55 @@ class DBImpl : public DB {
   port::Mutex mutex_;
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
+  port::CondVar manifest_write_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
   MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
   std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  std::atomic<bool> flushing_imm_;    // Some thread is writing out imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
-  uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
+  std::atomic<uint32_t> seed_;  // For sampling.
+
+  // The SuperVersion of the current mem_, imm_ and Version.  Each thread
+  // that reads keeps a reference to it in local_super_version_ until it
+  // is replaced.
+  SuperVersion* super_version_ GUARDED_BY(mutex_);
+  ThreadLocalPtr* const local_super_version_;
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Paces writes while ShouldDelayWrite() holds.  Each write group is
+  // charged its size before it is written.
+  WriteController write_controller_ GUARDED_BY(mutex_);
+
+  // With options_.enable_pipelined_write, the leaders of the write groups
+  // that are in the log but not yet in mem_, in log order.  mem_ is not
+  // switched while any are left.
+  std::deque<Writer*> memtable_writers_ GUARDED_BY(mutex_);
+  port::CondVar memtable_writers_empty_signal_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions that are scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a memtable flush been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Set when a background compaction found nothing to do because all
+  // candidates conflict with running compactions.  No more compactions
+  // are scheduled until a running one finishes or a memtable is flushed.
+  bool compaction_pick_blocked_ GUARDED_BY(mutex_);
+
+  // Is some thread inside versions_->LogAndApply()?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -203,14 +320,17 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+  WriteStallStats stall_stats_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
-Options SanitizeOptions(const std::string& db,
-                        const InternalKeyComparator* icmp,
-                        const InternalFilterPolicy* ipolicy,
-                        const Options& src);
+// it is not equal to src.info_log.  The entries of
+// src.filter_policy_per_level are replaced by those of
+// *ipolicies_per_level, which must wrap them, or dropped if it is null.
+Options SanitizeOptions(
+    const std::string& db, const InternalKeyComparator* icmp,
+    const InternalFilterPolicy* ipolicy, const Options& src,
+    const std::vector<InternalFilterPolicy>* ipolicies_per_level = nullptr);
 
 }  // namespace leveldb
 
@@ -7,6 +7,7 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -46,20 +47,28 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, RangeTombstoneLists* range_tombstones,
+         PrefixSeekState* prefix_seek)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
+        range_tombstones_(range_tombstones),
+        prefix_seek_(prefix_seek),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        prefix_bounded_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete range_tombstones_;
+    delete prefix_seek_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
@@ -79,6 +88,7 @@ class DBIter : public Iterator {
 
   void Next() override;
   void Prev() override;
+  int NextBatch(int n, IteratorBatch* batch) override;
   void Seek(const Slice& target) override;
   void SeekToFirst() override;
   void SeekToLast() override;
@@ -87,6 +97,37 @@ class DBIter : public Iterator {
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
+  bool ParseKey(const Slice& k, const Slice& v, ParsedInternalKey* key);
+
+  // Type of the entry "ikey" as seen at sequence_: values covered by a
+  // newer range tombstone count as deletions.
+  ValueType VisibleType(const ParsedInternalKey& ikey) const {
+    if (ikey.type == kTypeValue && range_tombstones_ != nullptr &&
+        range_tombstones_->MaxCoveringSequence(ikey.user_key, sequence_) >
+            ikey.sequence) {
+      return kTypeDeletion;
+    }
+    return ikey.type;
+  }
+
+  // True if the iterator is restricted to the prefix of its last Seek()
+  // and "user_key" does not have it.
+  bool OutsidePrefix(const Slice& user_key) const {
+    if (!prefix_bounded_) {
+      return false;
+    }
+    const SliceTransform* extractor = prefix_seek_->prefix_extractor;
+    return !extractor->InDomain(user_key) ||
+           extractor->Transform(user_key) != Slice(prefix_seek_->prefix);
+  }
+
+  // Ends the restriction to the prefix of the last Seek().
+  void ClearPrefixSeek() {
+    prefix_bounded_ = false;
+    if (prefix_seek_ != nullptr) {
+      prefix_seek_->active = false;
+    }
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -109,20 +150,27 @@ class DBIter : public Iterator {
   DBImpl* db_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
+  RangeTombstoneLists* const range_tombstones_;
+  PrefixSeekState* const prefix_seek_;  // nullptr unless prefix_same_as_start
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool prefix_bounded_;  // Restricted to prefix_seek_->prefix?
   Random rnd_;
   size_t bytes_until_read_sampling_;
+  IteratorBatch internal_batch_;  // Entries of iter_ read by NextBatch()
 };
 
 inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
-  Slice k = iter_->key();
+  return ParseKey(iter_->key(), iter_->value(), ikey);
+}
 
-  size_t bytes_read = k.size() + iter_->value().size();
+inline bool DBIter::ParseKey(const Slice& k, const Slice& v,
+                             ParsedInternalKey* ikey) {
+  size_t bytes_read = k.size() + v.size();
   while (bytes_until_read_sampling_ < bytes_read) {
     bytes_until_read_sampling_ += RandomCompactionPeriod();
     db_->RecordReadSample(k);
@@ -180,8 +228,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed && OutsidePrefix(ikey.user_key)) {
+      break;
+    }
+    if (parsed && ikey.sequence <= sequence_) {
+      switch (VisibleType(ikey)) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
@@ -198,6 +250,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeRangeDeletion:
+          // Range tombstones are not stored among the point entries.
+          break;
       }
     }
     iter_->Next();
@@ -206,9 +261,84 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+int DBIter::NextBatch(int n, IteratorBatch* batch) {
+  int count = 0;
+  if (count < n && valid_ && direction_ == kReverse) {
+    batch->Add(key(), value());
+    Next();
+    count++;
+  }
+  if (count >= n || !valid_) {
+    return count;
+  }
+
+  // iter_ is pointing at the current entry.  Copy it, and then read the
+  // following entries from iter_ in batches, running the skipping logic of
+  // FindNextUserEntry() over them.  Each internal entry yields at most one
+  // user entry, so reading no more entries than are still wanted keeps
+  // iter_ at or before the entry that becomes current.
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  batch->Add(saved_key_, iter_->value());
+  count++;
+  iter_->Next();
+  Slice skip = saved_key_;  // Points into saved_key_ or internal_batch_
+  while (count < n && iter_->Valid()) {
+    if (skip.data() != saved_key_.data()) {
+      SaveKey(skip, &saved_key_);
+      skip = saved_key_;
+    }
+    internal_batch_.Clear();
+    const int m = iter_->NextBatch(n - count, &internal_batch_);
+    for (int i = 0; i < m; i++) {
+      ParsedInternalKey ikey;
+      const bool parsed =
+          ParseKey(internal_batch_.key(i), internal_batch_.value(i), &ikey);
+      if (parsed && OutsidePrefix(ikey.user_key)) {
+        saved_key_.clear();
+        valid_ = false;
+        return count;
+      }
+      if (parsed && ikey.sequence <= sequence_) {
+        switch (VisibleType(ikey)) {
+          case kTypeDeletion:
+            skip = ikey.user_key;
+            break;
+          case kTypeValue:
+            if (user_comparator_->Compare(ikey.user_key, skip) <= 0) {
+              // Entry hidden
+            } else {
+              batch->Add(ikey.user_key, internal_batch_.value(i));
+              count++;
+              skip = ikey.user_key;
+            }
+            break;
+          case kTypeRangeDeletion:
+            break;
+        }
+      }
+    }
+  }
+  if (!iter_->Valid()) {
+    saved_key_.clear();
+    valid_ = false;
+    return count;
+  }
+  if (skip.data() != saved_key_.data()) {
+    SaveKey(skip, &saved_key_);
+  }
+  FindNextUserEntry(true, &saved_key_);
+  return count;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
+  // The table iterators must not skip tables or stop at the end of the
+  // prefix in this direction.
+  if (prefix_seek_ != nullptr) {
+    prefix_seek_->active = false;
+  }
+
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
@@ -240,13 +370,17 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      const bool parsed = ParseKey(&ikey);
+      if (parsed && OutsidePrefix(ikey.user_key)) {
+        break;
+      }
+      if (parsed && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        value_type = VisibleType(ikey);
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
@@ -278,6 +412,18 @@ void DBIter::FindPrevUserEntry() {
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
+  ClearPrefixSeek();
+  if (prefix_seek_ != nullptr &&
+      prefix_seek_->prefix_extractor->InDomain(target)) {
+    Slice prefix = prefix_seek_->prefix_extractor->Transform(target);
+    prefix_seek_->prefix.assign(prefix.data(), prefix.size());
+    prefix_seek_->filter_key.clear();
+    AppendInternalKey(&prefix_seek_->filter_key,
+                      ParsedInternalKey(prefix, kMaxSequenceNumber,
+                                        kValueTypeForSeek));
+    prefix_seek_->active = true;
+    prefix_bounded_ = true;
+  }
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
@@ -292,6 +438,7 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
+  ClearPrefixSeek();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -303,6 +450,7 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
+  ClearPrefixSeek();
   iter_->SeekToLast();
   FindPrevUserEntry();
 }
@@ -311,8 +459,10 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, RangeTombstoneLists* range_tombstones,
+                        PrefixSeekState* prefix_seek) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    range_tombstones, prefix_seek);
 }
 
 }  // namespace leveldb
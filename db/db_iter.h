@@ -6,20 +6,48 @@
 #define STORAGE_LEVELDB_DB_DB_ITER_H_
 
 #include <cstdint>
+#include <string>
 
 #include "db/dbformat.h"
 #include "leveldb/db.h"
+#include "leveldb/slice_transform.h"
 
 namespace leveldb {
 
 class DBImpl;
+class RangeTombstoneLists;
+
+// The prefix seek of an iterator opened with
+// ReadOptions::prefix_same_as_start, shared by its DBIter and the table
+// iterators beneath it.
+struct PrefixSeekState {
+  explicit PrefixSeekState(const SliceTransform* t) : prefix_extractor(t) {}
+
+  const SliceTransform* const prefix_extractor;
+
+  // Set by a forward Seek() to a key with a prefix, and cleared when the
+  // iterator is repositioned otherwise or moves backwards.  While set, the
+  // table iterators may skip the tables whose filters rule out the prefix
+  // and stop at the end of the prefix, since the DBIter yields no key past
+  // it in that direction.
+  bool active = false;
+  std::string prefix;      // User key prefix of the seek target
+  std::string filter_key;  // Internal key with user key "prefix"
+};
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Entries covered by a newer tombstone of
+// "*range_tombstones" are hidden.  Takes ownership of
+// "range_tombstones", which may be null if there are none.  If
+// "prefix_seek" is non-null, Seek() restricts the iterator to the prefix
+// of its target and publishes it there for the iterators beneath
+// "internal_iter"; takes ownership of it too.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed,
+                        RangeTombstoneLists* range_tombstones = nullptr,
+                        PrefixSeekState* prefix_seek = nullptr);
 
 }  // namespace leveldb
 
@@ -7,15 +7,19 @@
 #include <atomic>
 #include <cinttypes>
 #include <string>
+#include <thread>
 
 #include "gtest/gtest.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "helpers/memenv/memenv.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -237,6 +241,7 @@ class DBTest : public testing::Test {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    prefix_extractor_ = NewFixedPrefixTransform(3);
     dbname_ = testing::TempDir() + "db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -248,6 +253,7 @@ class DBTest : public testing::Test {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -276,6 +282,33 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kVectorMemTable:
+        options.memtable_rep = kVectorRep;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kHashSkipListMemTable:
+        options.memtable_rep = kHashSkipListRep;
+        options.memtable_hash_bucket_count = 64;
+        options.prefix_extractor = prefix_extractor_;
+        break;
+      case kFilterPartitions:
+        options.filter_policy = filter_policy_;
+        options.filter_format = kPartitionedFilter;
+        options.filter_partition_size = 64;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kIndexPartitions:
+        options.index_format = kPartitionedIndex;
+        options.index_partition_size = 64;
+        break;
       default:
         break;
     }
@@ -321,6 +354,10 @@ class DBTest : public testing::Test {
 
   Status Delete(const std::string& k) { return db_->Delete(WriteOptions(), k); }
 
+  Status DeleteRange(const std::string& begin, const std::string& end) {
+    return db_->DeleteRange(WriteOptions(), begin, end);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = nullptr) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -390,6 +427,9 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
           }
         }
         iter->Next();
@@ -532,9 +572,23 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kVectorMemTable,
+    kHashSkipListMemTable,
+    kFilterPartitions,
+    kDataBlockHashIndex,
+    kIndexPartitions,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
   int option_config_;
 };
 
@@ -607,6 +661,31 @@ TEST_F(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetSeesEachNewVersion) {
+  // Reads keep the memtables and Version of the last read of their thread
+  // until a flush or compaction replaces them.
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_EQ("v1", Get("foo"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_LEVELDB_OK(Put("foo", "v2"));
+  ASSERT_EQ("v2", Get("foo"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_LEVELDB_OK(Delete("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+
+  // Threads that read and exit while the DB stays open
+  for (int i = 0; i < 3; i++) {
+    std::string v = "v" + std::to_string(3 + i);
+    ASSERT_LEVELDB_OK(Put("foo", v));
+    std::thread reader([this, v]() { ASSERT_EQ(v, Get("foo")); });
+    reader.join();
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("v5", Get("foo"));
+}
+
 TEST_F(DBTest, GetFromVersions) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -615,6 +694,45 @@ TEST_F(DBTest, GetFromVersions) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetPinned) {
+  do {
+    const std::string big(10000, 'x');
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+    ASSERT_LEVELDB_OK(Put("big", big));
+    ASSERT_LEVELDB_OK(Delete("gone"));
+
+    PinnableSlice mem_value;
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &mem_value));
+    ASSERT_TRUE(mem_value.IsPinned());
+    ASSERT_EQ("v1", mem_value.ToString());
+
+    PinnableSlice missing;
+    ASSERT_TRUE(db_->Get(ReadOptions(), "gone", &missing).IsNotFound());
+    ASSERT_TRUE(db_->Get(ReadOptions(), "none", &missing).IsNotFound());
+    ASSERT_TRUE(!missing.IsPinned());
+    ASSERT_TRUE(missing.empty());
+
+    dbfull()->TEST_CompactMemTable();
+    PinnableSlice table_value;
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "big", &table_value));
+    ASSERT_EQ(big, table_value.ToString());
+
+    // Pinned values survive newer writes and compactions.
+    ASSERT_LEVELDB_OK(Put("foo", "v2"));
+    ASSERT_LEVELDB_OK(Put("big", "small"));
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    ASSERT_EQ("v1", mem_value.ToString());
+    ASSERT_EQ(big, table_value.ToString());
+    ASSERT_EQ("v2", Get("foo"));
+
+    table_value.Reset();
+    ASSERT_TRUE(!table_value.IsPinned());
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "big", &table_value));
+    ASSERT_EQ("small", table_value.ToString());
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetMemUsage) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -626,6 +744,40 @@ TEST_F(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, WriteStallStats) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &stats));
+  ASSERT_NE(std::string::npos, stats.find("delayed writes: 0, 0.000 sec\n"))
+      << stats;
+  ASSERT_NE(std::string::npos, stats.find("stopped writes: 0, 0.000 sec\n"))
+      << stats;
+
+  // Block sync calls, so that the flush of the first memtable is stuck
+  // and the write that fills the second one has to stop.
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  Put("k1", std::string(100000, 'x'));  // Fill memtable.
+  Put("k2", std::string(100000, 'y'));  // Trigger compaction.
+  std::thread writer([this]() { ASSERT_LEVELDB_OK(Put("k3", "v3")); });
+  while (stats.find("stopped writes: 1,") == std::string::npos) {
+    env_->SleepForMicroseconds(1000);
+    ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &stats));
+  }
+  // Release sync calls.
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  writer.join();
+  ASSERT_EQ("v3", Get("k3"));
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &stats));
+  ASSERT_NE(std::string::npos, stats.find("stopped writes: 1,")) << stats;
+  ASSERT_EQ(std::string::npos, stats.find("stopped writes: 1, 0.000 sec"))
+      << stats;
+}
+
 TEST_F(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -735,6 +887,57 @@ TEST_F(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread keys over a lower level, level-0 and the memtable, with
+    // overwrites and deletions at each layer.
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    ASSERT_LEVELDB_OK(Put("e", "ve1"));
+    ASSERT_LEVELDB_OK(Put("g", "vg1"));
+    Compact("a", "g");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Delete("e"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("a", "va3"));
+    ASSERT_LEVELDB_OK(Delete("g"));
+    ASSERT_LEVELDB_OK(Put("i", "vi3"));
+
+    std::vector<Slice> keys = {"g", "a", "b", "e", "c", "i", "a", "z"};
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), statuses.size());
+    const char* expected[] = {nullptr, "va3", nullptr, nullptr,
+                              "vc2",   "vi3", "va3",   nullptr};
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (expected[i] == nullptr) {
+        ASSERT_TRUE(statuses[i].IsNotFound()) << keys[i].ToString();
+      } else {
+        ASSERT_LEVELDB_OK(statuses[i]);
+        ASSERT_EQ(expected[i], values[i]);
+      }
+    }
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    db_->MultiGet(options, keys, &values, &statuses);
+    const char* expected_at_snapshot[] = {"vg1", "va1", nullptr, nullptr,
+                                          "vc2", nullptr, "va1", nullptr};
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (expected_at_snapshot[i] == nullptr) {
+        ASSERT_TRUE(statuses[i].IsNotFound()) << keys[i].ToString();
+      } else {
+        ASSERT_LEVELDB_OK(statuses[i]);
+        ASSERT_EQ(expected_at_snapshot[i], values[i]);
+      }
+    }
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -984,6 +1187,66 @@ TEST_F(DBTest, IterMultiWithDeleteAndCompaction) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, IterNextBatch) {
+  do {
+    for (int i = 0; i < 50; i++) {
+      ASSERT_LEVELDB_OK(Put("k" + std::to_string(100 + i), "v1"));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < 50; i += 3) {
+      ASSERT_LEVELDB_OK(Put("k" + std::to_string(100 + i), "v2"));
+    }
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < 50; i += 4) {
+      ASSERT_LEVELDB_OK(Delete("k" + std::to_string(100 + i)));
+    }
+    ASSERT_LEVELDB_OK(Put("k107", "v3"));
+
+    for (const Snapshot* s : {static_cast<const Snapshot*>(nullptr),
+                              snapshot}) {
+      ReadOptions options;
+      options.snapshot = s;
+      std::vector<std::string> expected;
+      Iterator* iter = db_->NewIterator(options);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        expected.push_back(IterStatus(iter));
+      }
+
+      for (int n : {1, 2, 3, 7, 100}) {
+        std::vector<std::string> actual;
+        IteratorBatch batch;
+        iter->SeekToFirst();
+        while (iter->Valid()) {
+          batch.Clear();
+          const int count = iter->NextBatch(n, &batch);
+          ASSERT_EQ(count, batch.size());
+          ASSERT_TRUE(count == n || !iter->Valid());
+          for (int i = 0; i < count; i++) {
+            actual.push_back(batch.key(i).ToString() + "->" +
+                             batch.value(i).ToString());
+          }
+        }
+        ASSERT_LEVELDB_OK(iter->status());
+        ASSERT_EQ(expected, actual) << n;
+      }
+
+      // A batch read after moving backward starts at the current entry.
+      iter->Seek("k120");
+      iter->Prev();
+      const std::string current = IterStatus(iter);
+      IteratorBatch batch;
+      ASSERT_EQ(3, iter->NextBatch(3, &batch));
+      ASSERT_EQ(current,
+                batch.key(0).ToString() + "->" + batch.value(0).ToString());
+      iter->Prev();
+      ASSERT_EQ(batch.key(2).ToString() + "->" + batch.value(2).ToString(),
+                IterStatus(iter));
+      delete iter;
+    }
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, Recover) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1143,6 +1406,242 @@ TEST_F(DBTest, RepeatedWritesToSameKey) {
   }
 }
 
+TEST_F(DBTest, MultiGetMatchesGet) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 5000;
+  for (int i = 0; i < 3 * kNumKeys; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    if (rnd.OneIn(500)) {
+      ASSERT_LEVELDB_OK(DeleteRange(Key(k), Key(k + rnd.Uniform(50))));
+    } else if (rnd.OneIn(5)) {
+      ASSERT_LEVELDB_OK(Delete(Key(k)));
+    } else {
+      ASSERT_LEVELDB_OK(Put(Key(k), RandomString(&rnd, 100)));
+    }
+  }
+
+  std::vector<std::string> key_storage;
+  for (int i = 0; i < 1000; i++) {
+    key_storage.push_back(Key(rnd.Uniform(kNumKeys + 100)));
+  }
+  std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::string value;
+    Status s = db_->Get(ReadOptions(), keys[i], &value);
+    ASSERT_EQ(s.ToString(), statuses[i].ToString());
+    if (s.ok()) {
+      ASSERT_EQ(value, values[i]);
+    }
+  }
+}
+
+TEST_F(DBTest, ParallelCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_file_size = 100000;      // Many small files per level
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 10000;
+  std::vector<std::string> values(kNumKeys);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      int k = (round == 0) ? i : rnd.Uniform(kNumKeys);
+      values[k] = RandomString(&rnd, 500);
+      ASSERT_LEVELDB_OK(Put(Key(k), values[k]));
+    }
+  }
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    ASSERT_EQ(values[count], iter->value().ToString());
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(kNumKeys, count);
+  delete iter;
+
+  // Contents must survive a reopen with a single compaction thread.
+  options.max_background_compactions = 1;
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;  // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Build several overlapping level-0 files spanning the whole key range,
+  // with deletions and a snapshot so that every piece has to keep or drop
+  // entries correctly.
+  Random rnd(301);
+  const int kNumKeys = 2000;
+  std::vector<std::string> values(kNumKeys);
+  const Snapshot* snapshot = nullptr;
+  for (int file = 0; file < 4; file++) {
+    for (int i = file % 2; i < kNumKeys; i += 2) {
+      values[i] = RandomString(&rnd, 200);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    if (file == 1) {
+      snapshot = db_->GetSnapshot();
+    }
+    for (int i = file; i < kNumKeys; i += 10) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+      values[i].clear();
+    }
+    if (file == 2) {
+      // A range tombstone that has to be split between the pieces.
+      ASSERT_LEVELDB_OK(DeleteRange(Key(kNumKeys / 4), Key(kNumKeys * 3 / 4)));
+      for (int i = kNumKeys / 4; i < kNumKeys * 3 / 4; i++) {
+        values[i].clear();
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  db_->ReleaseSnapshot(snapshot);
+
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+  int count = 0;
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(std::count_if(values.begin(), values.end(),
+                          [](const std::string& v) { return !v.empty(); }),
+            count);
+}
+
+TEST_F(DBTest, DeleteRange) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(DeleteRange("b", "d"));
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+
+    // Same results from the memtable, after a flush and after compaction.
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("vb", Get("b", snapshot));
+      ASSERT_EQ("vc", Get("c", snapshot));
+      std::vector<Slice> keys = {"a", "b", "c", "d"};
+      std::vector<std::string> values;
+      std::vector<Status> statuses;
+      db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+      ASSERT_LEVELDB_OK(statuses[0]);
+      ASSERT_TRUE(statuses[1].IsNotFound());
+      ASSERT_EQ("vc2", values[2]);
+      ASSERT_EQ("vd", values[3]);
+      if (i == 0) {
+        dbfull()->TEST_CompactMemTable();
+      } else if (i == 1) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+    }
+
+    // Without the snapshot the deleted entries are compacted away.
+    db_->ReleaseSnapshot(snapshot);
+    Reopen();
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+    }
+    ASSERT_EQ("[ ]", AllEntriesFor("b"));
+    ASSERT_EQ("[ vc2 ]", AllEntriesFor("c"));
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeAfterLookups) {
+  // Lookups cache the tombstones of the memtable; later ones must still
+  // be seen.
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    ASSERT_LEVELDB_OK(DeleteRange("a", "b"));
+    ASSERT_EQ("vc", Get("c"));
+    ASSERT_EQ("(c->vc)(e->ve)", Contents());
+    ASSERT_LEVELDB_OK(DeleteRange("c", "d"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("(e->ve)", Contents());
+    ASSERT_LEVELDB_OK(DeleteRange("b", "f"));
+    ASSERT_EQ("NOT_FOUND", Get("e"));
+    ASSERT_EQ("", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeDropsCoveredFiles) {
+  Options options = CurrentOptions();
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 10000;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  const int files = TotalTableFiles();
+  ASSERT_GE(files, 4);
+
+  ASSERT_LEVELDB_OK(DeleteRange(Key(1000), Key(9000)));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LT(TotalTableFiles(), files);
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    const int k = (count < 1000) ? count : count + 8000;
+    ASSERT_EQ(Key(k), iter->key().ToString());
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(2000, count);
+
+  // Deleting everything must not read the tables' data: rewriting them
+  // would take hundreds of block reads.
+  ASSERT_LEVELDB_OK(DeleteRange("", "z"));
+  dbfull()->TEST_CompactMemTable();
+  Reopen(&options);
+  env_->count_random_reads_ = true;
+  env_->random_read_counter_.Reset();
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LT(env_->random_read_counter_.Read(), 50);
+  env_->count_random_reads_ = false;
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("", Contents());
+}
+
 TEST_F(DBTest, SparseMerge) {
   Options options = CurrentOptions();
   options.compression = kNoCompression;
@@ -1193,6 +1692,39 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   return result;
 }
 
+TEST_F(DBTest, CompressionPerLevel) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compression_per_level = {kNoCompression, kLZ4Compression,
+                                   kZstdCompression};
+  DestroyAndReopen(&options);
+
+  const int N = 100;
+  static const int S = 10000;
+  Random rnd(301);
+  std::vector<std::string> values(N);
+  for (int i = 0; i < N; i++) {
+    test::CompressibleString(&rnd, 0.25, S, &values[i]);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  // Flushes use the level-0 entry, whatever level they are placed at.
+  ASSERT_GE(Size("", Key(N)), static_cast<uint64_t>(N * S));
+
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+  std::string compressed;
+  if (port::Zstd_Compress(1, values[0].data(), values[0].size(),
+                          &compressed)) {
+    ASSERT_LT(Size("", Key(N)), static_cast<uint64_t>(N * S / 2));
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
 TEST_F(DBTest, ApproximateSizes) {
   do {
     Options options = CurrentOptions();
@@ -1941,6 +2473,409 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, PartitionedBloomFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.filter_format = kPartitionedFilter;
+  options.filter_partition_size = 256;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Lookup present keys.  Each sstable probed costs one read of a filter
+  // partition, and the one holding the key a data block read.  The small
+  // sstable holds N/100 of the keys, so those lookups stop there; it
+  // should rarely cost a data block read for the others.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, 3 * N - N / 100);
+  ASSERT_LE(reads, 3 * N - N / 100 + 2 * N / 100);
+
+  // Lookup missing keys.  Should read one filter partition per sstable
+  // and rarely any data block.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_GE(reads, 2 * N);
+  ASSERT_LE(reads, 2 * N + 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+namespace {
+// Counts the filters built and probed through a wrapped policy.
+class CountingFilterPolicy : public FilterPolicy {
+ public:
+  explicit CountingFilterPolicy(const FilterPolicy* policy)
+      : policy_(policy), created_(0), probed_(0) {}
+  ~CountingFilterPolicy() override { delete policy_; }
+
+  const char* Name() const override { return policy_->Name(); }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    created_.fetch_add(1, std::memory_order_relaxed);
+    policy_->CreateFilter(keys, n, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    probed_.fetch_add(1, std::memory_order_relaxed);
+    return policy_->KeyMayMatch(key, filter);
+  }
+
+  int created() const { return created_.load(std::memory_order_relaxed); }
+  int probed() const { return probed_.load(std::memory_order_relaxed); }
+
+ private:
+  const FilterPolicy* const policy_;
+  mutable std::atomic<int> created_;
+  mutable std::atomic<int> probed_;
+};
+}  // namespace
+
+TEST_F(DBTest, FilterPolicyPerLevel) {
+  CountingFilterPolicy bloom(NewBloomFilterPolicy(10));
+  CountingFilterPolicy ribbon(NewRibbonFilterPolicy(10));
+  Options options = CurrentOptions();
+  options.filter_policy = &bloom;
+  options.filter_policy_per_level = {&bloom, &ribbon};
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_GT(ribbon.created(), 0);
+
+  // Tables below level 0 are read with their ribbon filters, even when
+  // they are no longer configured for new tables.
+  for (int reopen = 0; reopen < 2; reopen++) {
+    const int bloom_probed = bloom.probed();
+    const int ribbon_probed = ribbon.probed();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    ASSERT_EQ(bloom_probed, bloom.probed());
+    ASSERT_GE(ribbon.probed() - ribbon_probed, 2 * N - 1);
+
+    options.filter_policy = &ribbon;
+    options.filter_policy_per_level.clear();
+    Reopen(&options);
+  }
+  Close();
+}
+
+TEST_F(DBTest, FilterFormatsMixed) {
+  // Tables written in every filter format remain readable with each.
+  const FilterFormat formats[] = {kBlockBasedFilter, kFullFilter,
+                                  kPartitionedFilter};
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.filter_partition_size = 32;
+  for (int i = 0; i < 3; i++) {
+    options.filter_format = formats[i];
+    Reopen(&options);
+    for (int k = 0; k < 100; k++) {
+      ASSERT_LEVELDB_OK(Put(Key(i * 100 + k), "v" + std::to_string(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (FilterFormat format : formats) {
+    options.filter_format = format;
+    Reopen(&options);
+    for (int i = 0; i < 3; i++) {
+      for (int k = 0; k < 100; k++) {
+        ASSERT_EQ("v" + std::to_string(i), Get(Key(i * 100 + k)));
+      }
+    }
+    ASSERT_EQ("NOT_FOUND", Get(Key(300)));
+    ASSERT_EQ("NOT_FOUND", Get("missing"));
+  }
+  Close();
+  delete options.filter_policy;
+}
+
+namespace {
+
+std::string TenantKey(int tenant, int entity) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "t%03d|e%04d", tenant, entity);
+  return std::string(buf);
+}
+
+std::string TenantPrefix(int tenant) {
+  return TenantKey(tenant, 0).substr(0, 4);
+}
+
+// Returns the keys yielded from a Seek() to the prefix of "tenant".
+std::vector<std::string> ScanTenant(DB* db, const ReadOptions& options,
+                                    int tenant) {
+  std::vector<std::string> result;
+  Iterator* iter = db->NewIterator(options);
+  for (iter->Seek(TenantPrefix(tenant)); iter->Valid(); iter->Next()) {
+    result.push_back(iter->key().ToString());
+  }
+  EXPECT_LEVELDB_OK(iter->status());
+  delete iter;
+  return result;
+}
+
+}  // namespace
+
+TEST_F(DBTest, IndexAndFilterBlocksInBlockCache) {
+  // Blocks of memory-mapped files are never cached: use an Env that
+  // serves reads from heap buffers.
+  Env* mem_env = NewMemEnv(Env::Default());
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  for (FilterFormat format :
+       {kFullFilter, kPartitionedFilter, kBlockBasedFilter}) {
+    for (bool cache_meta : {false, true}) {
+      Cache* cache = NewLRUCache(1 << 20);
+      Options options;
+      options.env = mem_env;
+      options.create_if_missing = true;
+      options.filter_policy = policy;
+      options.filter_format = format;
+      options.filter_partition_size = 256;
+      options.block_cache = cache;
+      options.cache_index_and_filter_blocks = cache_meta;
+      DB* db;
+      ASSERT_LEVELDB_OK(DB::Open(options, "/meta_cache", &db));
+      for (int i = 0; i < 1000; i++) {
+        ASSERT_LEVELDB_OK(db->Put(WriteOptions(), Key(2 * i), Key(i)));
+      }
+      db->CompactRange(nullptr, nullptr);
+
+      // Reads that do not fill the cache still cache the meta blocks, and
+      // read them again once they are evicted.
+      ReadOptions read_options;
+      read_options.fill_cache = false;
+      for (int pass = 0; pass < 2; pass++) {
+        cache->Prune();
+        ASSERT_EQ(0, cache->TotalCharge());
+        std::string value;
+        for (int i = 0; i < 1000; i++) {
+          ASSERT_LEVELDB_OK(db->Get(read_options, Key(2 * i), &value));
+          ASSERT_EQ(Key(i), value);
+          ASSERT_TRUE(
+              db->Get(read_options, Key(2 * i + 1), &value).IsNotFound());
+        }
+        if (cache_meta) {
+          ASSERT_GT(cache->TotalCharge(), 0);
+        } else {
+          ASSERT_EQ(0, cache->TotalCharge());
+        }
+      }
+      Iterator* iter = db->NewIterator(read_options);
+      int count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+      ASSERT_EQ(1000, count);
+
+      delete db;
+      ASSERT_LEVELDB_OK(DestroyDB("/meta_cache", options));
+      delete cache;
+    }
+  }
+  delete policy;
+  delete mem_env;
+}
+
+TEST_F(DBTest, SecondaryCache) {
+  Env* mem_env = NewMemEnv(Env::Default());
+  for (int type = 0; type < 2; type++) {
+    // A block cache that keeps nothing: every block read misses it.
+    Cache* cache = NewLRUCache(0);
+    SecondaryCache* secondary =
+        type == 0 ? NewCompressedSecondaryCache(1 << 20)
+                  : NewFileSecondaryCache(mem_env, "/secondary", 1 << 20);
+    Options options;
+    options.env = mem_env;
+    options.create_if_missing = true;
+    options.block_cache = cache;
+    options.secondary_cache = secondary;
+    DB* db;
+    ASSERT_LEVELDB_OK(DB::Open(options, "/secondary_db", &db));
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_LEVELDB_OK(db->Put(WriteOptions(), Key(i), Key(i)));
+    }
+    db->CompactRange(nullptr, nullptr);
+
+    // The first pass fills the secondary cache, the second one hits it
+    // for every block.
+    uint64_t misses = 0;
+    for (int pass = 0; pass < 2; pass++) {
+      std::string value;
+      for (int i = 0; i < 1000; i++) {
+        ASSERT_LEVELDB_OK(db->Get(ReadOptions(), Key(i), &value));
+        ASSERT_EQ(Key(i), value);
+      }
+      if (pass == 0) {
+        misses = secondary->LookupMisses();
+        ASSERT_GT(misses, 0);
+      } else {
+        ASSERT_EQ(misses, secondary->LookupMisses());
+        ASSERT_GE(secondary->LookupHits(), 1000);
+      }
+    }
+    ASSERT_GE(cache->LookupMisses(), 2000);
+
+    std::string stats;
+    ASSERT_TRUE(db->GetProperty("leveldb.block-cache-stats", &stats));
+    char expected[100];
+    std::snprintf(expected, sizeof(expected),
+                  "secondary cache: %llu hits, %llu misses",
+                  static_cast<unsigned long long>(secondary->LookupHits()),
+                  static_cast<unsigned long long>(misses));
+    ASSERT_NE(std::string::npos, stats.find(expected)) << stats;
+
+    delete db;
+    ASSERT_LEVELDB_OK(DestroyDB("/secondary_db", options));
+    delete secondary;
+    delete cache;
+  }
+  delete mem_env;
+}
+
+TEST_F(DBTest, PrefixSeek) {
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(4);
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  const int kTenants = 100;
+  const int kEntities = 20;
+
+  for (FilterFormat format : {kFullFilter, kPartitionedFilter}) {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.create_if_missing = true;
+    options.prefix_extractor = prefix_extractor;
+    options.filter_policy = policy;
+    options.filter_format = format;
+    options.filter_partition_size = 64;
+    DestroyAndReopen(&options);
+
+    // Only even tenants have keys.  Spread them over several levels: the
+    // last tables all hold a new version of the first key, which keeps
+    // them above the older ones.
+    for (int tenant = 0; tenant < kTenants; tenant += 2) {
+      for (int e = 0; e < kEntities; e++) {
+        ASSERT_LEVELDB_OK(Put(TenantKey(tenant, e), "v"));
+      }
+      if (tenant % 20 == 18) {
+        if (tenant > 60) {
+          ASSERT_LEVELDB_OK(Put(TenantKey(0, 0), "v"));
+        }
+        dbfull()->TEST_CompactMemTable();
+      }
+    }
+    ASSERT_EQ("1,1,3", FilesPerLevel());
+
+    ReadOptions prefix_options;
+    prefix_options.prefix_same_as_start = true;
+    for (int tenant = 0; tenant < kTenants; tenant++) {
+      std::vector<std::string> keys =
+          ScanTenant(db_, prefix_options, tenant);
+      if (tenant % 2 == 1) {
+        ASSERT_TRUE(keys.empty()) << tenant;
+        continue;
+      }
+      ASSERT_EQ(static_cast<size_t>(kEntities), keys.size()) << tenant;
+      for (int e = 0; e < kEntities; e++) {
+        ASSERT_EQ(TenantKey(tenant, e), keys[e]);
+      }
+    }
+    // Without the option, iterators are not bounded by the prefix.
+    ASSERT_EQ(static_cast<size_t>(kTenants / 2 - 10) * kEntities,
+              ScanTenant(db_, ReadOptions(), 20).size());
+
+    // Seeks to missing prefixes skip the tables by their filters.
+    env_->count_random_reads_ = true;
+    Reopen(&options);
+    ScanTenant(db_, ReadOptions(), 0);  // Opens every table
+    env_->random_read_counter_.Reset();
+    for (int tenant = 1; tenant < kTenants; tenant += 2) {
+      ScanTenant(db_, ReadOptions(), tenant);
+    }
+    const int total_order_reads = env_->random_read_counter_.Read();
+    env_->random_read_counter_.Reset();
+    for (int tenant = 1; tenant < kTenants; tenant += 2) {
+      ScanTenant(db_, prefix_options, tenant);
+    }
+    const int prefix_reads = env_->random_read_counter_.Read();
+    env_->count_random_reads_ = false;
+    if (format == kFullFilter) {
+      ASSERT_LT(prefix_reads * 10, total_order_reads);
+    } else {
+      // The filter partitions of the test tables cannot be cached, so each
+      // probe reads one instead of an index and data block.
+      ASSERT_LT(prefix_reads, total_order_reads);
+    }
+
+    // Backward iteration stays within the prefix too.
+    Iterator* iter = db_->NewIterator(prefix_options);
+    iter->Seek(TenantKey(40, 2));
+    ASSERT_EQ(TenantKey(40, 2), iter->key().ToString());
+    iter->Prev();
+    iter->Prev();
+    ASSERT_EQ(TenantKey(40, 0), iter->key().ToString());
+    iter->Prev();
+    ASSERT_TRUE(!iter->Valid());
+    iter->Seek(TenantKey(40, kEntities - 1));
+    iter->Prev();
+    iter->Next();
+    iter->Next();
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToLast();
+    ASSERT_EQ(TenantKey(kTenants - 2, kEntities - 1), iter->key().ToString());
+    delete iter;
+
+    // Without the extractor, tables are read without their filters.
+    options.prefix_extractor = nullptr;
+    Reopen(&options);
+    ASSERT_EQ("v", Get(TenantKey(40, 3)));
+    ASSERT_EQ("NOT_FOUND", Get(TenantKey(41, 3)));
+    ASSERT_EQ(static_cast<size_t>(kTenants / 2 - 10) * kEntities,
+              ScanTenant(db_, prefix_options, 20).size());
+    Close();
+    delete options.block_cache;
+  }
+  delete policy;
+  delete prefix_extractor;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2038,6 +2973,68 @@ TEST_F(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+struct PipelinedWriter {
+  DB* db;
+  int id;
+  std::atomic<bool> done;
+};
+
+std::string PipelinedKey(int id, int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "%d.%06d", id, i);
+  return std::string(buf);
+}
+
+}  // namespace
+
+static const int kPipelinedWrites = 2000;
+
+static void PipelinedWriterBody(void* arg) {
+  PipelinedWriter* w = reinterpret_cast<PipelinedWriter*>(arg);
+  for (int i = 0; i < kPipelinedWrites; i++) {
+    std::string key = PipelinedKey(w->id, i);
+    ASSERT_LEVELDB_OK(
+        w->db->Put(WriteOptions(), key, key + std::string(100, 'v')));
+  }
+  w->done.store(true, std::memory_order_release);
+}
+
+TEST_F(DBTest, PipelinedWrite) {
+  for (bool concurrent : {false, true}) {
+    Options options = CurrentOptions();
+    options.enable_pipelined_write = true;
+    options.allow_concurrent_memtable_write = concurrent;
+    options.write_buffer_size = 10000;  // Switch memtables under load
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    PipelinedWriter writers[kNumThreads];
+    for (int id = 0; id < kNumThreads; id++) {
+      writers[id].db = db_;
+      writers[id].id = id;
+      writers[id].done.store(false, std::memory_order_release);
+      env_->StartThread(PipelinedWriterBody, &writers[id]);
+    }
+    for (int id = 0; id < kNumThreads; id++) {
+      while (!writers[id].done.load(std::memory_order_acquire)) {
+        DelayMilliseconds(10);
+      }
+    }
+
+    for (int id = 0; id < kNumThreads; id++) {
+      for (int i = 0; i < kPipelinedWrites; i++) {
+        std::string key = PipelinedKey(id, i);
+        ASSERT_EQ(key + std::string(100, 'v'), Get(key));
+      }
+    }
+    Reopen(&options);
+    ASSERT_EQ(PipelinedKey(0, 0) + std::string(100, 'v'),
+              Get(PipelinedKey(0, 0)));
+  }
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -2090,6 +3087,12 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin, const Slice& end) override {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2247,11 +3250,17 @@ TEST_F(DBTest, Randomized) {
         ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
         ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
 
-      } else if (p < 90) {  // Delete
+      } else if (p < 88) {  // Delete
         k = RandomKey(&rnd);
         ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
         ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
 
+      } else if (p < 90) {  // DeleteRange
+        k = RandomKey(&rnd);
+        v = RandomKey(&rnd);
+        ASSERT_LEVELDB_OK(model.DeleteRange(WriteOptions(), k, v));
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), k, v));
+
       } else {  // Multi-element batch
         WriteBatch b;
         const int num = rnd.Uniform(8);
@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -98,7 +99,20 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
-const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor)
+    : user_policy_(p), prefix_extractor_(p != nullptr ? prefix_extractor
+                                                      : nullptr) {
+  if (p != nullptr) {
+    name_ = p->Name();
+    if (prefix_extractor_ != nullptr) {
+      name_.append(":");
+      name_.append(prefix_extractor_->Name());
+    }
+  }
+}
+
+const char* InternalFilterPolicy::Name() const { return name_.c_str(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
@@ -109,7 +123,28 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == nullptr) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Keys arrive in order, so the keys sharing a prefix are adjacent and
+  // each prefix only needs to be added once.
+  std::vector<Slice> with_prefixes(keys, keys + n);
+  Slice last_prefix;
+  bool has_last_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!has_last_prefix || prefix != last_prefix) {
+        with_prefixes.push_back(prefix);
+        last_prefix = prefix;
+        has_last_prefix = true;
+      }
+    }
+  }
+  user_policy_->CreateFilter(with_prefixes.data(),
+                             static_cast<int>(with_prefixes.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
@@ -3,11 +3,18 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/memtable.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -18,21 +25,27 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
-
-MemTable::~MemTable() { assert(refs_ == 0); }
-
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   const Options& options)
+    : comparator_(comparator),
+      refs_(0),
+      table_(NewMemTableRep(options, comparator_, &arena_)),
+      range_del_table_(NewSkipListRep(comparator_, &arena_)),
+      num_range_deletions_(0),
+      range_tombstones_count_(0) {}
+
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete range_del_table_;
+  delete table_;
+}
 
-int MemTable::KeyComparator::operator()(const char* aptr,
-                                        const char* bptr) const {
-  // Internal keys are encoded as length-prefixed strings.
-  Slice a = GetLengthPrefixedSlice(aptr);
-  Slice b = GetLengthPrefixedSlice(bptr);
-  return comparator.Compare(a, b);
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + table_->ApproximateMemoryUsage();
 }
 
+void MemTable::MarkReadOnly() { table_->MarkReadOnly(); }
+
 // Encode a suitable internal key target for "target" and return it.
 // Uses *scratch as scratch space, and the returned pointer will point
 // into this scratch space.
@@ -46,37 +59,53 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 // memtable的迭代器
 class MemTableIterator : public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) {}
+  explicit MemTableIterator(MemTableRep::Iterator* iter) : iter_(iter) {}
 
   MemTableIterator(const MemTableIterator&) = delete;
   MemTableIterator& operator=(const MemTableIterator&) = delete;
 
-  ~MemTableIterator() override = default;
+  ~MemTableIterator() override { delete iter_; }
 
-  bool Valid() const override { return iter_.Valid(); }
-  void Seek(const Slice& k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
-  void SeekToFirst() override { iter_.SeekToFirst(); }
-  void SeekToLast() override { iter_.SeekToLast(); }
-  void Next() override { iter_.Next(); }
-  void Prev() override { iter_.Prev(); }
-  Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& k) override { iter_->Seek(EncodeKey(&tmp_, k)); }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override { return GetLengthPrefixedSlice(iter_->key()); }
   Slice value() const override {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   Status status() const override { return Status::OK(); }
 
  private:
-//  这个迭代器内部迭代的是skiplist
-  MemTable::Table::Iterator iter_;
+//  这个迭代器内部迭代的是memtable的表示(默认是skiplist)
+  MemTableRep::Iterator* const iter_;
   std::string tmp_;  // For passing to EncodeKey
 };
 
-Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+Iterator* MemTable::NewIterator() {
+  return new MemTableIterator(table_->NewIterator());
+}
+
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(range_del_table_->NewIterator());
+}
 
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
+  Insert(s, type, key, value, false);
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  Insert(s, type, key, value, true);
+}
+
+void MemTable::Insert(SequenceNumber s, ValueType type, const Slice& key,
+                      const Slice& value, bool concurrently) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -89,7 +118,8 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   const size_t encoded_len = VarintLength(internal_key_size) +
                              internal_key_size + VarintLength(val_size) +
                              val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrently ? arena_.AllocateConcurrently(encoded_len)
+                           : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -98,14 +128,68 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  MemTableRep* table = (type == kTypeRangeDeletion) ? range_del_table_ : table_;
+  if (concurrently) {
+    table->InsertConcurrently(buf);
+  } else {
+    table->Insert(buf);
+  }
+  if (type == kTypeRangeDeletion) {
+    // Counted once inserted, so that GetRangeTombstones() rebuilds its
+    // list from a skiplist that holds the tombstone.
+    num_range_deletions_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+std::shared_ptr<const RangeTombstoneList> MemTable::GetRangeTombstones() {
+  const uint64_t count = num_range_deletions_.load(std::memory_order_acquire);
+  if (count == 0) {
+    return nullptr;
+  }
+  MutexLock l(&range_tombstones_mutex_);
+  if (range_tombstones_count_ != count) {
+    // The skiplist holds at least "count" tombstones, maybe more.  The
+    // list is rebuilt again once those others are counted.
+    std::vector<RangeTombstone> tombstones;
+    std::unique_ptr<MemTableRep::Iterator> iter(
+        range_del_table_->NewIterator());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      Slice ikey = GetLengthPrefixedSlice(iter->key());
+      Slice end = GetLengthPrefixedSlice(ikey.data() + ikey.size());
+      tombstones.emplace_back(ExtractUserKey(ikey), end, ExtractSequence(ikey));
+    }
+    range_tombstones_ = std::make_shared<const RangeTombstoneList>(
+        comparator_.comparator.user_comparator(), std::move(tombstones));
+    range_tombstones_count_ = count;
+  }
+  return range_tombstones_;
+}
+
+SequenceNumber MemTable::MaxCoveringTombstone(const LookupKey& key) {
+  std::shared_ptr<const RangeTombstoneList> list = GetRangeTombstones();
+  if (list == nullptr) {
+    return 0;
+  }
+  return list->MaxCoveringSequence(key.user_key(),
+                                   ExtractSequence(key.internal_key()));
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+  Slice v;
+  if (!Get(key, &v, s)) {
+    return false;
+  }
+  if (s->ok()) {
+    value->assign(v.data(), v.size());
+  }
+  return true;
+}
+
+bool MemTable::Get(const LookupKey& key, Slice* value, Status* s) {
+  const SequenceNumber tombstone = MaxCoveringTombstone(key);
   Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  const char* entry = table_->FindGreaterOrEqual(memkey.data());
+  if (entry != nullptr) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -113,27 +197,36 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     //    vlength  varint32
     //    value    char[vlength]
     // Check that it belongs to same user key.  We do not check the
-    // sequence number since the Seek() call above should have skipped
+    // sequence number since FindGreaterOrEqual() should have skipped
     // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
             Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      if ((tag >> 8) < tombstone) {
+        // Deleted by a newer range tombstone
+        *s = Status::NotFound(Slice());
+        return true;
+      }
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
+          *value = GetLengthPrefixedSlice(key_ptr + key_length);
           return true;
         }
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           *s = Status::NotFound(Slice());
           return true;
       }
     }
   }
+  if (tombstone != 0) {
+    // Older memtables and tables only hold older entries for the key.
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
@@ -5,23 +5,30 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/memtablerep.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class RangeTombstoneList;
 
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
-  // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  // is zero and the caller must call Ref() at least once.  The entries
+  // are held in the representation chosen by options.memtable_rep.
+  MemTable(const InternalKeyComparator& comparator, const Options& options);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -50,36 +57,76 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones of the memtable, which
+  // are not yielded by NewIterator().  Keys are internal keys of type
+  // kTypeRangeDeletion and values the end keys (see db/range_tombstone.h).
+  // Same lifetime rules as NewIterator().
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  If
+  // type==kTypeRangeDeletion, key and value are the begin and end
+  // of the deleted range.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Same as Add(), but several threads may call it at once, as long as
+  // none calls Add() at the same time.
+  // REQUIRES: SupportsConcurrentInserts()
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone that
+  // covers key, store a NotFound() error in *status and return true.
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
- private:
-  friend class MemTableIterator;
-  friend class MemTableBackwardIterator;
+  // Like Get() above, but points *value at the value in the memtable,
+  // which stays valid as long as the memtable is referenced.
+  bool Get(const LookupKey& key, Slice* value, Status* s);
 
-  struct KeyComparator {
-    const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
-    int operator()(const char* a, const char* b) const;
-  };
+  // Return the range tombstones of the memtable, cut into fragments, or
+  // null if it has none.  The list is built on first use and kept until
+  // the next range tombstone is added.
+  std::shared_ptr<const RangeTombstoneList> GetRangeTombstones();
+
+  bool SupportsConcurrentInserts() const {
+    return table_->SupportsConcurrentInserts();
+  }
 
-  typedef SkipList<const char*, KeyComparator> Table;
+  // Called once nothing more will be added, so that the representation
+  // can prepare for reads only.
+  void MarkReadOnly();
+
+ private:
+  typedef MemTableRep::KeyComparator KeyComparator;
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  void Insert(SequenceNumber seq, ValueType type, const Slice& key,
+              const Slice& value, bool concurrently);
+
+  // Largest sequence number <= the sequence of "key" among the range
+  // tombstones covering its user key, or zero if there are none.
+  SequenceNumber MaxCoveringTombstone(const LookupKey& key);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
-  Table table_;
+  MemTableRep* const table_;
+  // Range tombstones, kept out of table_ in a skiplist whatever the
+  // representation of table_.
+  MemTableRep* const range_del_table_;
+  // Number of entries inserted into range_del_table_.
+  std::atomic<uint64_t> num_range_deletions_;
+
+  port::Mutex range_tombstones_mutex_;
+  // Fragments of the first range_tombstones_count_ range tombstones.
+  std::shared_ptr<const RangeTombstoneList> range_tombstones_
+      GUARDED_BY(range_tombstones_mutex_);
+  uint64_t range_tombstones_count_ GUARDED_BY(range_tombstones_mutex_);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,349 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/memtablerep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "db/skiplist.h"
+#include "leveldb/slice_transform.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = data;
+  p = GetVarint32Ptr(p, p + 5, &len);  // +5: we assume "p" is not corrupted
+  return Slice(p, len);
+}
+
+int MemTableRep::KeyComparator::operator()(const char* aptr,
+                                           const char* bptr) const {
+  // Internal keys are encoded as length-prefixed strings.
+  Slice a = GetLengthPrefixedSlice(aptr);
+  Slice b = GetLengthPrefixedSlice(bptr);
+  return comparator.Compare(a, b);
+}
+
+MemTableRep::Iterator::~Iterator() = default;
+
+MemTableRep::~MemTableRep() = default;
+
+void MemTableRep::InsertConcurrently(const char* entry) {
+  // Only reps that override SupportsConcurrentInserts() may be used here.
+  assert(false);
+  Insert(entry);
+}
+
+namespace {
+
+typedef SkipList<const char*, MemTableRep::KeyComparator> Table;
+
+class SkipListIterator : public MemTableRep::Iterator {
+ public:
+  explicit SkipListIterator(const Table* table) : iter_(table) {}
+
+  bool Valid() const override { return iter_.Valid(); }
+  const char* key() const override { return iter_.key(); }
+  void Next() override { iter_.Next(); }
+  void Prev() override { iter_.Prev(); }
+  void Seek(const char* target) override { iter_.Seek(target); }
+  void SeekToFirst() override { iter_.SeekToFirst(); }
+  void SeekToLast() override { iter_.SeekToLast(); }
+
+ private:
+  Table::Iterator iter_;
+};
+
+// Iterates over a sorted vector of entries.  If "owned" the iterator
+// deletes the vector.
+class VectorIterator : public MemTableRep::Iterator {
+ public:
+  VectorIterator(const MemTableRep::KeyComparator& cmp,
+                 const std::vector<const char*>* entries, bool owned)
+      : cmp_(cmp),
+        entries_(entries),
+        owned_(owned),
+        pos_(entries->size()) {}
+
+  ~VectorIterator() override {
+    if (owned_) {
+      delete entries_;
+    }
+  }
+
+  bool Valid() const override { return pos_ < entries_->size(); }
+  const char* key() const override {
+    assert(Valid());
+    return (*entries_)[pos_];
+  }
+  void Next() override {
+    assert(Valid());
+    ++pos_;
+  }
+  void Prev() override {
+    assert(Valid());
+    // Wraps around to an invalid position before the first entry.
+    pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+  }
+  void Seek(const char* target) override {
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                            [this](const char* a, const char* b) {
+                              return cmp_(a, b) < 0;
+                            }) -
+           entries_->begin();
+  }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+ private:
+  const MemTableRep::KeyComparator& cmp_;
+  const std::vector<const char*>* const entries_;
+  const bool owned_;
+  size_t pos_;
+};
+
+void SortEntries(const MemTableRep::KeyComparator& cmp,
+                 std::vector<const char*>* entries) {
+  std::sort(entries->begin(), entries->end(),
+            [&cmp](const char* a, const char* b) { return cmp(a, b) < 0; });
+}
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const KeyComparator& cmp, Arena* arena) : table_(cmp, arena) {}
+
+  void Insert(const char* entry) override { table_.Insert(entry); }
+
+  bool SupportsConcurrentInserts() const override { return true; }
+
+  void InsertConcurrently(const char* entry) override {
+    table_.InsertConcurrently(entry);
+  }
+
+  const char* FindGreaterOrEqual(const char* key) const override {
+    Table::Iterator iter(&table_);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  Iterator* NewIterator() const override {
+    return new SkipListIterator(&table_);
+  }
+
+ private:
+  Table table_;
+};
+
+class VectorRep : public MemTableRep {
+ public:
+  explicit VectorRep(const KeyComparator& cmp)
+      : cmp_(cmp), read_only_(false), sorted_(false) {}
+
+  void Insert(const char* entry) override {
+    MutexLock l(&mu_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+  }
+
+  bool SupportsConcurrentInserts() const override { return true; }
+
+  void InsertConcurrently(const char* entry) override { Insert(entry); }
+
+  const char* FindGreaterOrEqual(const char* key) const override {
+    if (EnsureSorted()) {
+      auto iter = std::lower_bound(
+          entries_.begin(), entries_.end(), key,
+          [this](const char* a, const char* b) { return cmp_(a, b) < 0; });
+      return (iter == entries_.end()) ? nullptr : *iter;
+    }
+    MutexLock l(&mu_);
+    const char* result = nullptr;
+    for (const char* entry : entries_) {
+      if (cmp_(entry, key) >= 0 &&
+          (result == nullptr || cmp_(entry, result) < 0)) {
+        result = entry;
+      }
+    }
+    return result;
+  }
+
+  Iterator* NewIterator() const override {
+    if (EnsureSorted()) {
+      return new VectorIterator(cmp_, &entries_, false);
+    }
+    std::vector<const char*>* copy;
+    {
+      MutexLock l(&mu_);
+      copy = new std::vector<const char*>(entries_);
+    }
+    SortEntries(cmp_, copy);
+    return new VectorIterator(cmp_, copy, true);
+  }
+
+  void MarkReadOnly() override {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  size_t ApproximateMemoryUsage() const override {
+    MutexLock l(&mu_);
+    return entries_.capacity() * sizeof(const char*);
+  }
+
+ private:
+  // Sorts entries_ on the first call after MarkReadOnly().  Returns true
+  // iff entries_ is sorted and will not change anymore.
+  bool EnsureSorted() const {
+    if (sorted_.load(std::memory_order_acquire)) {
+      return true;
+    }
+    MutexLock l(&mu_);
+    if (!read_only_) {
+      return false;
+    }
+    if (!sorted_.load(std::memory_order_relaxed)) {
+      SortEntries(cmp_, &entries_);
+      sorted_.store(true, std::memory_order_release);
+    }
+    return true;
+  }
+
+  const KeyComparator cmp_;
+  mutable port::Mutex mu_;
+  mutable std::vector<const char*> entries_;  // Sorted once read-only
+  bool read_only_ GUARDED_BY(mu_);
+  mutable std::atomic<bool> sorted_;
+};
+
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const KeyComparator& cmp, Arena* arena,
+                  const SliceTransform* transform, size_t bucket_count)
+      : cmp_(cmp),
+        arena_(arena),
+        transform_(transform),
+        bucket_count_(bucket_count),
+        buckets_(new std::atomic<Table*>[bucket_count]) {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~HashSkipListRep() override {
+    // The buckets live in the arena, so only run their destructors.
+    for (size_t i = 0; i < bucket_count_; i++) {
+      Table* bucket = buckets_[i].load(std::memory_order_relaxed);
+      if (bucket != nullptr) {
+        bucket->~Table();
+      }
+    }
+    delete[] buckets_;
+  }
+
+  void Insert(const char* entry) override {
+    std::atomic<Table*>* slot = Bucket(entry);
+    Table* bucket = slot->load(std::memory_order_relaxed);
+    if (bucket == nullptr) {
+      char* mem = arena_->AllocateAligned(sizeof(Table));
+      bucket = new (mem) Table(cmp_, arena_);
+      bucket->Insert(entry);
+      // Publish the bucket only once its first entry is linked in.
+      slot->store(bucket, std::memory_order_release);
+    } else {
+      bucket->Insert(entry);
+    }
+  }
+
+  const char* FindGreaterOrEqual(const char* key) const override {
+    Table* bucket = Bucket(key)->load(std::memory_order_acquire);
+    if (bucket == nullptr) {
+      return nullptr;
+    }
+    Table::Iterator iter(bucket);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  Iterator* NewIterator() const override {
+    std::vector<const char*>* entries = new std::vector<const char*>;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      Table* bucket = buckets_[i].load(std::memory_order_acquire);
+      if (bucket != nullptr) {
+        Table::Iterator iter(bucket);
+        for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+          entries->push_back(iter.key());
+        }
+      }
+    }
+    SortEntries(cmp_, entries);
+    return new VectorIterator(cmp_, entries, true);
+  }
+
+  size_t ApproximateMemoryUsage() const override {
+    return bucket_count_ * sizeof(std::atomic<Table*>);
+  }
+
+ private:
+  std::atomic<Table*>* Bucket(const char* entry) const {
+    Slice user_key = ExtractUserKey(GetLengthPrefixedSlice(entry));
+    Slice prefix = (transform_ != nullptr && transform_->InDomain(user_key))
+                       ? transform_->Transform(user_key)
+                       : user_key;
+    return &buckets_[Hash(prefix.data(), prefix.size(), 0) % bucket_count_];
+  }
+
+  const KeyComparator cmp_;
+  Arena* const arena_;
+  const SliceTransform* const transform_;
+  const size_t bucket_count_;
+  std::atomic<Table*>* const buckets_;
+};
+
+}  // namespace
+
+MemTableRep* NewSkipListRep(const MemTableRep::KeyComparator& cmp,
+                            Arena* arena) {
+  return new SkipListRep(cmp, arena);
+}
+
+MemTableRep* NewVectorRep(const MemTableRep::KeyComparator& cmp) {
+  return new VectorRep(cmp);
+}
+
+MemTableRep* NewHashSkipListRep(const MemTableRep::KeyComparator& cmp,
+                                Arena* arena, const SliceTransform* transform,
+                                size_t bucket_count) {
+  return new HashSkipListRep(cmp, arena, transform,
+                             std::max<size_t>(bucket_count, 1));
+}
+
+MemTableRep* NewMemTableRep(const Options& options,
+                            const MemTableRep::KeyComparator& cmp,
+                            Arena* arena) {
+  switch (options.memtable_rep) {
+    case kVectorRep:
+      return NewVectorRep(cmp);
+    case kHashSkipListRep:
+      return NewHashSkipListRep(cmp, arena, options.prefix_extractor,
+                                options.memtable_hash_bucket_count);
+    case kSkipListRep:
+    default:
+      return NewSkipListRep(cmp, arena);
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,120 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+
+#include <cstddef>
+
+#include "db/dbformat.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class Arena;
+class SliceTransform;
+
+// A MemTableRep is the data structure that holds the entries of a
+// MemTable.  Entries are allocated by the MemTable from its arena and
+// start with the length-prefixed internal key (see MemTable::Add); the
+// representation only orders and finds them.
+//
+// Inserts require external synchronization, except that several threads
+// may call InsertConcurrently() at once if SupportsConcurrentInserts().
+// Reads may run at the same time as inserts.
+class MemTableRep {
+ public:
+  // Orders entries by their internal keys.
+  struct KeyComparator {
+    const InternalKeyComparator comparator;
+    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
+    int operator()(const char* a, const char* b) const;
+  };
+
+  // Iteration over the entries in internal key order.
+  class Iterator {
+   public:
+    Iterator() = default;
+
+    Iterator(const Iterator&) = delete;
+    Iterator& operator=(const Iterator&) = delete;
+
+    virtual ~Iterator();
+
+    virtual bool Valid() const = 0;
+
+    // Returns the entry at the current position.
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+
+    // Advance to the first entry at or after the entry "target".
+    virtual void Seek(const char* target) = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+  };
+
+  MemTableRep() = default;
+
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep();
+
+  // Insert "entry".
+  // REQUIRES: nothing that compares equal to entry is in the rep.
+  virtual void Insert(const char* entry) = 0;
+
+  virtual bool SupportsConcurrentInserts() const { return false; }
+
+  // Like Insert(), but safe to call from several threads at once.  Must
+  // not run at the same time as Insert().
+  // REQUIRES: SupportsConcurrentInserts()
+  virtual void InsertConcurrently(const char* entry);
+
+  // Return the first entry at or after "key", or nullptr if there is
+  // none.  Representations that partition the entries may only search
+  // the partition of key's user key, so the result is only meaningful
+  // if it has the same user key as "key".
+  virtual const char* FindGreaterOrEqual(const char* key) const = 0;
+
+  // Return an iterator over all entries.  The caller must delete it
+  // before the rep.  It yields at least the entries inserted before it
+  // was created.
+  virtual Iterator* NewIterator() const = 0;
+
+  // Called once no more entries will be inserted.
+  virtual void MarkReadOnly() {}
+
+  // Memory used by the rep beyond what it allocates from the arena.
+  virtual size_t ApproximateMemoryUsage() const { return 0; }
+};
+
+// Return a rep that keeps the entries in a single skiplist.
+MemTableRep* NewSkipListRep(const MemTableRep::KeyComparator& cmp,
+                            Arena* arena);
+
+// Return a rep that appends the entries to a vector in O(1) and sorts it
+// once it is read-only.  Until then, lookups scan the whole vector and
+// iterators sort a copy of it.
+MemTableRep* NewVectorRep(const MemTableRep::KeyComparator& cmp);
+
+// Return a rep that hashes the user keys' prefixes under "transform"
+// (whole user keys if it is null or a key is outside its domain) into
+// "bucket_count" buckets, each a skiplist.  Lookups search one bucket;
+// iterators sort a copy of all entries.
+MemTableRep* NewHashSkipListRep(const MemTableRep::KeyComparator& cmp,
+                                Arena* arena, const SliceTransform* transform,
+                                size_t bucket_count);
+
+// Return the rep chosen by options.memtable_rep.
+MemTableRep* NewMemTableRep(const Options& options,
+                            const MemTableRep::KeyComparator& cmp,
+                            Arena* arena);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MEMTABLEREP_H_
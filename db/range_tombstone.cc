@@ -0,0 +1,104 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+bool ParseRangeTombstone(const Slice& key, const Slice& value,
+                         RangeTombstone* result) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(key, &ikey) || ikey.type != kTypeRangeDeletion) {
+    return false;
+  }
+  result->begin.assign(ikey.user_key.data(), ikey.user_key.size());
+  result->end.assign(value.data(), value.size());
+  result->sequence = ikey.sequence;
+  return true;
+}
+
+bool IsRangeTombstoneEndKey(const Slice& internal_key) {
+  ParsedInternalKey ikey;
+  return ParseInternalKey(internal_key, &ikey) &&
+         ikey.sequence == kMaxSequenceNumber &&
+         ikey.type == kTypeRangeDeletion;
+}
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator,
+                                       std::vector<RangeTombstone> tombstones)
+    : user_comparator_(user_comparator), tombstones_(std::move(tombstones)) {
+  const Comparator* ucmp = user_comparator_;
+  auto less = [ucmp](const std::string& a, const std::string& b) {
+    return ucmp->Compare(a, b) < 0;
+  };
+
+  // Drop empty ranges, they cover nothing.
+  tombstones_.erase(
+      std::remove_if(tombstones_.begin(), tombstones_.end(),
+                     [ucmp](const RangeTombstone& t) {
+                       return ucmp->Compare(t.begin, t.end) >= 0;
+                     }),
+      tombstones_.end());
+  std::stable_sort(tombstones_.begin(), tombstones_.end(),
+                   [&less](const RangeTombstone& a, const RangeTombstone& b) {
+                     return less(a.begin, b.begin);
+                   });
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  for (const RangeTombstone& t : tombstones_) {
+    points_.push_back(t.begin);
+    points_.push_back(t.end);
+  }
+  std::sort(points_.begin(), points_.end(), less);
+  points_.erase(std::unique(points_.begin(), points_.end(),
+                            [ucmp](const std::string& a, const std::string& b) {
+                              return ucmp->Compare(a, b) == 0;
+                            }),
+                points_.end());
+
+  sequences_.resize(points_.size() - 1);
+  for (const RangeTombstone& t : tombstones_) {
+    size_t i = std::lower_bound(points_.begin(), points_.end(), t.begin, less) -
+               points_.begin();
+    for (; ucmp->Compare(points_[i], t.end) < 0; i++) {
+      sequences_[i].push_back(t.sequence);
+    }
+  }
+  for (std::vector<SequenceNumber>& seqs : sequences_) {
+    std::sort(seqs.begin(), seqs.end(), std::greater<SequenceNumber>());
+  }
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  if (points_.empty()) {
+    return 0;
+  }
+  // Find the last fragment starting at or before user_key.
+  const Comparator* ucmp = user_comparator_;
+  size_t i = std::upper_bound(points_.begin(), points_.end(), user_key,
+                              [ucmp](const Slice& k, const std::string& p) {
+                                return ucmp->Compare(k, p) < 0;
+                              }) -
+             points_.begin();
+  if (i == 0 || i == points_.size()) {
+    return 0;  // Before the first or after the last tombstone
+  }
+  for (SequenceNumber s : sequences_[i - 1]) {
+    if (s <= snapshot) {
+      return s;
+    }
+  }
+  return 0;
+}
+
+}  // namespace leveldb
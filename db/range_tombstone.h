@@ -0,0 +1,119 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+// A range tombstone deletes every entry whose user key falls in
+// [begin, end) and whose sequence number is smaller than "sequence".
+//
+// Range tombstones are kept apart from the point entries: memtables
+// hold them in a separate skiplist and tables in a "leveldb.rangedel"
+// meta block.  In both places an entry maps the internal key
+// (begin, sequence, kTypeRangeDeletion) to the end key.
+struct RangeTombstone {
+  RangeTombstone() : sequence(0) {}
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.ToString()), end(e.ToString()), sequence(s) {}
+
+  // Key under which the tombstone is stored.
+  InternalKey start_key() const {
+    return InternalKey(begin, sequence, kTypeRangeDeletion);
+  }
+
+  // Smallest internal key for user key "end".  A table holding the
+  // tombstone uses it as its largest key: it sorts after every key the
+  // tombstone covers and before every entry for "end" itself.
+  InternalKey end_key() const {
+    return InternalKey(end, kMaxSequenceNumber, kValueTypeForSeek);
+  }
+
+  std::string begin;
+  std::string end;
+  SequenceNumber sequence;
+};
+
+// Attempt to parse a range tombstone stored as key => value.  On
+// success, stores it in "*result" and returns true.
+bool ParseRangeTombstone(const Slice& key, const Slice& value,
+                         RangeTombstone* result);
+
+// Returns true iff "internal_key" is the end_key() of some tombstone,
+// i.e. an exclusive upper bound rather than a key stored in the table.
+bool IsRangeTombstoneEndKey(const Slice& internal_key);
+
+// An immutable set of range tombstones.  The tombstones are cut at
+// every begin and end key into non-overlapping fragments so that the
+// ones covering a key can be found with a single binary search.
+//
+// Safe for concurrent use by multiple threads.
+class RangeTombstoneList {
+ public:
+  RangeTombstoneList(const Comparator* user_comparator,
+                     std::vector<RangeTombstone> tombstones);
+
+  RangeTombstoneList(const RangeTombstoneList&) = delete;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  bool empty() const { return tombstones_.empty(); }
+
+  // The tombstones of the list, sorted by begin key.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // Returns the largest sequence number <= snapshot of the tombstones
+  // that cover "user_key", or zero if there are none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+ private:
+  const Comparator* const user_comparator_;
+  std::vector<RangeTombstone> tombstones_;
+
+  // Fragment i covers [points_[i], points_[i+1]) and is covered by the
+  // tombstones with sequence numbers sequences_[i], in decreasing order.
+  std::vector<std::string> points_;
+  std::vector<std::vector<SequenceNumber>> sequences_;
+};
+
+// The range tombstones of several sources, looked up together.  The
+// lists are shared with the memtables and Versions that cached them.
+class RangeTombstoneLists {
+ public:
+  // Adds "list" to the set, unless it is null or empty.
+  void Add(std::shared_ptr<const RangeTombstoneList> list) {
+    if (list != nullptr && !list->empty()) {
+      lists_.push_back(std::move(list));
+    }
+  }
+
+  bool empty() const { return lists_.empty(); }
+
+  // Returns the largest sequence number <= snapshot of the tombstones
+  // of any list that cover "user_key", or zero if there are none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const {
+    SequenceNumber result = 0;
+    for (const auto& list : lists_) {
+      result = std::max(result, list->MaxCoveringSequence(user_key, snapshot));
+    }
+    return result;
+  }
+
+ private:
+  std::vector<std::shared_ptr<const RangeTombstoneList>> lists_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -48,7 +49,7 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -177,7 +178,7 @@ class Repairer {
     std::string scratch;
     Slice record;
     WriteBatch batch;
-    MemTable* mem = new MemTable(icmp_);
+    MemTable* mem = new MemTable(icmp_, options_);
     mem->Ref();
     int counter = 0;
     while (reader.ReadRecord(&record, &scratch)) {
@@ -203,7 +204,10 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
+    delete range_del_iter;
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -281,6 +285,28 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // Range tombstones extend the key range of the table.
+    std::vector<RangeTombstone> tombstones;
+    if (status.ok()) {
+      status = table_cache_->AddRangeTombstones(t.meta.number,
+                                                t.meta.file_size, &tombstones);
+    }
+    for (const RangeTombstone& tombstone : tombstones) {
+      const InternalKey start = tombstone.start_key();
+      const InternalKey end = tombstone.end_key();
+      if (empty || icmp_.Compare(start, t.meta.smallest) < 0) {
+        t.meta.smallest = start;
+      }
+      if (empty || icmp_.Compare(end, t.meta.largest) > 0) {
+        t.meta.largest = end;
+      }
+      empty = false;
+      t.meta.has_range_deletions = true;
+      if (tombstone.sequence > t.max_sequence) {
+        t.max_sequence = tombstone.sequence;
+      }
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -312,6 +338,16 @@ class Repairer {
       counter++;
     }
     delete iter;
+    std::vector<RangeTombstone> tombstones;
+    if (table_cache_->AddRangeTombstones(t.meta.number, t.meta.file_size,
+                                         &tombstones)
+            .ok()) {
+      for (const RangeTombstone& tombstone : tombstones) {
+        builder->AddRangeTombstone(tombstone.start_key().Encode(),
+                                   tombstone.end);
+        counter++;
+      }
+    }
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -369,7 +405,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, t.meta.has_range_deletions);
     }
 
     // std::fprintf(stderr,
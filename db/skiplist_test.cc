@@ -125,6 +125,71 @@ TEST(SkipTest, InsertAndLookup) {
   }
 }
 
+namespace {
+
+struct ConcurrentInserter {
+  SkipList<Key, Comparator>* list;
+  int id;
+  std::atomic<bool> done;
+};
+
+}  // namespace
+
+static const int kInserters = 4;
+static const int kInsertsPerThread = 10000;
+
+static void ConcurrentInsertBody(void* arg) {
+  ConcurrentInserter* inserter = reinterpret_cast<ConcurrentInserter*>(arg);
+  for (int i = 0; i < kInsertsPerThread; i++) {
+    inserter->list->InsertConcurrently(static_cast<Key>(i) * kInserters +
+                                       inserter->id);
+  }
+  inserter->done.store(true, std::memory_order_release);
+}
+
+TEST(SkipTest, InsertConcurrently) {
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  ConcurrentInserter inserters[kInserters];
+  for (int id = 0; id < kInserters; id++) {
+    inserters[id].list = &list;
+    inserters[id].id = id;
+    inserters[id].done.store(false, std::memory_order_release);
+    Env::Default()->StartThread(ConcurrentInsertBody, &inserters[id]);
+  }
+
+  // Readers see a sorted list while the inserts are going on.
+  bool all_done = false;
+  while (!all_done) {
+    all_done = true;
+    for (int id = 0; id < kInserters; id++) {
+      all_done &= inserters[id].done.load(std::memory_order_acquire);
+    }
+    SkipList<Key, Comparator>::Iterator iter(&list);
+    iter.SeekToFirst();
+    if (!iter.Valid()) {
+      continue;
+    }
+    Key prev = iter.key();
+    for (iter.Next(); iter.Valid(); iter.Next()) {
+      ASSERT_LT(prev, iter.key());
+      prev = iter.key();
+    }
+  }
+
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  Key expected = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    ASSERT_EQ(expected, iter.key());
+    expected++;
+  }
+  ASSERT_EQ(kInserters * kInsertsPerThread, expected);
+  for (int i = 0; i < kInserters * kInsertsPerThread; i += 97) {
+    ASSERT_TRUE(list.Contains(i));
+  }
+}
+
 // We want to make sure that with a single writer and multiple
 // concurrent readers (with no synchronization other than when a
 // reader's iterator is created), the reader always observes all the
@@ -4,6 +4,8 @@
 
 #include "db/table_cache.h"
 
+#include <utility>
+
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
@@ -14,11 +16,43 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeTombstoneList* range_tombstones;  // nullptr if the table has none
 };
 
+// Parse the range deletion block of "table", if any, into *result.
+static Status ReadRangeTombstones(const Options& options, Table* table,
+                                  RangeTombstoneList** result) {
+  *result = nullptr;
+  Iterator* iter = table->NewRangeTombstoneIterator();
+  if (iter == nullptr) {
+    return Status::OK();
+  }
+  const Comparator* ucmp =
+      static_cast<const InternalKeyComparator*>(options.comparator)
+          ->user_comparator();
+  std::vector<RangeTombstone> tombstones;
+  Status s;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    tombstones.emplace_back();
+    if (!ParseRangeTombstone(iter->key(), iter->value(), &tombstones.back())) {
+      s = Status::Corruption("bad range tombstone in table");
+      break;
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+  if (s.ok()) {
+    *result = new RangeTombstoneList(ucmp, std::move(tombstones));
+  }
+  return s;
+}
+
 // 淘汰缓存是通过delteEntry删除缓存句柄
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_tombstones;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -62,6 +96,14 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     if (s.ok()) {
       s = Table::Open(options_, file, file_size, &table);
     }
+    RangeTombstoneList* range_tombstones = nullptr;
+    if (s.ok()) {
+      s = ReadRangeTombstones(options_, table, &range_tombstones);
+      if (!s.ok()) {
+        delete table;
+        table = nullptr;
+      }
+    }
 
     if (!s.ok()) {
       assert(table == nullptr);
@@ -73,6 +115,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_tombstones = range_tombstones;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -104,12 +147,85 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&, Cleanable*)) {
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    // Releases the table, unless handle_result kept an entry of its file
+    // mapping and took over the release.
+    Cleanable table_pin;
+    table_pin.RegisterCleanup(&UnrefEntry, cache_, handle);
+    s = t->InternalGet(options, k, arg, handle_result, &table_pin);
+  }
+  return s;
+}
+
+bool TableCache::FilterMayMatch(const ReadOptions& options,
+                                uint64_t file_number, uint64_t file_size,
+                                const Slice& target, const Slice& filter_key) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, &handle).ok()) {
+    return true;
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  bool may_match = t->FilterMayMatch(options, target, filter_key);
+  cache_->Release(handle);
+  return may_match;
+}
+
+void TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                          uint64_t file_size, int n, const Slice* keys,
+                          void* const* args,
+                          void (*handle_result)(void*, const Slice&,
+                                                const Slice&, Cleanable*),
+                          Status* statuses) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    t->InternalMultiGet(options, n, keys, args, handle_result, statuses);
+    cache_->Release(handle);
+  } else {
+    for (int i = 0; i < n; i++) {
+      statuses[i] = s;
+    }
+  }
+}
+
+Status TableCache::GetCoveringTombstone(uint64_t file_number,
+                                        uint64_t file_size,
+                                        const Slice& user_key,
+                                        SequenceNumber snapshot,
+                                        SequenceNumber* sequence) {
+  *sequence = 0;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* list =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+            ->range_tombstones;
+    if (list != nullptr) {
+      *sequence = list->MaxCoveringSequence(user_key, snapshot);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::AddRangeTombstones(uint64_t file_number,
+                                      uint64_t file_size,
+                                      std::vector<RangeTombstone>* result) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* list =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+            ->range_tombstones;
+    if (list != nullptr) {
+      result->insert(result->end(), list->tombstones().begin(),
+                     list->tombstones().end());
+    }
     cache_->Release(handle);
   }
   return s;
@@ -9,8 +9,10 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
 #include "port/port.h"
@@ -41,11 +43,41 @@ class TableCache {
                         uint64_t file_size, Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value, pin).  The entry
+  // stays valid until the cleanup functions of "pin" run (see
+  // Table::InternalGet).
   // 查询指定的key
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&,
+                                   Cleanable*));
+
+  // Returns false if the filters of the specified file rule out every
+  // entry at or after internal key "target" that matches "filter_key"
+  // (see Table::FilterMayMatch).  Errors count as potential matches.
+  bool FilterMayMatch(const ReadOptions& options, uint64_t file_number,
+                      uint64_t file_size, const Slice& target,
+                      const Slice& filter_key);
+
+  // Batched form of Get() for the sorted internal keys keys[0,n-1]; the
+  // outcome of lookup i is stored in statuses[i].
+  void MultiGet(const ReadOptions& options, uint64_t file_number,
+                uint64_t file_size, int n, const Slice* keys,
+                void* const* args,
+                void (*handle_result)(void*, const Slice&, const Slice&,
+                                      Cleanable*),
+                Status* statuses);
+
+  // Store in *sequence the largest sequence number <= snapshot of the
+  // range tombstones in the specified file that cover user_key, or zero
+  // if there are none.
+  Status GetCoveringTombstone(uint64_t file_number, uint64_t file_size,
+                              const Slice& user_key, SequenceNumber snapshot,
+                              SequenceNumber* sequence);
+
+  // Append the range tombstones stored in the specified file to *result.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            std::vector<RangeTombstone>* result);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
@@ -6,7 +6,10 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <memory>
+#include <utility>
 
+#include "db/db_iter.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
@@ -18,6 +21,7 @@
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -155,22 +159,57 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
   return !BeforeFile(ucmp, largest_user_key, files[index]);
 }
 
+// Returns false if the active prefix seek "prefix_seek" rules out file
+// "f": its filters show no entry at or after "target" with the prefix.
+static bool PrefixMayMatch(TableCache* table_cache, const ReadOptions& options,
+                           const PrefixSeekState* prefix_seek,
+                           const FileMetaData* f, const Slice& target) {
+  return table_cache->FilterMayMatch(options, f->number, f->file_size, target,
+                                     prefix_seek->filter_key);
+}
+
+// Returns true if the smallest key of file "f" has the prefix of the active
+// prefix seek "prefix_seek".
+static bool StartsInPrefix(const PrefixSeekState* prefix_seek,
+                           const FileMetaData* f) {
+  const SliceTransform* extractor = prefix_seek->prefix_extractor;
+  Slice user_key = f->smallest.user_key();
+  return extractor->InDomain(user_key) &&
+         extractor->Transform(user_key) == Slice(prefix_seek->prefix);
+}
+
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
 // 16-byte value containing the file number and file size, both
 // encoded using EncodeFixed64.
 // 这个迭代器是对level大于0的SST文件进行迭代
+//
+// While "prefix_seek" is active, Seek() and Next() stop at the files that
+// cannot hold keys with its prefix: those whose filters rule out the prefix
+// and those that start past it.
 class Version::LevelFileNumIterator : public Iterator {
  public:
 //  其实是对文件元数据进行遍历
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
-      : icmp_(icmp), flist_(flist), index_(flist->size()) {  // Marks as invalid
-  }
+                       const std::vector<FileMetaData*>* flist,
+                       const PrefixSeekState* prefix_seek = nullptr,
+                       TableCache* table_cache = nullptr,
+                       const ReadOptions& options = ReadOptions())
+      : icmp_(icmp),
+        flist_(flist),
+        index_(flist->size()),  // Marks as invalid
+        prefix_seek_(prefix_seek),
+        table_cache_(table_cache),
+        options_(options) {}
   bool Valid() const override { return index_ < flist_->size(); }
   void Seek(const Slice& target) override {
     index_ = FindFile(icmp_, *flist_, target);
+    if (PrefixSeekActive() && Valid() &&
+        !PrefixMayMatch(table_cache_, options_, prefix_seek_,
+                        (*flist_)[index_], target)) {
+      index_ = flist_->size();
+    }
   }
   void SeekToFirst() override { index_ = 0; }
   void SeekToLast() override {
@@ -179,6 +218,10 @@ class Version::LevelFileNumIterator : public Iterator {
   void Next() override {
     assert(Valid());
     index_++;
+    if (PrefixSeekActive() && Valid() &&
+        !StartsInPrefix(prefix_seek_, (*flist_)[index_])) {
+      index_ = flist_->size();
+    }
   }
   void Prev() override {
     assert(Valid());
@@ -201,14 +244,87 @@ class Version::LevelFileNumIterator : public Iterator {
   Status status() const override { return Status::OK(); }
 
  private:
+  bool PrefixSeekActive() const {
+    return prefix_seek_ != nullptr && prefix_seek_->active;
+  }
+
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
+  const PrefixSeekState* const prefix_seek_;
+  TableCache* const table_cache_;
+  const ReadOptions options_;
 
   // Backing store for value().  Holds the file number and size.
   mutable char value_buf_[16];
 };
 
+namespace {
+
+// Iterator over a level-0 file for a prefix seek.  While the prefix seek
+// is active, Seek() leaves it invalid without reading the index or data
+// blocks of the file if its filters rule out the prefix.
+class PrefixFilteredFileIterator : public Iterator {
+ public:
+  PrefixFilteredFileIterator(TableCache* table_cache,
+                             const ReadOptions& options,
+                             const PrefixSeekState* prefix_seek,
+                             const FileMetaData* f)
+      : table_cache_(table_cache),
+        options_(options),
+        prefix_seek_(prefix_seek),
+        file_(f),
+        iter_(table_cache->NewIterator(options, f->number, f->file_size)),
+        ruled_out_(false) {}
+
+  ~PrefixFilteredFileIterator() override { delete iter_; }
+
+  bool Valid() const override { return !ruled_out_ && iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    ruled_out_ = prefix_seek_->active &&
+                 !PrefixMayMatch(table_cache_, options_, prefix_seek_, file_,
+                                 target);
+    if (!ruled_out_) {
+      iter_->Seek(target);
+    }
+  }
+  void SeekToFirst() override {
+    ruled_out_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    ruled_out_ = false;
+    iter_->SeekToLast();
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return iter_->key();
+  }
+  Slice value() const override {
+    assert(Valid());
+    return iter_->value();
+  }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  TableCache* const table_cache_;
+  const ReadOptions options_;
+  const PrefixSeekState* const prefix_seek_;
+  const FileMetaData* const file_;
+  Iterator* const iter_;
+  bool ruled_out_;
+};
+
+}  // namespace
+
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
@@ -221,19 +337,27 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
   }
 }
 
-Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
-                                            int level) const {
+Iterator* Version::NewConcatenatingIterator(
+    const ReadOptions& options, int level,
+    const PrefixSeekState* prefix_seek) const {
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      new LevelFileNumIterator(vset_->icmp_, &files_[level], prefix_seek,
+                               vset_->table_cache_, options),
+      &GetFileIterator, vset_->table_cache_, options);
 }
 
 void Version::AddIterators(const ReadOptions& options,
-                           std::vector<Iterator*>* iters) {
+                           std::vector<Iterator*>* iters,
+                           const PrefixSeekState* prefix_seek) {
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+    if (prefix_seek != nullptr) {
+      iters->push_back(new PrefixFilteredFileIterator(
+          vset_->table_cache_, options, prefix_seek, files_[0][i]));
+    } else {
+      iters->push_back(vset_->table_cache_->NewIterator(
+          options, files_[0][i]->number, files_[0][i]->file_size));
+    }
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -241,11 +365,38 @@ void Version::AddIterators(const ReadOptions& options,
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
     if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+      iters->push_back(NewConcatenatingIterator(options, level, prefix_seek));
     }
   }
 }
 
+Status Version::GetRangeTombstones(
+    std::shared_ptr<const RangeTombstoneList>* result) {
+  MutexLock l(&range_tombstones_mutex_);
+  if (!range_tombstones_loaded_) {
+    std::vector<RangeTombstone> tombstones;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (FileMetaData* f : files_[level]) {
+        if (f->has_range_deletions) {
+          Status s = vset_->table_cache_->AddRangeTombstones(
+              f->number, f->file_size, &tombstones);
+          if (!s.ok()) {
+            // Not cached, so that a later call tries again.
+            return s;
+          }
+        }
+      }
+    }
+    if (!tombstones.empty()) {
+      range_tombstones_ = std::make_shared<const RangeTombstoneList>(
+          vset_->icmp_.user_comparator(), std::move(tombstones));
+    }
+    range_tombstones_loaded_ = true;
+  }
+  *result = range_tombstones_;
+  return Status::OK();
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -259,9 +410,12 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  PinnableSlice* pinnable_value;  // Used instead of value if non-null
+  SequenceNumber sequence;        // Of the entry found
 };
 }  // namespace
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+static void SaveValue(void* arg, const Slice& ikey, const Slice& v,
+                      Cleanable* pin) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
@@ -269,13 +423,33 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
       s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      s->sequence = parsed_key.sequence;
       if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+        if (s->pinnable_value == nullptr) {
+          s->value->assign(v.data(), v.size());
+        } else if (pin != nullptr) {
+          s->pinnable_value->PinSlice(v, pin);
+        } else {
+          s->pinnable_value->PinSelf(v);
+        }
       }
     }
   }
 }
 
+// Applies a range tombstone with sequence number "tombstone" from the
+// file that was just searched.  Whatever the file holds for the key that
+// is older than the tombstone is deleted, and so is everything in older
+// files, which only hold older entries for the key.
+static void ApplyRangeTombstone(SequenceNumber tombstone, Saver* s) {
+  if (tombstone == 0 || s->state == kCorrupt) {
+    return;
+  }
+  if (s->state == kNotFound || s->sequence < tombstone) {
+    s->state = kDeleted;
+  }
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -324,7 +498,7 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
 }
 
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    PinnableSlice* value, GetStats* stats) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -353,6 +527,16 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
+      SequenceNumber tombstone = 0;
+      if (f->has_range_deletions) {
+        state->s = state->vset->table_cache_->GetCoveringTombstone(
+            f->number, f->file_size, state->saver.user_key,
+            ExtractSequence(state->ikey), &tombstone);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+      }
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
                                                 &state->saver, SaveValue);
@@ -360,6 +544,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
         state->found = true;
         return false;
       }
+      ApplyRangeTombstone(tombstone, &state->saver);
       switch (state->saver.state) {
         case kNotFound:
           return true;  // Keep searching in other files
@@ -394,13 +579,162 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.state = kNotFound;
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
-  state.saver.value = value;
+  state.saver.value = nullptr;
+  state.saver.pinnable_value = value;
+  state.saver.sequence = 0;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys,
+                       std::string* const* values, Status* statuses,
+                       GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+  // Per-key equivalent of the State used by Get().
+  struct KeyState {
+    Saver saver;
+    FileMetaData* last_file_read;
+    int last_file_read_level;
+    bool done;
+  };
+  std::vector<KeyState> state(n);
+  for (int i = 0; i < n; i++) {
+    KeyState* ks = &state[i];
+    ks->saver.state = kNotFound;
+    ks->saver.ucmp = ucmp;
+    ks->saver.user_key = keys[i]->user_key();
+    ks->saver.value = values[i];
+    ks->saver.pinnable_value = nullptr;
+    ks->saver.sequence = 0;
+    ks->last_file_read = nullptr;
+    ks->last_file_read_level = -1;
+    ks->done = false;
+    stats[i].seek_file = nullptr;
+    stats[i].seek_file_level = -1;
+    statuses[i] = Status::NotFound(Slice());
+  }
+
+  // Keys waiting to be looked up in "batch_file", in sorted order.
+  std::vector<int> batch;
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+  std::vector<Status> batch_statuses;
+  std::vector<SequenceNumber> batch_tombstones;
+  FileMetaData* batch_file = nullptr;
+  int batch_level = -1;
+  auto flush_batch = [&]() {
+    if (batch.empty()) {
+      return;
+    }
+    batch_keys.clear();
+    batch_args.clear();
+    for (int i : batch) {
+      KeyState* ks = &state[i];
+      if (stats[i].seek_file == nullptr && ks->last_file_read != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        stats[i].seek_file = ks->last_file_read;
+        stats[i].seek_file_level = ks->last_file_read_level;
+      }
+      ks->last_file_read = batch_file;
+      ks->last_file_read_level = batch_level;
+      batch_keys.push_back(keys[i]->internal_key());
+      batch_args.push_back(&ks->saver);
+    }
+    batch_statuses.resize(batch.size());
+    batch_tombstones.assign(batch.size(), 0);
+    Status tombstone_status;
+    if (batch_file->has_range_deletions) {
+      for (size_t j = 0; j < batch.size() && tombstone_status.ok(); j++) {
+        tombstone_status = vset_->table_cache_->GetCoveringTombstone(
+            batch_file->number, batch_file->file_size,
+            keys[batch[j]]->user_key(), ExtractSequence(batch_keys[j]),
+            &batch_tombstones[j]);
+      }
+    }
+    vset_->table_cache_->MultiGet(options, batch_file->number,
+                                  batch_file->file_size, batch.size(),
+                                  batch_keys.data(), batch_args.data(),
+                                  SaveValue, batch_statuses.data());
+    if (!tombstone_status.ok()) {
+      batch_statuses.assign(batch.size(), tombstone_status);
+    }
+    for (size_t j = 0; j < batch.size(); j++) {
+      const int i = batch[j];
+      KeyState* ks = &state[i];
+      if (!batch_statuses[j].ok()) {
+        statuses[i] = batch_statuses[j];
+        ks->done = true;
+        continue;
+      }
+      ApplyRangeTombstone(batch_tombstones[j], &ks->saver);
+      switch (ks->saver.state) {
+        case kNotFound:
+          break;  // Keep searching in other files
+        case kFound:
+          statuses[i] = Status::OK();
+          ks->done = true;
+          break;
+        case kDeleted:
+          ks->done = true;
+          break;
+        case kCorrupt:
+          statuses[i] =
+              Status::Corruption("corrupted key for ", ks->saver.user_key);
+          ks->done = true;
+          break;
+      }
+    }
+    batch.clear();
+  };
+
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (FileMetaData* f : tmp) {
+    batch_file = f;
+    batch_level = 0;
+    for (int i = 0; i < n; i++) {
+      const Slice user_key = keys[i]->user_key();
+      if (!state[i].done &&
+          ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(i);
+      }
+    }
+    flush_batch();
+  }
+
+  // Search other levels, grouping neighbouring keys that fall into the
+  // same file.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    for (int i = 0; i < n; i++) {
+      if (state[i].done) continue;
+      uint32_t index = FindFile(vset_->icmp_, files_[level],
+                                keys[i]->internal_key());
+      if (index >= num_files) continue;
+      FileMetaData* f = files_[level][index];
+      if (ucmp->Compare(keys[i]->user_key(), f->smallest.user_key()) < 0) {
+        // All of "f" is past any data for user_key
+        continue;
+      }
+      if (f != batch_file) {
+        flush_batch();
+        batch_file = f;
+        batch_level = level;
+      }
+      batch.push_back(i);
+    }
+    flush_batch();
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -482,6 +816,10 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
+      if (vset_->RangeInRunningCompaction(level + 1, smallest_user_key,
+                                          largest_user_key)) {
+        break;
+      }
       if (level + 2 < config::kNumLevels) {
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
@@ -753,6 +1091,7 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
 }
 
 VersionSet::~VersionSet() {
+  assert(running_compactions_.empty());
   current_->Unref();
   assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
   delete descriptor_log_;
@@ -789,7 +1128,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  edit->SetLastSequence(LastSequence());
 
   Version* v = new Version(this);
   {
@@ -974,7 +1313,7 @@ Status VersionSet::Recover(bool* save_manifest) {
     AppendVersion(v);
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
-    last_sequence_ = last_sequence;
+    SetLastSequence(last_sequence);
     log_number_ = log_number;
     prev_log_number_ = prev_log_number;
 
@@ -1057,6 +1396,7 @@ void VersionSet::Finalize(Version* v) {
       score =
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
+    v->compaction_scores_[level] = score;
 
     if (score > best_score) {
       best_level = level;
@@ -1066,6 +1406,29 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate the compaction debt: the bytes that have to be pushed down
+  // from each level whose score is at least one, together with the part
+  // of the next level that they are merged with.  Pushed-down bytes count
+  // towards the size of the next level.
+  double debt = 0;
+  double incoming = 0;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    const double level_bytes = TotalFileSize(v->files_[level]) + incoming;
+    incoming = 0;
+    if (level == 0) {
+      if (v->compaction_scores_[0] >= 1) {
+        incoming = level_bytes;
+      }
+    } else if (level_bytes > MaxBytesForLevel(options_, level)) {
+      incoming = level_bytes - MaxBytesForLevel(options_, level);
+    }
+    if (incoming > 0) {
+      const double next_bytes = TotalFileSize(v->files_[level + 1]);
+      debt += incoming * (1 + next_bytes / level_bytes);
+    }
+  }
+  v->compaction_debt_ = static_cast<uint64_t>(debt);
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1089,7 +1452,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->has_range_deletions);
     }
   }
 
@@ -1251,46 +1615,98 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
-Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
-
-  // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+Status VersionSet::AddInputRangeTombstones(
+    Compaction* c, int which, std::vector<RangeTombstone>* result) {
+  Status s;
+  for (FileMetaData* f : c->inputs_[which]) {
+    if (f->has_range_deletions) {
+      s = table_cache_->AddRangeTombstones(f->number, f->file_size, result);
+      if (!s.ok()) {
         break;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+  return s;
+}
+
+Compaction* VersionSet::PickCompaction() {
+  Compaction* c = nullptr;
+
+  // We prefer compactions triggered by too much data in a level over
+  // the compactions triggered by seeks.  Levels are tried in decreasing
+  // order of score so that a level whose files are all taken by running
+  // compactions does not hold back the others.
+  int levels[config::kNumLevels];
+  int num_levels = 0;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    if (current_->compaction_scores_[level] >= 1) {
+      levels[num_levels++] = level;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
+  }
+  const Version* v = current_;
+  std::stable_sort(levels, levels + num_levels, [v](int a, int b) {
+    return v->compaction_scores_[a] > v->compaction_scores_[b];
+  });
+  for (int i = 0; i < num_levels && c == nullptr; i++) {
+    c = PickCompactionAtLevel(levels[i]);
+  }
+
+  if (c == nullptr && current_->file_to_compact_ != nullptr &&
+      !current_->file_to_compact_->being_compacted) {
+    c = new Compaction(options_, current_->file_to_compact_level_);
     c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
+    c = SetupInputs(c);
+  }
+
+  if (c != nullptr) {
+    RegisterCompaction(c);
+  }
+  return c;
+}
+
+Compaction* VersionSet::PickCompactionAtLevel(int level) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+  if (files.empty()) {
     return nullptr;
   }
 
+  // Start with the first file that comes after compact_pointer_[level],
+  // wrapping around to the beginning of the key space.
+  size_t start = 0;
+  if (!compact_pointer_[level].empty()) {
+    while (start < files.size() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    if (start == files.size()) {
+      start = 0;
+    }
+  }
+
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[(start + i) % files.size()];
+    if (f->being_compacted) {
+      continue;
+    }
+    Compaction* c = new Compaction(options_, level);
+    c->inputs_[0].push_back(f);
+    c = SetupInputs(c);
+    if (c != nullptr) {
+      return c;
+    }
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::SetupInputs(Compaction* c) {
   c->input_version_ = current_;
   c->input_version_->Ref();
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
-  if (level == 0) {
+  if (c->level() == 0) {
     InternalKey smallest, largest;
     GetRange(c->inputs_[0], &smallest, &largest);
     // Note that the next call will discard the file we placed in
@@ -1302,9 +1718,73 @@ Compaction* VersionSet::PickCompaction() {
 
   SetupOtherInputs(c);
 
+  if (ConflictsWithRunningCompaction(c)) {
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
+bool VersionSet::ConflictsWithRunningCompaction(const Compaction* c) const {
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      if (f->being_compacted) {
+        return true;
+      }
+    }
+  }
+  return RangeInRunningCompaction(c->level(), c->smallest_.user_key(),
+                                  c->largest_.user_key()) ||
+         RangeInRunningCompaction(c->level() + 1, c->smallest_.user_key(),
+                                  c->largest_.user_key());
+}
+
+bool VersionSet::RangeInRunningCompaction(
+    int level, const Slice& smallest_user_key,
+    const Slice& largest_user_key) const {
+  const Comparator* ucmp = icmp_.user_comparator();
+  for (const Compaction* r : running_compactions_) {
+    if (level != r->level() && level != r->level() + 1) {
+      continue;
+    }
+    if (ucmp->Compare(largest_user_key, r->smallest_.user_key()) < 0 ||
+        ucmp->Compare(smallest_user_key, r->largest_.user_key()) > 0) {
+      continue;  // No overlap
+    }
+    return true;
+  }
+  return false;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  assert(c->running_in_ == nullptr);
+  assert(c->dropped_.empty());
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      assert(!f->being_compacted);
+      f->being_compacted = true;
+    }
+  }
+  c->running_in_ = this;
+  running_compactions_.insert(c);
+}
+
+void VersionSet::UnregisterCompaction(Compaction* c) {
+  assert(c->running_in_ == this);
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      assert(f->being_compacted);
+      f->being_compacted = false;
+    }
+  }
+  for (FileMetaData* f : c->dropped_) {
+    assert(f->being_compacted);
+    f->being_compacted = false;
+  }
+  c->running_in_ = nullptr;
+  running_compactions_.erase(c);
+}
+
 // Finds the largest key in a vector of files. Returns true if files is not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1432,6 +1912,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     }
   }
 
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
   if (level + 2 < config::kNumLevels) {
@@ -1477,6 +1960,10 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  // Callers only run manual compactions when no other compaction is
+  // running, so there is nothing to conflict with.
+  assert(!ConflictsWithRunningCompaction(c));
+  RegisterCompaction(c);
   return c;
 }
 
@@ -1484,15 +1971,19 @@ Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      running_in_(nullptr) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
 Compaction::~Compaction() {
+  if (running_in_ != nullptr) {
+    running_in_->UnregisterCompaction(this);
+  }
   if (input_version_ != nullptr) {
     input_version_->Unref();
   }
@@ -1514,15 +2005,49 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
       edit->RemoveFile(level_ + which, inputs_[which][i]->number);
     }
   }
+  for (FileMetaData* f : dropped_) {
+    edit->RemoveFile(level_ + 1, f->number);
+  }
+}
+
+int Compaction::DropCoveredInputs(const std::vector<RangeTombstone>& tombstones,
+                                  SequenceNumber smallest_snapshot) {
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  const size_t num_dropped = dropped_.size();
+  std::vector<FileMetaData*> kept;
+  for (FileMetaData* f : inputs_[1]) {
+    // A largest key that is the end of a range tombstone is exclusive.
+    const bool exclusive_end = IsRangeTombstoneEndKey(f->largest.Encode());
+    bool covered = false;
+    for (const RangeTombstone& t : tombstones) {
+      if (t.sequence > smallest_snapshot) {
+        continue;  // Some snapshot still sees the file's entries
+      }
+      const int end_cmp = user_cmp->Compare(f->largest.user_key(), t.end);
+      if (user_cmp->Compare(t.begin, f->smallest.user_key()) <= 0 &&
+          (end_cmp < 0 || (exclusive_end && end_cmp == 0))) {
+        covered = true;
+        break;
+      }
+    }
+    if (covered) {
+      dropped_.push_back(f);
+    } else {
+      kept.push_back(f);
+    }
+  }
+  inputs_[1].swap(kept);
+  return static_cast<int>(dropped_.size() - num_dropped);
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1531,37 +2056,104 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  // OverlapInLevel() takes an inclusive range, which is conservative.
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
          icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
+                       grandparents_[cursor->grandparent_index]->largest.Encode()) >
              0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+void Compaction::GetSubcompactionBoundaries(
+    int max_subcompactions, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (max_subcompactions <= 1) {
+    return;
+  }
+
+  // Candidate split points are the largest keys of the input files,
+  // visited in key order so that the input size before each one grows.
+  std::vector<FileMetaData*> files(inputs_[0]);
+  files.insert(files.end(), inputs_[1].begin(), inputs_[1].end());
+  if (files.size() < 2) {
+    return;
+  }
+  const InternalKeyComparator& icmp = input_version_->vset_->icmp_;
+  const Comparator* user_cmp = icmp.user_comparator();
+  std::sort(files.begin(), files.end(),
+            [&icmp](FileMetaData* a, FileMetaData* b) {
+              return icmp.Compare(a->largest, b->largest) < 0;
+            });
+
+  const uint64_t total = TotalFileSize(files);
+  const uint64_t target = total / max_subcompactions;
+  if (target == 0) {
+    return;
+  }
+  const Slice smallest_user_key = smallest_.user_key();
+  const Slice largest_user_key = largest_.user_key();
+  uint64_t size_before = 0;
+  for (size_t i = 0; i + 1 < files.size(); i++) {
+    size_before += files[i]->file_size;
+    if (size_before < target * (boundaries->size() + 1)) {
+      continue;
+    }
+    const Slice key = files[i]->largest.user_key();
+    if (user_cmp->Compare(key, smallest_user_key) <= 0 ||
+        user_cmp->Compare(key, largest_user_key) >= 0) {
+      continue;
+    }
+    if (!boundaries->empty() &&
+        user_cmp->Compare(key, boundaries->back()) <= 0) {
+      continue;
+    }
+    boundaries->push_back(key.ToString());
+    if (static_cast<int>(boundaries->size()) + 1 >= max_subcompactions) {
+      break;
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
+  // Unregister first: the input files may be freed along with the version.
+  if (running_in_ != nullptr) {
+    running_in_->UnregisterCompaction(this);
+  }
   if (input_version_ != nullptr) {
     input_version_->Unref();
     input_version_ = nullptr;
@@ -15,12 +15,16 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "db/version_edit.h"
+#include "leveldb/pinnable_slice.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 
@@ -33,6 +37,7 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+struct PrefixSeekState;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -65,16 +70,34 @@ class Version {
   };
 
   // Append to *iters a sequence of iterators that will
-  // yield the contents of this Version when merged together.
+  // yield the contents of this Version when merged together.  If
+  // "prefix_seek" is non-null, they skip the files it rules out.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
-  void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
+  void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters,
+                    const PrefixSeekState* prefix_seek = nullptr);
+
+  // Store in *result the range tombstones of every file in this Version,
+  // cut into fragments, or null if there are none.  The list is built on
+  // first use and shared by every later caller.
+  Status GetRangeTombstones(std::shared_ptr<const RangeTombstoneList>* result);
 
   // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // return OK.  Else return a non-OK status.  Fills *stats.  *val pins
+  // the block or table that holds the value where it can.
   // REQUIRES: lock is not held
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
              GetStats* stats);
 
+  // Batched form of Get() for keys[0,n-1], which must be sorted by user
+  // key.  Every key is looked up in the same files, in the same order, as
+  // Get() would, but each table is opened once per batch and data blocks
+  // shared by neighbouring keys are read once.  Stores the results for
+  // key i in *values[i], statuses[i] and stats[i].
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string* const* values, Status* statuses,
+                GetStats* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -106,6 +129,8 @@ class Version {
 
   // Return the level at which we should place a new memtable compaction
   // result that covers the range [smallest_user_key,largest_user_key].
+  // Levels that a running compaction is writing to in that range are
+  // never picked.
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
@@ -128,14 +153,22 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        compaction_debt_(0),
+        range_tombstones_loaded_(false) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      compaction_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
 
   ~Version();
 
-  Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
+  Iterator* NewConcatenatingIterator(
+      const ReadOptions&, int level,
+      const PrefixSeekState* prefix_seek = nullptr) const;
 
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
@@ -162,6 +195,21 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, used to pick other levels when the
+  // best one is busy with running compactions.
+  double compaction_scores_[config::kNumLevels];
+
+  // Estimated number of bytes that compactions have to write to bring
+  // every level back under its limit.  Initialized by Finalize().
+  uint64_t compaction_debt_;
+
+  // Cache of GetRangeTombstones().  The files of a Version never change,
+  // so the list is loaded once.
+  port::Mutex range_tombstones_mutex_;
+  bool range_tombstones_loaded_ GUARDED_BY(range_tombstones_mutex_);
+  std::shared_ptr<const RangeTombstoneList> range_tombstones_
+      GUARDED_BY(range_tombstones_mutex_);
 };
 
 class VersionSet {
@@ -208,13 +256,21 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the estimated number of bytes that compactions of the current
+  // version have yet to write.
+  uint64_t CompactionDebt() const { return current_->compaction_debt_; }
+
+  // Return the last sequence number.  Unlike the rest of the VersionSet,
+  // it may be read without the DB mutex: once it is set, the writes up to
+  // it are visible in the memtables.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -228,7 +284,8 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // candidate conflicts with a compaction that is still running.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
   Compaction* PickCompaction();
@@ -248,6 +305,15 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Append to *result the range tombstones of the compaction inputs for
+  // "*c" at level c->level()+which.
+  Status AddInputRangeTombstones(Compaction* c, int which,
+                                 std::vector<RangeTombstone>* result);
+
+  // Return the number of compactions returned by PickCompaction() or
+  // CompactRange() whose inputs have not been released yet.
+  int NumRunningCompactions() const { return running_compactions_.size(); }
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
@@ -288,6 +354,28 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Pick a compaction at "level" that does not conflict with any running
+  // compaction, or return nullptr if there is none.
+  Compaction* PickCompactionAtLevel(int level);
+
+  // Complete the inputs of "c", whose level inputs_[0] holds the initial
+  // file(s).  Deletes "c" and returns nullptr if the result conflicts with
+  // a running compaction.
+  Compaction* SetupInputs(Compaction* c);
+
+  // Returns true iff "c" shares an input file with a running compaction,
+  // or touches a level that a running compaction touches in an
+  // overlapping key range.
+  bool ConflictsWithRunningCompaction(const Compaction* c) const;
+
+  // Returns true iff a running compaction reads or writes "level" in a
+  // key range that overlaps [smallest_user_key,largest_user_key].
+  bool RangeInRunningCompaction(int level, const Slice& smallest_user_key,
+                                const Slice& largest_user_key) const;
+
+  void RegisterCompaction(Compaction* c);
+  void UnregisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -300,7 +388,7 @@ class VersionSet {
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -313,6 +401,9 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Compactions whose input files are marked as being_compacted.
+  std::set<Compaction*> running_compactions_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -344,17 +435,68 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Remove from the "level+1" inputs every file whose whole key range is
+  // covered by one of "tombstones", which must come from the "level"
+  // inputs, with a sequence number <= smallest_snapshot.  Everything in
+  // such a file is deleted for all readers, so the file is dropped when
+  // the compaction is installed without being read or rewritten.
+  // Returns the number of files removed.
+  int DropCoveredInputs(const std::vector<RangeTombstone>& tombstones,
+                        SequenceNumber smallest_snapshot);
+
+  // Number of input files removed by DropCoveredInputs().
+  int num_dropped_files() const { return dropped_.size(); }
+
+  // State of one scan over the compaction's inputs, as consumed by
+  // IsBaseLevelForKey() and ShouldStopBefore().  Keys passed with the same
+  // cursor must be increasing, so each subcompaction needs its own cursor.
+  struct Cursor {
+    Cursor();
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key) {
+    return IsBaseLevelForKey(user_key, &cursor_);
+  }
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Returns true if no data exists in levels greater than "level+1" for
+  // any user key in [begin, end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key) {
+    return ShouldStopBefore(internal_key, &cursor_);
+  }
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // Split the user key range of this compaction into at most
+  // "max_subcompactions" pieces of roughly equal input size, using the
+  // boundaries of the input files.  Stores the interior split points in
+  // increasing order in *boundaries; piece i covers user keys in
+  // [boundaries[i-1], boundaries[i]).  Leaves *boundaries empty if the
+  // compaction should not be split.
+  void GetSubcompactionBoundaries(int max_subcompactions,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also lets other compactions pick the input files.
   void ReleaseInputs();
 
  private:
@@ -368,24 +510,24 @@ class Compaction {
   Version* input_version_;
   VersionEdit edit_;
 
+  // Non-null while registered as a running compaction of this VersionSet.
+  VersionSet* running_in_;
+
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // "level_+1" files deleted by range tombstones; not in inputs_[1]
+  std::vector<FileMetaData*> dropped_;
+
+  // Range covered by all inputs; outputs never fall outside of it.
+  InternalKey smallest_;
+  InternalKey largest_;
+
+  // Files at level_ + 2 overlapping the inputs.
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+
+  // Cursor used when the compaction is not split.
+  Cursor cursor_;
 };
 
 }  // namespace leveldb
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+namespace leveldb {
+
+namespace {
+
+constexpr uint64_t kNanosPerSecond = 1000000000;
+constexpr uint64_t kNanosPerMicro = 1000;
+
+// Writes may run this far ahead of the rate before they are delayed, which
+// keeps the delays long enough for sleeping to be accurate.
+constexpr uint64_t kSlackNanos = 1000 * kNanosPerMicro;
+
+// Unused time earns credit up to this much time's worth of writes, so that
+// a pause between writes does not turn into a burst.
+constexpr uint64_t kMaxCreditNanos = 10000 * kNanosPerMicro;
+
+// The rate never drops below this many bytes per second.
+constexpr uint64_t kMinRate = 16 * 1024;
+
+// A single delay never exceeds this, however large the write.  Whatever
+// it leaves unpaid delays the following writes.
+constexpr uint64_t kMaxDelayMicros = 2000000;
+
+}  // namespace
+
+WriteController::WriteController(uint64_t max_rate)
+    : max_rate_(std::max<uint64_t>(max_rate, 1)),
+      min_rate_(std::min(max_rate_, kMinRate)),
+      delaying_(false),
+      rate_(max_rate_),
+      last_debt_(0),
+      paid_until_nanos_(0) {}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros,
+                                   uint64_t compaction_debt,
+                                   uint64_t num_bytes) {
+  const uint64_t now_nanos = now_micros * kNanosPerMicro;
+  if (!delaying_) {
+    delaying_ = true;
+    paid_until_nanos_ = now_nanos;
+  }
+  if (compaction_debt > last_debt_) {
+    // Compactions are falling further behind.
+    rate_ = std::max(rate_ / 5 * 4, min_rate_);
+  } else if (compaction_debt < last_debt_) {
+    // Compactions are catching up.
+    rate_ = std::min(rate_ / 4 * 5, max_rate_);
+  }
+  last_debt_ = compaction_debt;
+
+  if (paid_until_nanos_ + kMaxCreditNanos < now_nanos) {
+    paid_until_nanos_ = now_nanos - kMaxCreditNanos;
+  }
+  paid_until_nanos_ += num_bytes * kNanosPerSecond / rate_;
+  if (paid_until_nanos_ <= now_nanos + kSlackNanos) {
+    return 0;
+  }
+  // Sleep until the rate has paid for the write.
+  return std::min((paid_until_nanos_ - now_nanos) / kNanosPerMicro,
+                  kMaxDelayMicros);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,52 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// WriteController paces writes while compactions fall behind.  It is a
+// token bucket whose rate drops whenever the compaction debt grows and
+// recovers, up to a maximum, when it shrinks.
+//
+// Not thread-safe: DBImpl only uses it while holding its mutex.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+class WriteController {
+ public:
+  // Delayed writes start at, and never exceed, "max_rate" bytes per second.
+  explicit WriteController(uint64_t max_rate);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Returns the number of microseconds that a write of "num_bytes" bytes
+  // at time "now_micros" has to sleep, given the estimated number of bytes
+  // that compactions have yet to write.  Delays are capped at two seconds.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t compaction_debt,
+                    uint64_t num_bytes);
+
+  // Ends the current period of delayed writes.  The next one starts with
+  // no credit, at the rate that this one ended at.
+  void EndDelay() { delaying_ = false; }
+
+  // Returns the current rate of delayed writes in bytes per second.
+  uint64_t rate() const { return rate_; }
+
+ private:
+  const uint64_t max_rate_;
+  const uint64_t min_rate_;
+  bool delaying_;
+  uint64_t rate_;
+  uint64_t last_debt_;
+  // Time, in nanoseconds, by which the rate has paid for the bytes written
+  // so far.  It lags behind the clock while there is unused credit.
+  uint64_t paid_until_nanos_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
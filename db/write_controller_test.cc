@@ -0,0 +1,79 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static const uint64_t kRate = 1000000;  // One byte per microsecond
+
+TEST(WriteControllerTest, Pacing) {
+  WriteController controller(kRate);
+  // Writes may run a millisecond ahead of the rate.
+  ASSERT_EQ(0, controller.GetDelay(0, 0, 600));
+  ASSERT_EQ(0, controller.GetDelay(0, 0, 400));
+  ASSERT_EQ(2000, controller.GetDelay(0, 0, 1000));
+
+  // Writes that sleep as told are paced at the rate.
+  uint64_t now = 2000;
+  for (int i = 0; i < 100; i++) {
+    now += controller.GetDelay(now, 0, 5000);
+  }
+  ASSERT_EQ(2000 + 100 * 5000, now);
+}
+
+TEST(WriteControllerTest, PausesDoNotTurnIntoBursts) {
+  WriteController controller(kRate);
+  ASSERT_EQ(0, controller.GetDelay(0, 0, 1000));
+  // A second-long pause only earns ten milliseconds of credit.
+  ASSERT_EQ(0, controller.GetDelay(1000000, 0, 10000));
+  ASSERT_EQ(0, controller.GetDelay(1000000, 0, 1000));
+  ASSERT_EQ(2000, controller.GetDelay(1000000, 0, 1000));
+}
+
+TEST(WriteControllerTest, LongDelaysAreCapped) {
+  WriteController controller(kRate);
+  // A 5MB write pays for its first two seconds now and the rest with the
+  // delays of the writes that follow it.
+  ASSERT_EQ(2000000, controller.GetDelay(0, 0, 5000000));
+  ASSERT_EQ(2000000, controller.GetDelay(2000000, 0, 0));
+  ASSERT_EQ(1000000, controller.GetDelay(4000000, 0, 0));
+  ASSERT_EQ(0, controller.GetDelay(5000000, 0, 0));
+}
+
+TEST(WriteControllerTest, RateFollowsCompactionDebt) {
+  WriteController controller(kRate);
+  controller.GetDelay(0, 0, 0);
+  ASSERT_EQ(kRate, controller.rate());
+
+  // Growing debt slows writes down, to a floor.
+  controller.GetDelay(0, 100, 0);
+  ASSERT_EQ(kRate / 5 * 4, controller.rate());
+  controller.GetDelay(0, 100, 0);
+  ASSERT_EQ(kRate / 5 * 4, controller.rate());
+  controller.GetDelay(0, 200, 0);
+  for (uint64_t debt = 300; debt < 10000; debt += 100) {
+    controller.GetDelay(0, debt, 0);
+  }
+  ASSERT_EQ(16 * 1024, controller.rate());
+
+  // Shrinking debt speeds them up again, up to the maximum.
+  controller.GetDelay(0, 5000, 0);
+  ASSERT_EQ(16 * 1024 / 4 * 5, controller.rate());
+  for (uint64_t debt = 4900; debt > 0; debt -= 100) {
+    controller.GetDelay(0, debt, 0);
+  }
+  ASSERT_EQ(kRate, controller.rate());
+
+  // A new period of delays keeps the rate, but not the credit.
+  controller.GetDelay(0, 200, 0);
+  ASSERT_EQ(kRate / 5 * 4, controller.rate());
+  controller.EndDelay();
+  ASSERT_EQ(0, controller.GetDelay(1000000, 200, 800));
+  ASSERT_EQ(2000, controller.GetDelay(1000000, 200, 800));
+}
+
+}  // namespace leveldb
@@ -61,6 +61,7 @@ typedef struct leveldb_filterpolicy_t leveldb_filterpolicy_t;
 typedef struct leveldb_iterator_t leveldb_iterator_t;
 typedef struct leveldb_logger_t leveldb_logger_t;
 typedef struct leveldb_options_t leveldb_options_t;
+typedef struct leveldb_pinnableslice_t leveldb_pinnableslice_t;
 typedef struct leveldb_randomfile_t leveldb_randomfile_t;
 typedef struct leveldb_readoptions_t leveldb_readoptions_t;
 typedef struct leveldb_seqfile_t leveldb_seqfile_t;
@@ -97,6 +98,14 @@ LEVELDB_EXPORT char* leveldb_get(leveldb_t* db,
                                  const char* key, size_t keylen, size_t* vallen,
                                  char** errptr);
 
+/* Returns NULL if not found.  Otherwise the value, which may point into
+   the DB's memory instead of being copied, until the result is released
+   using leveldb_pinnableslice_destroy().  Results must be released before
+   the DB is closed. */
+LEVELDB_EXPORT leveldb_pinnableslice_t* leveldb_get_pinned(
+    leveldb_t* db, const leveldb_readoptions_t* options, const char* key,
+    size_t keylen, char** errptr);
+
 LEVELDB_EXPORT leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db, const leveldb_readoptions_t* options);
 
@@ -145,6 +154,12 @@ LEVELDB_EXPORT const char* leveldb_iter_value(const leveldb_iterator_t*,
 LEVELDB_EXPORT void leveldb_iter_get_error(const leveldb_iterator_t*,
                                            char** errptr);
 
+/* Pinnable slice */
+
+LEVELDB_EXPORT void leveldb_pinnableslice_destroy(leveldb_pinnableslice_t*);
+LEVELDB_EXPORT const char* leveldb_pinnableslice_value(
+    const leveldb_pinnableslice_t*, size_t* vlen);
+
 /* Write batch */
 
 LEVELDB_EXPORT leveldb_writebatch_t* leveldb_writebatch_create(void);
@@ -184,14 +199,43 @@ LEVELDB_EXPORT void leveldb_options_set_write_buffer_size(leveldb_options_t*,
 LEVELDB_EXPORT void leveldb_options_set_max_open_files(leveldb_options_t*, int);
 LEVELDB_EXPORT void leveldb_options_set_cache(leveldb_options_t*,
                                               leveldb_cache_t*);
+LEVELDB_EXPORT void leveldb_options_set_cache_index_and_filter_blocks(
+    leveldb_options_t*, uint8_t);
 LEVELDB_EXPORT void leveldb_options_set_block_size(leveldb_options_t*, size_t);
 LEVELDB_EXPORT void leveldb_options_set_block_restart_interval(
     leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_data_block_hash_index(
+    leveldb_options_t*, uint8_t);
 LEVELDB_EXPORT void leveldb_options_set_max_file_size(leveldb_options_t*,
                                                       size_t);
 
-enum { leveldb_no_compression = 0, leveldb_snappy_compression = 1 };
+enum {
+  leveldb_block_index = 0,
+  leveldb_fixed_index = 1,
+  leveldb_partitioned_index = 2
+};
+LEVELDB_EXPORT void leveldb_options_set_index_format(leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_index_partition_size(
+    leveldb_options_t*, size_t);
+
+enum {
+  leveldb_no_compression = 0,
+  leveldb_snappy_compression = 1,
+  leveldb_zstd_compression = 2,
+  leveldb_lz4_compression = 3
+};
 LEVELDB_EXPORT void leveldb_options_set_compression(leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_zstd_compression_level(
+    leveldb_options_t*, int);
+
+enum {
+  leveldb_block_based_filter = 0,
+  leveldb_full_filter = 1,
+  leveldb_partitioned_filter = 2
+};
+LEVELDB_EXPORT void leveldb_options_set_filter_format(leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_filter_partition_size(
+    leveldb_options_t*, size_t);
 
 /* Comparator */
 
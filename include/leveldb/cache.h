@@ -27,9 +27,42 @@ namespace leveldb {
 
 class LEVELDB_EXPORT Cache;
 
+// Segment sizes of a cache created by NewLRUCache(), as fractions of its
+// capacity, each clamped to [0, 1].
+struct LEVELDB_EXPORT LRUCacheOptions {
+  // Entries found by a Lookup() move to a protected segment of up to
+  // protected_ratio * capacity, which is evicted only once the entries
+  // inserted but never looked up are gone.  This keeps a scan that fills
+  // the cache from evicting the working set.  A ratio of 0 gives a plain
+  // LRU cache.
+  double protected_ratio = 0.8;
+
+  // Entries inserted with Cache::Priority::kHigh go to a third segment of
+  // up to high_pri_pool_ratio * capacity, which is evicted last: entries
+  // of normal priority cannot push them out.  Beyond that pool, the
+  // oldest of them join the protected segment.
+  double high_pri_pool_ratio = 0.5;
+};
+
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
+// of Cache uses a segmented least-recently-used eviction policy, with the
+// segments of a default LRUCacheOptions.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
+
+// Like NewLRUCache() above, with the segments sized by "options".
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity,
+                                  const LRUCacheOptions& options);
+
+// Create a new cache with a fixed size capacity, split into
+// 2^num_shard_bits shards.  This implementation uses the CLOCK eviction
+// policy: Lookup() and Release() take no lock, which scales better than
+// the LRU cache when many threads read the same shards.  Each shard
+// preallocates a hash table sized for entries of about
+// estimated_entry_charge (e.g. the block size for a block cache); entries
+// that do not fit while the table is full of referenced entries are
+// returned to the caller without being cached.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits = 4,
+                                    size_t estimated_entry_charge = 4096);
 // 定义缓存的接口
 class LEVELDB_EXPORT Cache {
  public:
@@ -63,6 +96,19 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  enum class Priority { kLow, kHigh };
+
+  // Like Insert(), with a hint that the entry is more valuable than the
+  // ones inserted with kLow priority, which should not evict it.
+  // Default implementation ignores the priority.
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority /*priority*/) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -110,6 +156,11 @@ class LEVELDB_EXPORT Cache {
   // cache.
   // 计算缓存所占内存空间
   virtual size_t TotalCharge() const = 0;
+
+  // Return the number of Lookup() calls that found their key, and that
+  // did not.  Default implementations return 0.
+  virtual uint64_t LookupHits() const { return 0; }
+  virtual uint64_t LookupMisses() const { return 0; }
 };
 
 }  // namespace leveldb
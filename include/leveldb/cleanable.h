@@ -0,0 +1,66 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Cleanable runs a list of cleanup functions when it is destroyed.  It is
+// the base of objects that keep other memory alive, such as an Iterator over
+// a cached block, and lets that memory be handed on to another object.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_CLEANABLE_H_
+#define STORAGE_LEVELDB_INCLUDE_CLEANABLE_H_
+
+#include <cassert>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT Cleanable {
+ public:
+  Cleanable();
+
+  Cleanable(const Cleanable&) = delete;
+  Cleanable& operator=(const Cleanable&) = delete;
+
+  ~Cleanable();
+
+  // Clients are allowed to register function/arg1/arg2 triples that
+  // will be invoked when this object is destroyed.
+  //
+  // Note that this method is not virtual and therefore clients should
+  // not override it.
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+  // Moves the registered cleanup functions to *other, which will invoke
+  // them instead of this object.
+  void DelegateCleanupsTo(Cleanable* other);
+
+ protected:
+  // Invokes the registered cleanup functions and forgets them.
+  void DoCleanup();
+
+ private:
+  // Cleanup functions are stored in a single-linked list.
+  // The list's head node is inlined in the object.
+  struct CleanupNode {
+    // True if the node is not used. Only head nodes might be unused.
+    bool IsEmpty() const { return function == nullptr; }
+    // Invokes the cleanup function.
+    void Run() {
+      assert(function != nullptr);
+      (*function)(arg1, arg2);
+    }
+
+    // The head node is used if the function pointer is not null.
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+    CleanupNode* next;
+  };
+  CleanupNode cleanup_head_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_CLEANABLE_H_
@@ -8,11 +8,10 @@
 #include <string>
 
 #include "leveldb/export.h"
+#include "leveldb/slice.h"
 
 namespace leveldb {
 
-class Slice;
-
 // A Comparator object provides a total order across slices that are
 // used as keys in an sstable or a database.  A Comparator implementation
 // must be thread-safe since leveldb may invoke its methods concurrently
@@ -57,6 +56,12 @@ class LEVELDB_EXPORT Comparator {
   // i.e., an implementation of this method that does nothing is correct.
   // 将key所指向的字符串改变为大于等于*key的字符串;默认行为是不改变字符串
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Returns the part of "key" that a point lookup of "key" matches
+  // byte-wise, for comparators whose keys carry more than that (e.g. a
+  // version).  Used to hash keys for Options::data_block_hash_index.  The
+  // default returns "key".
+  virtual Slice PointLookupKey(const Slice& key) const { return key; }
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -7,10 +7,13 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -72,6 +75,14 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in the range
+  // [begin, end).  Returns OK on success, and a non-OK status on error.
+  // Whole tables that fall into the range are later dropped by
+  // compactions without being rewritten.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -87,6 +98,32 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Like Get() above, but *value can point at the value where the database
+  // keeps it instead of holding a copy.  It then pins the block, table or
+  // memtable holding the value until it is reset or destroyed, which must
+  // happen before this db is deleted.  Values that cannot be pinned are
+  // copied into the buffer of *value.  *value is reset first.
+  //
+  // A value from a memtable pins the memtables and the set of table files
+  // that were current at the time of the read, like an Iterator does: the
+  // memory of the memtables is not freed and files that compactions replace
+  // are not deleted while *value is pinned.  Release it promptly.
+  //
+  // The default implementation copies the value.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value);
+
+  // Look up every key in "keys" as of a single snapshot.  On return
+  // (*values)[i] and (*statuses)[i] hold what Get() would have stored and
+  // returned for keys[i]: OK with the value, a status for which
+  // IsNotFound() returns true, or some other error.
+  //
+  // The default implementation calls Get() for each key.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +158,13 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.block-cache-stats" - returns the lookup hits and misses and
+  //     the size of the block cache, and of the secondary cache if any,
+  //     one line per tier.
+  //  "leveldb.write-stall-stats" - returns the number of writes that were
+  //     delayed or stopped to let compactions catch up and the time they
+  //     spent waiting, followed by the current rate of delayed writes and
+  //     the estimated number of bytes that compactions have yet to write.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
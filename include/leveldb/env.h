@@ -197,6 +197,20 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Like Schedule(), but "(*function)(arg)" is run ahead of any work that
+  // was queued with Schedule() and has not started yet.  Used for work,
+  // such as memtable flushes, that blocks foreground writers.
+  //
+  // The default implementation calls Schedule().
+  virtual void ScheduleHighPriority(void (*function)(void* arg), void* arg);
+
+  // Allow up to "number" background threads to run work items passed to
+  // Schedule() and ScheduleHighPriority() concurrently.  The pool never
+  // shrinks, so a smaller "number" than a previous call has no effect.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -248,6 +262,18 @@ class LEVELDB_EXPORT SequentialFile {
   virtual Status Skip(uint64_t n) = 0;
 };
 
+// One read in a batch passed to RandomAccessFile::MultiRead().
+struct LEVELDB_EXPORT ReadRequest {
+  // Inputs: read up to "n" bytes at "offset" into "scratch[0..n-1]".
+  uint64_t offset = 0;
+  size_t n = 0;
+  char* scratch = nullptr;
+
+  // Outputs: as set by RandomAccessFile::Read().
+  Slice result;
+  Status status;
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class LEVELDB_EXPORT RandomAccessFile {
  public:
@@ -269,6 +295,19 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Perform all of the reads in "reqs[0..n-1]", storing the outcome of each
+  // in its "result" and "status" fields exactly as Read() would.
+  // Implementations may issue the reads concurrently; the call returns
+  // once all of them have completed.
+  //
+  // The default implementation calls Read() for each request in turn.
+  // Env::Default() on Linux uses io_uring for files it does not mmap,
+  // unless the LEVELDB_USE_IO_URING environment variable is "0" when the
+  // process starts.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void MultiRead(ReadRequest* reqs, size_t n) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -384,6 +423,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleHighPriority(void (*f)(void*), void* a) override {
+    return target_->ScheduleHighPriority(f, a);
+  }
+  void SetBackgroundThreads(int number) override {
+    return target_->SetBackgroundThreads(number);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
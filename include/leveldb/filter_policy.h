@@ -67,6 +67,27 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a blocked bloom filter with
+// approximately the specified number of bits per key.  All probes for a
+// key fall within one 64-byte cache line, which makes lookups faster than
+// with NewBloomFilterPolicy() when filters do not fit in the CPU caches,
+// at the cost of a slightly higher false positive rate for the same
+// number of bits per key.  On x86-64 CPUs with AVX2, the probes of a
+// lookup are checked in parallel.
+//
+// The same caveats as for NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses a Ribbon filter with the false
+// positive rate of a bloom filter with "bits_per_key" bits per key, in
+// about 25% less space.  Building it is several times slower than a bloom
+// filter, so it best suits the tables of the last levels, which hold most
+// keys and are rewritten least often (see Options::filter_policy_per_level).
+//
+// The same caveats as for NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -15,13 +15,60 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_ITERATOR_H_
 #define STORAGE_LEVELDB_INCLUDE_ITERATOR_H_
 
+#include <string>
+#include <vector>
+
+#include "leveldb/cleanable.h"
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 
 namespace leveldb {
 
-class LEVELDB_EXPORT Iterator {
+// Entries copied out of an iterator by Iterator::NextBatch().  The keys
+// and values share one buffer, which is reused after Clear().
+class LEVELDB_EXPORT IteratorBatch {
+ public:
+  IteratorBatch() = default;
+
+  IteratorBatch(const IteratorBatch&) = delete;
+  IteratorBatch& operator=(const IteratorBatch&) = delete;
+
+  // Number of entries in the batch.
+  int size() const { return static_cast<int>(ends_.size() / 2); }
+
+  // The slices are valid until the batch is modified.
+  // REQUIRES: 0 <= i < size()
+  Slice key(int i) const {
+    const size_t start = (i == 0) ? 0 : ends_[2 * i - 1];
+    return Slice(data_.data() + start, ends_[2 * i] - start);
+  }
+  Slice value(int i) const {
+    return Slice(data_.data() + ends_[2 * i], ends_[2 * i + 1] - ends_[2 * i]);
+  }
+
+  // Removes all entries.
+  void Clear() {
+    data_.clear();
+    ends_.clear();
+  }
+
+  // Appends a copy of an entry.
+  void Add(const Slice& key, const Slice& value) {
+    data_.append(key.data(), key.size());
+    ends_.push_back(data_.size());
+    data_.append(value.data(), value.size());
+    ends_.push_back(data_.size());
+  }
+
+ private:
+  std::string data_;
+  std::vector<size_t> ends_;  // End offsets of each key and each value
+};
+
+// Clients can register cleanup functions, which run when the iterator is
+// destroyed, with Cleanable::RegisterCleanup().
+class LEVELDB_EXPORT Iterator : public Cleanable {
  public:
   Iterator();
 
@@ -72,33 +119,15 @@ class LEVELDB_EXPORT Iterator {
   // If an error has occurred, return it.  Else return an ok status.
   virtual Status status() const = 0;
 
-  // Clients are allowed to register function/arg1/arg2 triples that
-  // will be invoked when this iterator is destroyed.
+  // Appends copies of the current entry and of the entries after it, up
+  // to "n" entries in all, to *batch, and moves past them as if Next() had
+  // been called after each one.  Returns the number of entries appended,
+  // which is less than "n" only if the iterator is no longer Valid().
   //
-  // Note that unlike all of the preceding methods, this method is
-  // not abstract and therefore clients should not override it.
-  using CleanupFunction = void (*)(void* arg1, void* arg2);
-  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
-
- private:
-  // Cleanup functions are stored in a single-linked list.
-  // The list's head node is inlined in the iterator.
-  struct CleanupNode {
-    // True if the node is not used. Only head nodes might be unused.
-    bool IsEmpty() const { return function == nullptr; }
-    // Invokes the cleanup function.
-    void Run() {
-      assert(function != nullptr);
-      (*function)(arg1, arg2);
-    }
-
-    // The head node is used if the function pointer is not null.
-    CleanupFunction function;
-    void* arg1;
-    void* arg2;
-    CleanupNode* next;
-  };
-  CleanupNode cleanup_head_;
+  // A long scan that reads its entries in batches makes a few calls per
+  // batch instead of several virtual calls per entry through the layers
+  // of a DB iterator.
+  virtual int NextBatch(int n, IteratorBatch* batch);
 };
 
 // Return an empty iterator (yields nothing).
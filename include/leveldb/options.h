@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 
@@ -16,6 +18,8 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class SecondaryCache;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -26,7 +30,58 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZstdCompression = 0x2,
+  kLZ4Compression = 0x3
+};
+
+// The data structure that holds the entries of a memtable.  Unlike
+// CompressionType, this does not affect the persistent format.
+enum MemTableRepType {
+  // A skiplist: O(log n) inserts and lookups.
+  kSkipListRep = 0,
+  // An unsorted vector that is sorted once the memtable is full: the
+  // fastest inserts, but lookups and iterators in the active memtable
+  // scan or sort all of its entries.  Suits bulk loads without reads.
+  kVectorRep = 1,
+  // A hash table of skiplists, one per key prefix (see prefix_extractor):
+  // lookups only search their prefix's bucket, but iterators sort all
+  // entries.  Suits point lookups.
+  kHashSkipListRep = 2
+};
+
+// How the filters of filter_policy are laid out in each table.  Tables
+// written in any format can be read regardless of this setting.
+enum FilterFormat {
+  // One filter per 2KB of data block offsets.  A lookup must search the
+  // index block before it can probe its filter.
+  kBlockBasedFilter = 0,
+  // A single filter for all keys of the table, probed before the index
+  // block is searched.  It is held in memory while the table is open.
+  kFullFilter = 1,
+  // Full filters split into partitions of about filter_partition_size
+  // bytes, found through a small index that is held in memory.  The
+  // partitions are read on demand through the block cache, so the filter
+  // memory of large tables can be bounded by the cache size.
+  kPartitionedFilter = 2
+};
+
+// How the index block of each table, which maps the data blocks to their
+// key ranges, is laid out.  Tables written in any format can be read
+// regardless of this setting, but not by versions of leveldb without it
+// unless kBlockIndex is used.
+enum IndexFormat {
+  // A block with a restart point at each entry.  Each step of a seek
+  // decodes the varint lengths of an entry.
+  kBlockIndex = 0,
+  // All keys stored back to back, followed by an array of fixed-width
+  // offsets, so a seek binary-searches the offsets directly.
+  kFixedIndex = 1,
+  // kFixedIndex split into partitions of about index_partition_size
+  // bytes, found through a top-level index that is held in memory.  The
+  // partitions are read on demand through the block cache, so the index
+  // memory of large tables can be bounded by the cache size.
+  kPartitionedIndex = 2
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -81,6 +136,56 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // When level-0 holds too many files, or the write buffer fills up while
+  // the previous one is still being written out, writes are slowed down
+  // to let background work catch up before they have to stop altogether.
+  // They are paced at up to this many bytes per second, less while the
+  // compaction backlog keeps growing.  Zero selects the default rate.
+  uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // If true, a group of concurrent writes leaves the write queue as soon
+  // as it has been appended to the log, so the next group's log write
+  // overlaps its memtable insert.  Groups still become visible to readers
+  // in log order.  Mostly helps many threads issuing small writes.
+  bool enable_pipelined_write = false;
+
+  // If true, the writers of a group of concurrent writes insert their own
+  // batches into the memtable in parallel instead of leaving all of the
+  // group's inserts to one thread.
+  // Ignored with kHashSkipListRep, which does not support it.
+  bool allow_concurrent_memtable_write = false;
+
+  // The data structure that holds the entries of a memtable.
+  MemTableRepType memtable_rep = kSkipListRep;
+
+  // Number of buckets of a kHashSkipListRep memtable.
+  size_t memtable_hash_bucket_count = 10000;
+
+  // If non-null, kHashSkipListRep puts the keys that have the same prefix
+  // under this transform in the same bucket.  Keys outside its domain,
+  // or all keys if it is null, are hashed whole.
+  //
+  // The filters of the tables then also hold the prefixes of their keys,
+  // which lets iterators opened with ReadOptions::prefix_same_as_start skip
+  // the tables without keys of the prefix they seek to.  That requires
+  // the keys with the same prefix to be adjacent in the order of the
+  // comparator.  Tables written under another extractor, or none, are
+  // read without their filters until compactions rewrite them.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // Maximum number of compactions that may run concurrently on disjoint
+  // levels or key ranges.  Values above one ask options.env for a larger
+  // background thread pool (see Env::SetBackgroundThreads), with one extra
+  // thread reserved for memtable flushes so that they are not stuck behind
+  // long-running compactions.
+  int max_background_compactions = 1;
+
+  // Maximum number of pieces a single compaction may be split into.  Each
+  // piece covers a disjoint key range of the compaction's inputs and is
+  // written by its own thread; all outputs are installed together.  A value
+  // of one disables splitting.
+  int max_subcompactions = 1;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -93,6 +198,19 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If true, the index and filter blocks of tables are kept in block_cache,
+  // inserted with Cache::Priority::kHigh, instead of in memory owned by
+  // each open table.  The block cache then bounds the memory used for
+  // reads, whatever max_open_files is.  Blocks that the Env serves from
+  // memory-mapped files take no heap memory and stay with their table.
+  bool cache_index_and_filter_blocks = false;
+
+  // If non-null, data blocks that miss block_cache are looked up in this
+  // larger and slower tier before being read from their table file, and
+  // blocks read from table files are stored in it.  See
+  // leveldb/secondary_cache.h.
+  SecondaryCache* secondary_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -104,6 +222,24 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, each data block also stores a hash table from its keys to
+  // their restart points, which point lookups use to skip the binary
+  // search of the block, or to skip the block if it does not hold the
+  // key.  Costs about one byte per key.  Blocks with more than 253 restart
+  // points are built without it.  Tables built with it cannot be read by
+  // versions of leveldb without it.
+  //
+  // Requires that user keys compare equal only if they are byte-wise
+  // equal, as with the default comparator (see also
+  // Comparator::PointLookupKey()).
+  bool data_block_hash_index = false;
+
+  // Layout of the index block of each table.
+  IndexFormat index_format = kBlockIndex;
+
+  // Approximate size of each index partition with kPartitionedIndex.
+  size_t index_partition_size = 4096;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -130,6 +266,28 @@ struct LEVELDB_EXPORT Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression = kSnappyCompression;
 
+  // Compression level for zstd.
+  // Currently only the range [-5,22] is supported. Default is 1.
+  int zstd_compression_level = 1;
+
+  // If positive, each table written by a compaction with kZstdCompression
+  // gets its own zstd dictionary of at most this many bytes, trained on
+  // its first data blocks (up to 100 times this size) and stored in the
+  // table.  This improves the compression of small blocks of similar
+  // values, such as JSON documents.  Tables written by memtable flushes
+  // never get a dictionary.
+  //
+  // Default: 0, which disables dictionaries.
+  size_t zstd_max_dict_bytes = 0;
+
+  // If non-empty, overrides "compression" for the tables written by
+  // memtable flushes and compactions: tables of level L use entry
+  // min(L, size - 1).  Flushes always use the level-0 entry.  A typical
+  // choice is cheap compression (kLZ4Compression or kNoCompression) for
+  // the first levels, which are rewritten often, and kZstdCompression
+  // for the larger, colder levels below.
+  std::vector<CompressionType> compression_per_level;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -140,6 +298,20 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If non-empty, overrides "filter_policy" for the tables written by
+  // memtable flushes and compactions: tables of level L use entry
+  // min(L, size - 1), and a null entry means no filters.  A typical
+  // choice is bloom filters, which are fast to build, for the first
+  // levels and NewRibbonFilterPolicy() for the last one, which holds most
+  // keys.  Tables are read with whichever of the policies built them.
+  std::vector<const FilterPolicy*> filter_policy_per_level;
+
+  // Layout of the filters built by filter_policy.
+  FilterFormat filter_format = kFullFilter;
+
+  // Approximate size of each filter partition with kPartitionedFilter.
+  size_t filter_partition_size = 4096;
 };
 
 // Options that control read operations
@@ -159,6 +331,14 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true and the database has a prefix_extractor, an iterator positioned
+  // by Seek(target), with target in the extractor's domain, only yields
+  // the keys with the prefix of target: it becomes invalid past them in
+  // either direction.  Seeks skip the tables whose filters rule out that
+  // prefix without reading their index or data blocks.  Has no effect on
+  // the other ways to position an iterator.
+  bool prefix_same_as_start = false;
 };
 
 // Options that control write operations
@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// PinnableSlice is the value type of DB::Get() calls that avoid copying the
+// value.  The slice can point straight into a cached block or a memtable
+// and keeps that memory alive ("pinned") until the PinnableSlice is reset
+// or destroyed.  Values that cannot be pinned are copied into a buffer.
+//
+// A pinned PinnableSlice holds on to memory of its DB, so it must be reset
+// or destroyed before the DB is deleted, like an Iterator.  A value pinned
+// in a memtable also keeps the table files of that moment alive; see
+// DB::Get().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+
+#include "leveldb/cleanable.h"
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT PinnableSlice : public Slice, public Cleanable {
+ public:
+  PinnableSlice() : buf_(&self_space_), pinned_(false) {}
+
+  // Copied values are stored in *buf instead of an internal buffer.
+  explicit PinnableSlice(std::string* buf) : buf_(buf), pinned_(false) {}
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  ~PinnableSlice() { Reset(); }
+
+  // Points at "s", which stays valid until the cleanup functions of
+  // *cleanable run.  They are moved to this object.
+  void PinSlice(const Slice& s, Cleanable* cleanable);
+
+  // Points at "s", which stays valid until (*function)(arg1, arg2) runs
+  // when this object is reset.
+  void PinSlice(const Slice& s, CleanupFunction function, void* arg1,
+                void* arg2);
+
+  // Points at a copy of "s" in the buffer.
+  void PinSelf(const Slice& s);
+
+  // Releases the pinned memory, if any, and makes the slice empty.
+  void Reset();
+
+  // True if the slice points at pinned memory rather than at the buffer.
+  bool IsPinned() const { return pinned_; }
+
+ private:
+  std::string self_space_;
+  std::string* const buf_;
+  bool pinned_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
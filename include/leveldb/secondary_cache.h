@@ -0,0 +1,82 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SecondaryCache is a second tier behind the block cache, in a larger
+// but slower medium than heap memory: compressed memory, or files on a
+// local disk that is faster than the one holding the database.  Tables
+// look blocks up in it when they miss the block cache, before reading
+// their file, and store in it every block that they read from their file.
+//
+// Blocks are stored as they appear in the table file, compressed if the
+// table is and followed by their trailer, so that a hit is checked and
+// uncompressed like a read from the file.
+//
+// A SecondaryCache may be shared by several databases; its
+// implementations must be thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT SecondaryCache {
+ public:
+  SecondaryCache() = default;
+
+  SecondaryCache(const SecondaryCache&) = delete;
+  SecondaryCache& operator=(const SecondaryCache&) = delete;
+
+  virtual ~SecondaryCache();
+
+  // Store a copy of "value" under "key", evicting other entries to make
+  // room if needed.  The entry may be dropped, e.g. if it is larger than
+  // the cache.  Values stored under a key never change, so inserting an
+  // existing key may be ignored.
+  virtual void Insert(const Slice& key, const Slice& value) = 0;
+
+  // If the cache holds "key", store a copy of its value in *value and
+  // return true.  Else return false.
+  virtual bool Lookup(const Slice& key, std::string* value) = 0;
+
+  // Return a new numeric id, which clients prepend to their keys to
+  // partition the key space (see Cache::NewId()).
+  virtual uint64_t NewId() = 0;
+
+  // Return an estimate of the bytes held by the cache.
+  virtual size_t TotalCharge() const = 0;
+
+  // Number of Lookup() calls that found their key, and that did not.
+  virtual uint64_t LookupHits() const = 0;
+  virtual uint64_t LookupMisses() const = 0;
+};
+
+// Create a secondary cache that holds up to "capacity" bytes in memory.
+// Entries are compressed with "compression" when it is supported and
+// saves at least 12.5% of their size.  Evicts least recently used entries.
+LEVELDB_EXPORT SecondaryCache* NewCompressedSecondaryCache(
+    size_t capacity, CompressionType compression = kSnappyCompression);
+
+// Create a secondary cache that holds up to "capacity" bytes in files of
+// directory "dir" of "env", e.g. on a local SSD.  Entries are appended to
+// a buffer that is written as a new file once it holds capacity / 8
+// bytes, and the oldest file is deleted to make room for the new ones.
+// The cache does not survive restarts: it deletes the files of "dir"
+// named like the ones it writes, six or more digits followed by ".sc".
+// Give each cache a directory of its own.
+LEVELDB_EXPORT SecondaryCache* NewFileSecondaryCache(Env* env,
+                                                     const std::string& dir,
+                                                     size_t capacity);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
@@ -7,15 +7,17 @@
 
 #include <cstdint>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
+#include "leveldb/options.h"
 
 namespace leveldb {
 
 class Block;
+struct BlockContents;
 class BlockHandle;
 class Footer;
-struct Options;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
@@ -50,6 +52,10 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the entries added with
+  // TableBuilder::AddRangeTombstone(), or nullptr if the table has none.
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -63,18 +69,91 @@ class LEVELDB_EXPORT Table {
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  // Like BlockReader().  If "get_target" is non-null, the iterator is
+  // positioned for a point lookup of it (see Block::NewIteratorForGet()).
+  // If "pinnable" is non-null, *pinnable is set to whether the entries of
+  // the block stay valid until the cleanup functions of the returned
+  // iterator run, which is not the case for blocks of memory-mapped files.
+  static Iterator* DataBlockReader(Table* table, const ReadOptions&,
+                                   const Slice& index_value,
+                                   const Slice* get_target,
+                                   bool* pinnable = nullptr);
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key).  May not make such a call if filter policy, or the hash
+  // index of the data block, says that key is not present.
+  //
+  // The entry stays valid until the cleanup functions of the Cleanable
+  // passed to handle_result run, so it can keep the entry by delegating
+  // them.  That Cleanable is "table_pin" if the entry lives in the file
+  // mapping of the table, so "table_pin" must keep the table open.  If
+  // "table_pin" is null, such entries are passed without a Cleanable and
+  // must be copied.
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
-
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+                                           const Slice& v, Cleanable* pin),
+                     Cleanable* table_pin = nullptr);
+
+  // Batched form of InternalGet() for keys[0,n-1], which must be sorted.
+  // Calls (*handle_result)(args[i], ...) for the entry found by each seek
+  // and stores the outcome of lookup i in statuses[i].  Filters are probed
+  // before any data block is read, a data block holding several of the keys
+  // is read only once, and all blocks missing from the block cache are
+  // fetched with a single RandomAccessFile::MultiRead().  Entries are
+  // passed without a Cleanable and must be copied.
+  void InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                        void* const* args,
+                        void (*handle_result)(void* arg, const Slice& k,
+                                              const Slice& v, Cleanable* pin),
+                        Status* statuses);
+
+  // Returns false if the full filter of the table, or the filter partition
+  // holding the first entry at or after "target", rules out "filter_key".
+  // Point lookups pass the same key for both.  Tables with block-based
+  // filters are checked once the index block has located the key's data
+  // block, so this always returns true for them.
+  bool FilterMayMatch(const ReadOptions&, const Slice& target,
+                      const Slice& filter_key);
+  bool PartitionMayMatch(const ReadOptions&, const BlockHandle& handle,
+                         const Slice& key);
+
+  // Like FilterMayMatch() for block-based filters, which keep a filter
+  // per data block.
+  bool BlockFilterMayMatch(const ReadOptions&, uint64_t block_offset,
+                           const Slice& key);
+
+  // Index and filter blocks kept in the block cache with
+  // cache_index_and_filter_blocks.  Index blocks and the index of
+  // partitioned filters are cached parsed ("parse"), filters as raw
+  // BlockContents.
+  //
+  // CacheMetaBlock() inserts a block read by Open() and returns true, or
+  // returns false if the table keeps it itself.
+  bool CacheMetaBlock(const BlockHandle& handle, const BlockContents& contents,
+                      bool parse) const;
+  Cache::Handle* InsertMetaBlock(const BlockHandle& handle,
+                                 const BlockContents& contents,
+                                 bool parse) const;
+  // Sets *cache_handle to the cache entry of the block, reading it again if
+  // it was evicted.  The caller must release it.
+  Status LookupMetaBlock(const ReadOptions&, const BlockHandle& handle,
+                         bool parse, Cache::Handle** cache_handle) const;
+  // Returns an iterator over "block", or over the parsed block at "handle"
+  // in the block cache if "block" is null.
+  Iterator* NewMetaBlockIterator(const ReadOptions&, Block* block,
+                                 const BlockHandle& handle) const;
+  // Returns an iterator over the index block, or over all the index
+  // partitions of a table built with kPartitionedIndex.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+
+  Status ReadMeta(const Footer& footer);
+  void ReadFilter(FilterFormat format, const Slice& filter_handle_value);
+  Status ReadRangeDelBlock(const Slice& handle_value);
+  Status ReadCompressionDict(const Slice& handle_value);
 
   Rep* const rep_;
 };
@@ -51,6 +51,13 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add key,value to the range deletion block of the table, which is kept
+  // apart from the data blocks and read back with
+  // Table::NewRangeTombstoneIterator().  Entries may be added in any order;
+  // they are sorted by comparator when the table is finished.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -75,14 +82,29 @@ class LEVELDB_EXPORT TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
-  // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Number of calls to AddRangeTombstone() so far.
+  uint64_t NumRangeTombstones() const;
+
+  // Size of the file generated so far, counting the data blocks held
+  // back for zstd dictionary training (see Options::zstd_max_dict_bytes)
+  // uncompressed.  If invoked after a successful Finish() call, returns
+  // the size of the final generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void WriteBlock(const Slice& raw, bool data_block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  // Add the index entry of the last data block, and with kPartitionedIndex
+  // start a new index partition if the current one is full.
+  void AddIndexEntry();
+  void CutIndexPartition();
+  // Train the zstd dictionary and write the data blocks held back for it.
+  void EnterUnbuffered();
+  // Feed the filter builder of Options::filter_format.
+  void AddFilterKey(const Slice& key);
+  void StartFilterBlock();
 
   struct Rep;
   Rep* rep_;
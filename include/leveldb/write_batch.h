@@ -38,6 +38,9 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // Called for DeleteRange() records.  The default implementation
+    // ignores them.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
   };
 
   WriteBatch();
@@ -54,6 +57,12 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key falls in [begin, end).  Keys are compared
+  // with the database's comparator; nothing is erased unless begin < end.
+  // Unlike issuing one Delete() per key, this adds a single record to the
+  // batch however many keys the range holds.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -81,6 +81,63 @@ bool Snappy_GetUncompressedLength(const char* input, size_t length,
 bool Snappy_Uncompress(const char* input_data, size_t input_length,
                        char* output);
 
+// Store the zstd compression of "input[0,input_length-1]" at compression
+// level "level" in *output.  Returns false if zstd is not supported by
+// this port.
+bool Zstd_Compress(int level, const char* input, size_t input_length,
+                   std::string* output);
+
+// If input[0,input_length-1] looks like a valid zstd compressed
+// buffer, store the size of the uncompressed data in *result and
+// return true.  Else return false.
+bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                size_t* result);
+
+// Attempt to zstd uncompress input[0,input_length-1] into *output.
+// Returns true if successful, false if the input is invalid zstd
+// compressed data.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// Zstd_GetUncompressedLength.
+bool Zstd_Uncompress(const char* input_data, size_t input_length,
+                     char* output);
+
+// Train a zstd dictionary of at most "max_dict_bytes" bytes on the
+// samples that "samples" holds back to back, of the given lengths, and
+// store it in *dict.  Returns false if zstd is not supported or the
+// samples are not enough to train on.
+bool Zstd_TrainDictionary(const std::string& samples,
+                          const std::vector<size_t>& sample_lengths,
+                          size_t max_dict_bytes, std::string* dict);
+
+// A zstd dictionary digested for compression at a fixed level.  Its
+// Compress() is Zstd_Compress() with the dictionary.  Not thread-safe.
+class ZstdCompressDict {
+ public:
+  ZstdCompressDict(const char* dict, size_t length, int level);
+  ~ZstdCompressDict();
+
+  bool Compress(const char* input, size_t length, std::string* output);
+};
+
+// A zstd dictionary digested for decompression.  Its Uncompress() is
+// Zstd_Uncompress() with the dictionary.  Thread-safe.
+class ZstdUncompressDict {
+ public:
+  ZstdUncompressDict(const char* dict, size_t length);
+  ~ZstdUncompressDict();
+
+  bool Uncompress(const char* input, size_t length, char* output) const;
+};
+
+// Same as the zstd functions above, for LZ4.  Since LZ4 does not record
+// the uncompressed length, LZ4_Compress() prepends it to its output.
+bool LZ4_Compress(const char* input, size_t input_length, std::string* output);
+bool LZ4_GetUncompressedLength(const char* input, size_t length,
+                               size_t* result);
+bool LZ4_Uncompress(const char* input_data, size_t input_length, char* output);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
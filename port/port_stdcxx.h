@@ -28,6 +28,13 @@
 #if HAVE_SNAPPY
 #include <snappy.h>
 #endif  // HAVE_SNAPPY
+#if HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif  // HAVE_ZSTD
+#if HAVE_LZ4
+#include <lz4.h>
+#endif  // HAVE_LZ4
 
 #include <cassert>
 #include <condition_variable>  // NOLINT
@@ -35,6 +42,7 @@
 #include <cstdint>
 #include <mutex>  // NOLINT
 #include <string>
+#include <vector>
 
 #include "port/thread_annotations.h"
 
@@ -126,6 +134,277 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
 #endif  // HAVE_SNAPPY
 }
 
+inline bool Zstd_Compress(int level, const char* input, size_t length,
+                          std::string* output) {
+#if HAVE_ZSTD
+  // Get the MaxCompressedLength.
+  size_t outlen = ZSTD_compressBound(length);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  outlen = ZSTD_compress(&(*output)[0], output->size(), input, length, level);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)level;
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#if HAVE_ZSTD
+  const unsigned long long size = ZSTD_getFrameContentSize(input, length);
+  if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    return false;
+  }
+  *result = static_cast<size_t>(size);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_Uncompress(const char* input, size_t length, char* output) {
+#if HAVE_ZSTD
+  size_t outlen;
+  if (!Zstd_GetUncompressedLength(input, length, &outlen)) {
+    return false;
+  }
+  const size_t result = ZSTD_decompress(output, outlen, input, length);
+  return !ZSTD_isError(result) && result == outlen;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+// Train a zstd dictionary of at most "max_dict_bytes" bytes on the
+// samples that "samples" holds back to back, of the given lengths, and
+// store it in *dict.  Returns false if zstd is not supported or the
+// samples are not enough to train on.
+inline bool Zstd_TrainDictionary(const std::string& samples,
+                                 const std::vector<size_t>& sample_lengths,
+                                 size_t max_dict_bytes, std::string* dict) {
+#if HAVE_ZSTD
+  dict->resize(max_dict_bytes);
+  const size_t outlen = ZDICT_trainFromBuffer(
+      &(*dict)[0], dict->size(), samples.data(), sample_lengths.data(),
+      static_cast<unsigned>(sample_lengths.size()));
+  if (ZDICT_isError(outlen)) {
+    dict->clear();
+    return false;
+  }
+  dict->resize(outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)samples;
+  (void)sample_lengths;
+  (void)max_dict_bytes;
+  (void)dict;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+// A zstd dictionary digested for compression at a fixed level, together
+// with a compression context.  Not thread-safe.
+class ZstdCompressDict {
+ public:
+  ZstdCompressDict(const char* dict, size_t length, int level) {
+#if HAVE_ZSTD
+    cdict_ = ZSTD_createCDict(dict, length, level);
+    ctx_ = ZSTD_createCCtx();
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)dict;
+    (void)length;
+    (void)level;
+#endif  // HAVE_ZSTD
+  }
+
+  ZstdCompressDict(const ZstdCompressDict&) = delete;
+  ZstdCompressDict& operator=(const ZstdCompressDict&) = delete;
+
+  ~ZstdCompressDict() {
+#if HAVE_ZSTD
+    ZSTD_freeCCtx(ctx_);
+    ZSTD_freeCDict(cdict_);
+#endif  // HAVE_ZSTD
+  }
+
+  // Same as Zstd_Compress(), with the dictionary.
+  bool Compress(const char* input, size_t length, std::string* output) {
+#if HAVE_ZSTD
+    if (cdict_ == nullptr || ctx_ == nullptr) {
+      return false;
+    }
+    output->resize(ZSTD_compressBound(length));
+    const size_t outlen = ZSTD_compress_usingCDict(
+        ctx_, &(*output)[0], output->size(), input, length, cdict_);
+    if (ZSTD_isError(outlen)) {
+      return false;
+    }
+    output->resize(outlen);
+    return true;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  ZSTD_CDict* cdict_;
+  ZSTD_CCtx* ctx_;
+#endif  // HAVE_ZSTD
+};
+
+// A zstd dictionary digested for decompression.  Thread-safe.
+class ZstdUncompressDict {
+ public:
+  ZstdUncompressDict(const char* dict, size_t length) {
+#if HAVE_ZSTD
+    ddict_ = ZSTD_createDDict(dict, length);
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)dict;
+    (void)length;
+#endif  // HAVE_ZSTD
+  }
+
+  ZstdUncompressDict(const ZstdUncompressDict&) = delete;
+  ZstdUncompressDict& operator=(const ZstdUncompressDict&) = delete;
+
+  ~ZstdUncompressDict() {
+#if HAVE_ZSTD
+    ZSTD_freeDDict(ddict_);
+#endif  // HAVE_ZSTD
+  }
+
+  // Same as Zstd_Uncompress(), with the dictionary.
+  bool Uncompress(const char* input, size_t length, char* output) const {
+#if HAVE_ZSTD
+    size_t outlen;
+    if (ddict_ == nullptr ||
+        !Zstd_GetUncompressedLength(input, length, &outlen)) {
+      return false;
+    }
+    // Decompression contexts are reused by each thread.
+    struct Context {
+      Context() : ctx(ZSTD_createDCtx()) {}
+      ~Context() { ZSTD_freeDCtx(ctx); }
+      ZSTD_DCtx* const ctx;
+    };
+    static thread_local Context context;
+    if (context.ctx == nullptr) {
+      return false;
+    }
+    const size_t result = ZSTD_decompress_usingDDict(context.ctx, output, outlen,
+                                                     input, length, ddict_);
+    return !ZSTD_isError(result) && result == outlen;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  ZSTD_DDict* ddict_;
+#endif  // HAVE_ZSTD
+};
+
+// LZ4 blocks do not record their uncompressed length, so the output of
+// LZ4_Compress() starts with it as a little-endian uint32.
+inline bool LZ4_Compress(const char* input, size_t length,
+                         std::string* output) {
+#if HAVE_LZ4
+  if (length > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  output->resize(4 + bound);
+  for (int i = 0; i < 4; i++) {
+    (*output)[i] = static_cast<char>((length >> (8 * i)) & 0xff);
+  }
+  const int outlen = LZ4_compress_default(input, &(*output)[4],
+                                          static_cast<int>(length), bound);
+  if (outlen <= 0) {
+    return false;
+  }
+  output->resize(4 + outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool LZ4_GetUncompressedLength(const char* input, size_t length,
+                                      size_t* result) {
+#if HAVE_LZ4
+  if (length < 4) {
+    return false;
+  }
+  *result = 0;
+  for (int i = 0; i < 4; i++) {
+    *result |= static_cast<size_t>(static_cast<unsigned char>(input[i]))
+               << (8 * i);
+  }
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool LZ4_Uncompress(const char* input, size_t length, char* output) {
+#if HAVE_LZ4
+  size_t outlen;
+  if (!LZ4_GetUncompressedLength(input, length, &outlen) ||
+      outlen > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  return LZ4_decompress_safe(input + 4, output, static_cast<int>(length - 4),
+                             static_cast<int>(outlen)) ==
+         static_cast<int>(outlen);
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   // Silence compiler warnings about unused arguments.
   (void)func;
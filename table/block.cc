@@ -13,29 +13,83 @@
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      num_restarts_(0),
+      hash_buckets_(nullptr),
+      num_hash_buckets_(0),
+      fixed_format_(false),
+      num_entries_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
+    return;
+  }
+  size_t limit = size_ - sizeof(uint32_t);  // End of the restart array
+  num_restarts_ = DecodeFixed32(data_ + limit);
+  if ((num_restarts_ & kBlockFixedFormatFlag) != 0) {
+    fixed_format_ = true;
+    num_entries_ = num_restarts_ & ~kBlockFixedFormatFlag;
+    num_restarts_ = 0;
+    InitFixedFormat(limit);
+    return;
+  }
+  if ((num_restarts_ & kBlockHashIndexFlag) != 0) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (limit < sizeof(uint32_t)) {
+      size_ = 0;
+      return;
+    }
+    limit -= sizeof(uint32_t);
+    num_hash_buckets_ = DecodeFixed32(data_ + limit);
+    if (num_hash_buckets_ == 0 || num_hash_buckets_ > limit) {
+      size_ = 0;
+      return;
+    }
+    limit -= num_hash_buckets_;
+    hash_buckets_ = reinterpret_cast<const uint8_t*>(data_ + limit);
+  }
+  size_t max_restarts_allowed = limit / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for num_restarts_
+    size_ = 0;
   } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    restart_offset_ = limit - num_restarts_ * sizeof(uint32_t);
+  }
+}
+
+void Block::InitFixedFormat(size_t limit) {
+  // Two offset arrays of num_entries_ + 1 entries each
+  const uint64_t offsets_size =
+      2 * (static_cast<uint64_t>(num_entries_) + 1) * sizeof(uint32_t);
+  if (offsets_size > limit) {
+    size_ = 0;
+    return;
+  }
+  restart_offset_ = limit - offsets_size;
+  // Check once that the offsets are in order and in bounds, so that the
+  // iterators can use them as they are.
+  const char* offsets = data_ + restart_offset_;
+  uint32_t previous = 0;
+  for (uint32_t i = 0; i < 2 * (num_entries_ + 1); i++) {
+    const uint32_t offset = DecodeFixed32(offsets + i * sizeof(uint32_t));
+    if (offset < previous || offset > restart_offset_ ||
+        (i == 0 && offset != 0)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    previous = offset;
+  }
+  // The values must start where the keys end.
+  if (DecodeFixed32(offsets + num_entries_ * sizeof(uint32_t)) !=
+      DecodeFixed32(offsets + (num_entries_ + 1) * sizeof(uint32_t))) {
+    size_ = 0;
   }
 }
 
@@ -81,6 +135,9 @@ class Block::Iter : public Iterator {
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
 
+  const uint8_t* const hash_buckets_;  // Hash index, or nullptr if none
+  uint32_t const num_hash_buckets_;
+
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
   uint32_t restart_index_;  // Index of restart block in which current_ falls
@@ -114,11 +171,14 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const uint8_t* hash_buckets,
+       uint32_t num_hash_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_buckets_(hash_buckets),
+        num_hash_buckets_(num_hash_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -140,6 +200,16 @@ class Block::Iter : public Iterator {
     ParseNextKey();
   }
 
+  int NextBatch(int n, IteratorBatch* batch) override {
+    int count = 0;
+    while (count < n && Valid()) {
+      batch->Add(key_, value_);
+      ParseNextKey();
+      count++;
+    }
+    return count;
+  }
+
   void Prev() override {
     assert(Valid());
 
@@ -226,6 +296,35 @@ class Block::Iter : public Iterator {
     }
   }
 
+  // Like Seek(), except that the iterator may be left !Valid() when no
+  // entry matches "target" for a point lookup.
+  void SeekForGet(const Slice& target) {
+    if (hash_buckets_ == nullptr) {
+      Seek(target);
+      return;
+    }
+    const Slice hash_key = comparator_->PointLookupKey(target);
+    const uint8_t restart = hash_buckets_[Hash(hash_key.data(),
+                                               hash_key.size(),
+                                               kBlockHashSeed) %
+                                          num_hash_buckets_];
+    if (restart == kBlockHashNoEntry) {
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return;
+    }
+    if (restart == kBlockHashCollision || restart >= num_restarts_) {
+      Seek(target);
+      return;
+    }
+    // The entries before the restart point hold smaller keys, unless the
+    // block does not hold "target" at all.
+    SeekToRestartPoint(restart);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+      // Keep skipping
+    }
+  }
+
   void SeekToFirst() override {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -277,16 +376,113 @@ class Block::Iter : public Iterator {
   }
 };
 
+// Iterator over a block with the fixed-width layout of block_builder.cc.
+class Block::FixedIter : public Iterator {
+ public:
+  FixedIter(const Comparator* comparator, const char* data,
+            uint32_t offsets, uint32_t num_entries)
+      : comparator_(comparator),
+        data_(data),
+        key_offsets_(data + offsets),
+        value_offsets_(key_offsets_ + (num_entries + 1) * sizeof(uint32_t)),
+        num_entries_(num_entries),
+        current_(num_entries) {
+    assert(num_entries_ > 0);
+  }
+
+  bool Valid() const override { return current_ < num_entries_; }
+  Status status() const override { return Status::OK(); }
+  Slice key() const override {
+    assert(Valid());
+    return KeyAt(current_);
+  }
+  Slice value() const override {
+    assert(Valid());
+    const uint32_t start = Offset(value_offsets_, current_);
+    return Slice(data_ + start, Offset(value_offsets_, current_ + 1) - start);
+  }
+
+  void Next() override {
+    assert(Valid());
+    current_++;
+  }
+
+  void Prev() override {
+    assert(Valid());
+    current_ = (current_ == 0) ? num_entries_ : current_ - 1;
+  }
+
+  void Seek(const Slice& target) override {
+    // Binary search for the first key >= target
+    uint32_t left = 0;
+    uint32_t right = num_entries_;
+    while (left < right) {
+      const uint32_t mid = left + (right - left) / 2;
+      if (comparator_->Compare(KeyAt(mid), target) < 0) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    current_ = left;
+  }
+
+  void SeekToFirst() override { current_ = 0; }
+  void SeekToLast() override { current_ = num_entries_ - 1; }
+
+ private:
+  static uint32_t Offset(const char* offsets, uint32_t index) {
+    return DecodeFixed32(offsets + index * sizeof(uint32_t));
+  }
+
+  Slice KeyAt(uint32_t index) const {
+    const uint32_t start = Offset(key_offsets_, index);
+    return Slice(data_ + start, Offset(key_offsets_, index + 1) - start);
+  }
+
+  const Comparator* const comparator_;
+  const char* const data_;
+  const char* const key_offsets_;    // uint32[num_entries_ + 1]
+  const char* const value_offsets_;  // uint32[num_entries_ + 1]
+  uint32_t const num_entries_;
+  uint32_t current_;  // num_entries_ if !Valid()
+};
+
+Block::Iter* Block::NewIter(const Comparator* comparator) {
+  if (size_ < sizeof(uint32_t) || num_restarts_ == 0) {
+    return nullptr;
+  }
+  return new Iter(comparator, data_, restart_offset_, num_restarts_,
+                  hash_buckets_, num_hash_buckets_);
+}
+
 Iterator* Block::NewIterator(const Comparator* comparator) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (fixed_format_) {
+    if (num_entries_ == 0) {
+      return NewEmptyIterator();
+    }
+    return new FixedIter(comparator, data_, restart_offset_, num_entries_);
+  }
+  Iter* iter = NewIter(comparator);
+  if (iter == nullptr) {
     return NewEmptyIterator();
-  } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
   }
+  return iter;
+}
+
+Iterator* Block::NewIteratorForGet(const Comparator* comparator,
+                                   const Slice& target) {
+  Iter* iter = NewIter(comparator);
+  if (iter == nullptr) {
+    Iterator* fallback = NewIterator(comparator);
+    fallback->Seek(target);
+    return fallback;
+  }
+  iter->SeekForGet(target);
+  return iter;
 }
 
 }  // namespace leveldb
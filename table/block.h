@@ -28,15 +28,31 @@ class Block {
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Returns an iterator positioned as by Seek(target), for a point lookup
+  // of "target".  If the block has a hash index, the iterator is positioned
+  // without a binary search, and is left !Valid() if the block holds no
+  // entry matching "target".
+  Iterator* NewIteratorForGet(const Comparator* comparator,
+                              const Slice& target);
+
  private:
   class Iter;
+  class FixedIter;
 
-  uint32_t NumRestarts() const;
+  Iter* NewIter(const Comparator* comparator);
+  void InitFixedFormat(size_t limit);
 
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
-  bool owned_;               // Block owns data_[]
+  uint32_t num_restarts_;
+  const uint8_t* hash_buckets_;  // Hash index, or nullptr if none
+  uint32_t num_hash_buckets_;
+  // With the fixed-width layout, the number of entries; restart_offset_
+  // is then the offset of their key offsets.
+  bool fixed_format_;
+  uint32_t num_entries_;
+  bool owned_;  // Block owns data_[]
 };
 
 }  // namespace leveldb
@@ -25,6 +25,29 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// With Options::data_block_hash_index, data blocks end with a hash index
+// instead:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[hash(key) % num_buckets] holds the index of the restart point
+// before the entries of key, kBlockHashNoEntry if the block holds no key
+// hashing to it, or kBlockHashCollision if such keys follow different
+// restart points.  Keys are hashed as returned by
+// Comparator::PointLookupKey(), so all versions of a key hash alike.
+//
+// Index blocks built with an Options::index_format other than kBlockIndex
+// are not prefix-compressed, and keep their keys apart from their values:
+//     keys: char[]
+//     values: char[]
+//     key_offsets: uint32[num_entries + 1]
+//     value_offsets: uint32[num_entries + 1]
+//     num_entries | kBlockFixedFormatFlag: uint32
+// Key i spans [key_offsets[i], key_offsets[i + 1]) and value i
+// [value_offsets[i], value_offsets[i + 1]), so a seek binary-searches the
+// offsets without decoding any entry.
 
 #include "table/block_builder.h"
 
@@ -33,12 +56,24 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+// Hash index buckets per key: the table is filled to 3/4 at most.
+static size_t NumHashBuckets(size_t num_keys) { return num_keys * 4 / 3 + 1; }
+
+BlockBuilder::BlockBuilder(const Options* options, Type type)
+    : options_(options),
+      restarts_(),
+      counter_(0),
+      finished_(false),
+      type_(type),
+      hash_index_(type == kDataBlock && options->data_block_hash_index),
+      fixed_format_(type == kIndexBlock &&
+                    options->index_format != kBlockIndex) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -50,21 +85,69 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_index_ = type_ == kDataBlock && options_->data_block_hash_index;
+  key_hashes_.clear();
+  fixed_format_ =
+      type_ == kIndexBlock && options_->index_format != kBlockIndex;
+  values_.clear();
+  key_ends_.clear();
+  value_ends_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                       // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+  if (fixed_format_) {
+    return buffer_.size() + values_.size() +
+           2 * (key_ends_.size() + 1) * sizeof(uint32_t) + sizeof(uint32_t);
+  }
+  size_t estimate = (buffer_.size() +                       // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));  // Restart array length
+  if (hash_index_) {
+    estimate += NumHashBuckets(key_hashes_.size()) + sizeof(uint32_t);
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
+  if (fixed_format_) {
+    const uint32_t values_offset = buffer_.size();
+    buffer_.append(values_);
+    PutFixed32(&buffer_, 0);
+    for (uint32_t end : key_ends_) {
+      PutFixed32(&buffer_, end);
+    }
+    PutFixed32(&buffer_, values_offset);
+    for (uint32_t end : value_ends_) {
+      PutFixed32(&buffer_, values_offset + end);
+    }
+    PutFixed32(&buffer_, key_ends_.size() | kBlockFixedFormatFlag);
+    finished_ = true;
+    return Slice(buffer_);
+  }
   // Append restart array
   // 保存重启点
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  if (hash_index_ && !key_hashes_.empty() &&
+      restarts_.size() < kBlockHashCollision) {
+    const size_t num_buckets = NumHashBuckets(key_hashes_.size());
+    std::string buckets(num_buckets, static_cast<char>(kBlockHashNoEntry));
+    for (const auto& key_hash : key_hashes_) {
+      char& bucket = buckets[key_hash.first % num_buckets];
+      const uint8_t restart = static_cast<uint8_t>(key_hash.second);
+      if (static_cast<uint8_t>(bucket) == kBlockHashNoEntry) {
+        bucket = static_cast<char>(restart);
+      } else if (static_cast<uint8_t>(bucket) != restart) {
+        bucket = static_cast<char>(kBlockHashCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    PutFixed32(&buffer_, restarts_.size() | kBlockHashIndexFlag);
+  } else {
+    PutFixed32(&buffer_, restarts_.size());
+  }
   finished_ = true;
   return Slice(buffer_);
 }
@@ -75,8 +158,16 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   assert(!finished_);
   // block_restart_interval控制重启点之间的距离
   assert(counter_ <= options_->block_restart_interval);
-  assert(buffer_.empty()  // No values yet?
+  assert(empty()  // No values yet?
          || options_->comparator->Compare(key, last_key_piece) > 0);
+  if (fixed_format_) {
+    buffer_.append(key.data(), key.size());
+    values_.append(value.data(), value.size());
+    key_ends_.push_back(buffer_.size());
+    value_ends_.push_back(values_.size());
+    last_key_.assign(key.data(), key.size());
+    return;
+  }
   size_t shared = 0;
   if (counter_ < options_->block_restart_interval) {
     // See how much sharing to do with previous string
@@ -108,6 +199,13 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   last_key_.append(key.data() + shared, non_shared);
   assert(Slice(last_key_) == key);
   counter_++;
+
+  if (hash_index_) {
+    const Slice hash_key = options_->comparator->PointLookupKey(key);
+    key_hashes_.emplace_back(
+        Hash(hash_key.data(), hash_key.size(), kBlockHashSeed),
+        restarts_.size() - 1);
+  }
 }
 
 }  // namespace leveldb
@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -17,8 +19,14 @@ struct Options;
 // 用于构建index_block/data_block/meta_block的构建
 class BlockBuilder {
  public:
+  // The kind of block being built.  A kDataBlock gets a hash index if
+  // options->data_block_hash_index is set when the block is started, and
+  // a kIndexBlock the fixed-width layout if options->index_format is not
+  // kBlockIndex.
+  enum Type { kMetaBlock, kDataBlock, kIndexBlock };
+
 //  刚刚开始restart的第一个偏移量为0
-  explicit BlockBuilder(const Options* options);
+  explicit BlockBuilder(const Options* options, Type type = kMetaBlock);
 
   BlockBuilder(const BlockBuilder&) = delete;
   BlockBuilder& operator=(const BlockBuilder&) = delete;
@@ -43,7 +51,7 @@ class BlockBuilder {
   size_t CurrentSizeEstimate() const;
 
   // Return true iff no entries have been added since the last Reset()
-  bool empty() const { return buffer_.empty(); }
+  bool empty() const { return buffer_.empty() && key_ends_.empty(); }
 
  private:
 //配置相关的  
@@ -58,6 +66,17 @@ class BlockBuilder {
   bool finished_;                   // Has Finish() been called?
   // 上次记录的key
   std::string last_key_;
+  const Type type_;
+  bool hash_index_;  // Build a hash index for the current block
+  // Hash and restart index of each key, for the hash index
+  std::vector<std::pair<uint32_t, uint32_t>> key_hashes_;
+
+  // With the fixed-width layout, buffer_ holds the keys and values_ the
+  // values, and the entries end at key_ends_ and value_ends_.
+  bool fixed_format_;
+  std::string values_;
+  std::vector<uint32_t> key_ends_;
+  std::vector<uint32_t> value_ends_;
 };
 
 }  // namespace leveldb
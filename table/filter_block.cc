@@ -4,7 +4,8 @@
 
 #include "table/filter_block.h"
 
-#include "leveldb/filter_policy.h"
+#include <algorithm>
+
 #include "util/coding.h"
 
 namespace leveldb {
@@ -111,4 +112,87 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy,
+                                               size_t partition_size)
+    : policy_(policy), partition_size_(partition_size), bytes_per_key_(0) {}
+
+void FullFilterBlockBuilder::StartBlock() {
+  if (partition_size_ == 0 || start_.empty()) {
+    return;
+  }
+  if (bytes_per_key_ == 0) {
+    // Estimate the filter size per key from the keys of the first block.
+    std::string sample;
+    tmp_keys_.resize(start_.size());
+    for (size_t i = 0; i < start_.size(); i++) {
+      size_t limit = (i + 1 < start_.size()) ? start_[i + 1] : keys_.size();
+      tmp_keys_[i] = Slice(keys_.data() + start_[i], limit - start_[i]);
+    }
+    policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(start_.size()),
+                          &sample);
+    tmp_keys_.clear();
+    bytes_per_key_ = std::max(1.0, static_cast<double>(sample.size())) /
+                     static_cast<double>(start_.size());
+  }
+  if (start_.size() * bytes_per_key_ >= partition_size_) {
+    GeneratePartition();
+  }
+}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+  if (partition_size_ > 0) {
+    last_key_.assign(key.data(), key.size());
+  }
+}
+
+const std::vector<FullFilterBlockBuilder::Partition>&
+FullFilterBlockBuilder::Finish() {
+  if (!start_.empty() || (partition_size_ == 0 && partitions_.empty())) {
+    GeneratePartition();
+  }
+  return partitions_;
+}
+
+void FullFilterBlockBuilder::GeneratePartition() {
+  const size_t num_keys = start_.size();
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    tmp_keys_[i] = Slice(keys_.data() + start_[i], start_[i + 1] - start_[i]);
+  }
+
+  partitions_.emplace_back();
+  Partition* partition = &partitions_.back();
+  policy_->CreateFilter(tmp_keys_.data(), static_cast<int>(num_keys),
+                        &partition->filter);
+  partition->last_key.swap(last_key_);
+  if (num_keys > 0) {
+    bytes_per_key_ = static_cast<double>(partition->filter.size()) / num_keys;
+  }
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+}
+
+std::string FilterMetaKey(FilterFormat format, const FilterPolicy* policy) {
+  std::string key;
+  switch (format) {
+    case kFullFilter:
+      key = "fullfilter.";
+      break;
+    case kPartitionedFilter:
+      key = "partitionedfilter.";
+      break;
+    case kBlockBasedFilter:
+    default:
+      key = "filter.";
+      break;
+  }
+  key.append(policy->Name());
+  return key;
+}
+
 }  // namespace leveldb
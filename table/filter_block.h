@@ -4,7 +4,9 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block.  Depending on Options::filter_format, the
+// filters cover 2KB ranges of file offsets (FilterBlockBuilder) or ranges
+// of keys (FullFilterBlockBuilder).
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -14,13 +16,13 @@
 #include <string>
 #include <vector>
 
+#include "leveldb/filter_policy.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
 namespace leveldb {
 
-class FilterPolicy;
-
 // A FilterBlockBuilder is used to construct all of the filters for a
 // particular Table.  It generates a single string which is stored as
 // a special block in the Table.
@@ -68,6 +70,70 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+// A FullFilterBlockBuilder builds filters over ranges of keys rather than
+// ranges of file offsets, so a lookup needs no data block handle to find
+// its filter.  With a "partition_size" of zero it builds a single filter
+// for all keys of the table.  Otherwise the keys are split, at data block
+// boundaries, into partitions whose filters are about "partition_size"
+// bytes each.  The caller stores the partitions and indexes them by their
+// last keys.
+//
+// The sequence of calls to FullFilterBlockBuilder must match the regexp:
+//      (AddKey* StartBlock)* AddKey* Finish
+class FullFilterBlockBuilder {
+ public:
+  struct Partition {
+    std::string filter;
+    std::string last_key;  // Largest key added to the filter
+  };
+
+  FullFilterBlockBuilder(const FilterPolicy*, size_t partition_size);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  // Called after the keys of each data block have been added.
+  void StartBlock();
+  void AddKey(const Slice& key);
+
+  // Returns the filters.  Without partitioning there is exactly one;
+  // otherwise there is one per partition, in key order, and none if no
+  // key was added.
+  const std::vector<Partition>& Finish();
+
+ private:
+  void GeneratePartition();
+
+  const FilterPolicy* policy_;
+  const size_t partition_size_;
+  std::string keys_;             // Flattened key contents
+  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string last_key_;         // Last key added
+  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+  double bytes_per_key_;         // Filter size estimate; 0 until known
+  std::vector<Partition> partitions_;
+};
+
+// Reads a single filter made by FullFilterBlockBuilder.
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents)
+      : policy_(policy), contents_(contents) {}
+
+  bool KeyMayMatch(const Slice& key) const {
+    return policy_->KeyMayMatch(key, contents_);
+  }
+
+ private:
+  const FilterPolicy* policy_;
+  const Slice contents_;
+};
+
+// Returns the metaindex key under which a table stores the filters of
+// "policy" in the given format.
+std::string FilterMetaKey(FilterFormat format, const FilterPolicy* policy);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
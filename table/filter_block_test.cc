@@ -119,4 +119,76 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, FullFilterEmptyBuilder) {
+  FullFilterBlockBuilder builder(&policy_, 0);
+  const std::vector<FullFilterBlockBuilder::Partition>& partitions =
+      builder.Finish();
+  ASSERT_EQ(1, partitions.size());
+  FullFilterBlockReader reader(&policy_, partitions[0].filter);
+  ASSERT_TRUE(!reader.KeyMayMatch("foo"));
+}
+
+TEST_F(FilterBlockTest, FullFilter) {
+  FullFilterBlockBuilder builder(&policy_, 0);
+  builder.AddKey("bar");
+  builder.AddKey("box");
+  builder.StartBlock();
+  builder.AddKey("foo");
+  builder.StartBlock();
+  builder.AddKey("hello");
+  const std::vector<FullFilterBlockBuilder::Partition>& partitions =
+      builder.Finish();
+  ASSERT_EQ(1, partitions.size());
+  FullFilterBlockReader reader(&policy_, partitions[0].filter);
+  ASSERT_TRUE(reader.KeyMayMatch("bar"));
+  ASSERT_TRUE(reader.KeyMayMatch("box"));
+  ASSERT_TRUE(reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(reader.KeyMayMatch("hello"));
+  ASSERT_TRUE(!reader.KeyMayMatch("missing"));
+  ASSERT_TRUE(!reader.KeyMayMatch("other"));
+}
+
+TEST_F(FilterBlockTest, PartitionedFilterEmptyBuilder) {
+  FullFilterBlockBuilder builder(&policy_, 8);
+  ASSERT_TRUE(builder.Finish().empty());
+}
+
+TEST_F(FilterBlockTest, PartitionedFilter) {
+  // TestHashFilter uses 4 bytes per key, so partitions close at block
+  // boundaries once they hold two keys.
+  FullFilterBlockBuilder builder(&policy_, 8);
+  builder.AddKey("a");
+  builder.StartBlock();
+  builder.AddKey("b");
+  builder.StartBlock();
+  builder.AddKey("c");
+  builder.AddKey("d");
+  builder.AddKey("e");
+  builder.StartBlock();
+  builder.AddKey("f");
+  const std::vector<FullFilterBlockBuilder::Partition>& partitions =
+      builder.Finish();
+
+  ASSERT_EQ(3, partitions.size());
+  ASSERT_EQ("b", partitions[0].last_key);
+  ASSERT_EQ("e", partitions[1].last_key);
+  ASSERT_EQ("f", partitions[2].last_key);
+
+  FullFilterBlockReader first(&policy_, partitions[0].filter);
+  ASSERT_TRUE(first.KeyMayMatch("a"));
+  ASSERT_TRUE(first.KeyMayMatch("b"));
+  ASSERT_TRUE(!first.KeyMayMatch("c"));
+
+  FullFilterBlockReader second(&policy_, partitions[1].filter);
+  ASSERT_TRUE(second.KeyMayMatch("c"));
+  ASSERT_TRUE(second.KeyMayMatch("d"));
+  ASSERT_TRUE(second.KeyMayMatch("e"));
+  ASSERT_TRUE(!second.KeyMayMatch("b"));
+  ASSERT_TRUE(!second.KeyMayMatch("f"));
+
+  FullFilterBlockReader last(&policy_, partitions[2].filter);
+  ASSERT_TRUE(last.KeyMayMatch("f"));
+  ASSERT_TRUE(!last.KeyMayMatch("a"));
+}
+
 }  // namespace leveldb
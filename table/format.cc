@@ -4,7 +4,11 @@
 
 #include "table/format.h"
 
+#include <cstring>
+#include <vector>
+
 #include "leveldb/env.h"
+#include "leveldb/secondary_cache.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
@@ -62,24 +66,14 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
-  // 获取block的大小
+// Checks and uncompresses the block that a read of "handle" placed in
+// "contents", using "buf" as the scratch space the read was given.  Takes
+// ownership of "buf".
+static Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                          char* buf, const Slice& contents,
+                          const port::ZstdUncompressDict* dict,
+                          BlockContents* result) {
   size_t n = static_cast<size_t>(handle.size());
-  // 读取的数据为block加上固定5字节
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
@@ -93,7 +87,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
+      Status s = Status::Corruption("block checksum mismatch");
       return s;
     }
   }
@@ -116,14 +110,33 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
 
       // Ok
       break;
-    case kSnappyCompression: {
+    case kSnappyCompression:
+    case kZstdCompression:
+    case kLZ4Compression: {
+      const CompressionType type = static_cast<CompressionType>(data[n]);
       size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+      bool ok;
+      if (type == kSnappyCompression) {
+        ok = port::Snappy_GetUncompressedLength(data, n, &ulength);
+      } else if (type == kZstdCompression) {
+        ok = port::Zstd_GetUncompressedLength(data, n, &ulength);
+      } else {
+        ok = port::LZ4_GetUncompressedLength(data, n, &ulength);
+      }
+      if (!ok) {
         delete[] buf;
         return Status::Corruption("corrupted compressed block contents");
       }
       char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+      if (type == kSnappyCompression) {
+        ok = port::Snappy_Uncompress(data, n, ubuf);
+      } else if (type == kZstdCompression) {
+        ok = (dict != nullptr) ? dict->Uncompress(data, n, ubuf)
+                               : port::Zstd_Uncompress(data, n, ubuf);
+      } else {
+        ok = port::LZ4_Uncompress(data, n, ubuf);
+      }
+      if (!ok) {
         delete[] buf;
         delete[] ubuf;
         return Status::Corruption("corrupted compressed block contents");
@@ -142,4 +155,125 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+static std::string SecondaryCacheKey(uint64_t id, const BlockHandle& handle) {
+  char buf[16];
+  EncodeFixed64(buf, id);
+  EncodeFixed64(buf + 8, handle.offset());
+  return std::string(buf, sizeof(buf));
+}
+
+// If "secondary_cache" holds the block of "handle", copies it into a new
+// buffer and stores it in *buf and *contents.
+static bool LookupSecondaryCache(SecondaryCache* secondary_cache,
+                                 const std::string& key, char** buf,
+                                 Slice* contents) {
+  std::string value;
+  if (!secondary_cache->Lookup(key, &value)) {
+    return false;
+  }
+  *buf = new char[value.size()];
+  std::memcpy(*buf, value.data(), value.size());
+  *contents = Slice(*buf, value.size());
+  return true;
+}
+
+// Stores a block that a read placed in "contents" in "secondary_cache".
+// Blocks that the file returned from its own memory, e.g. a memory-mapped
+// file, are as cheap to read again and are skipped.
+static void InsertSecondaryCache(SecondaryCache* secondary_cache,
+                                 const std::string& key,
+                                 const BlockHandle& handle, const char* buf,
+                                 const Slice& contents) {
+  if (contents.data() == buf &&
+      contents.size() == handle.size() + kBlockTrailerSize) {
+    secondary_cache->Insert(key, contents);
+  }
+}
+
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result,
+                 const port::ZstdUncompressDict* dict,
+                 SecondaryCache* secondary_cache,
+                 uint64_t secondary_cache_id) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  char* buf;
+  Slice contents;
+  std::string key;
+  if (secondary_cache != nullptr) {
+    key = SecondaryCacheKey(secondary_cache_id, handle);
+    if (LookupSecondaryCache(secondary_cache, key, &buf, &contents)) {
+      return DecodeBlock(options, handle, buf, contents, dict, result);
+    }
+  }
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  // 获取block的大小
+  size_t n = static_cast<size_t>(handle.size());
+  // 读取的数据为block加上固定5字节
+  buf = new char[n + kBlockTrailerSize];
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  if (secondary_cache != nullptr && options.fill_cache) {
+    InsertSecondaryCache(secondary_cache, key, handle, buf, contents);
+  }
+  return DecodeBlock(options, handle, buf, contents, dict, result);
+}
+
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                const BlockHandle* handles, size_t n, BlockContents* results,
+                Status* statuses, const port::ZstdUncompressDict* dict,
+                SecondaryCache* secondary_cache, uint64_t secondary_cache_id) {
+  std::vector<std::string> keys;
+  std::vector<size_t> missing;  // Indexes of the blocks to read
+  std::vector<ReadRequest> reqs;
+  missing.reserve(n);
+  reqs.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    results[i].data = Slice();
+    results[i].cachable = false;
+    results[i].heap_allocated = false;
+    if (secondary_cache != nullptr) {
+      keys.push_back(SecondaryCacheKey(secondary_cache_id, handles[i]));
+      char* buf;
+      Slice contents;
+      if (LookupSecondaryCache(secondary_cache, keys[i], &buf, &contents)) {
+        statuses[i] =
+            DecodeBlock(options, handles[i], buf, contents, dict, &results[i]);
+        continue;
+      }
+    }
+    ReadRequest req;
+    req.offset = handles[i].offset();
+    req.n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    req.scratch = new char[req.n];
+    reqs.push_back(req);
+    missing.push_back(i);
+  }
+  if (reqs.empty()) {
+    return;
+  }
+  file->MultiRead(reqs.data(), reqs.size());
+  for (size_t j = 0; j < reqs.size(); j++) {
+    const size_t i = missing[j];
+    if (!reqs[j].status.ok()) {
+      delete[] reqs[j].scratch;
+      statuses[i] = reqs[j].status;
+    } else {
+      if (secondary_cache != nullptr && options.fill_cache) {
+        InsertSecondaryCache(secondary_cache, keys[i], handles[i],
+                             reqs[j].scratch, reqs[j].result);
+      }
+      statuses[i] = DecodeBlock(options, handles[i], reqs[j].scratch,
+                                reqs[j].result, dict, &results[i]);
+    }
+  }
+}
+
 }  // namespace leveldb
@@ -11,11 +11,13 @@
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "leveldb/table_builder.h"
+#include "port/port.h"
 
 namespace leveldb {
 
 class Block;
 class RandomAccessFile;
+class SecondaryCache;
 struct ReadOptions;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
@@ -91,6 +93,30 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the block written by TableBuilder::AddRangeTombstone()
+static const char kRangeDelBlockName[] = "leveldb.rangedel";
+
+// Metaindex key of the zstd dictionary of the data blocks of a table
+// (see Options::zstd_max_dict_bytes)
+static const char kZstdDictBlockName[] = "leveldb.zstd.dict";
+
+// Data blocks built with Options::data_block_hash_index end with a hash
+// index of their keys (see block_builder.cc), flagged by the top bit of
+// their restart count.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kBlockHashNoEntry = 255;
+static const uint8_t kBlockHashCollision = 254;
+static const uint32_t kBlockHashSeed = 0x5d7e1a03;
+
+// Index blocks built with Options::index_format other than kBlockIndex
+// store their keys and values with fixed-width offsets (see
+// block_builder.cc), flagged by this bit of their trailing entry count.
+static const uint32_t kBlockFixedFormatFlag = 1u << 30;
+
+// Metaindex entry of the tables built with kPartitionedIndex.  Its handle
+// spans the index partitions; the footer points at the top-level index.
+static const char kIndexPartitionsName[] = "leveldb.index.partitions";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -98,9 +124,29 @@ struct BlockContents {
 };
 
 // Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// return non-OK.  On success fill *result and return OK.  A zstd
+// compressed block is uncompressed with "dict" if it is non-null.
+//
+// If "secondary_cache" is non-null, the block is first looked up in it
+// under a key made of "secondary_cache_id" and the block offset, and a
+// block read from "file" into heap memory is stored in it if
+// options.fill_cache is true.
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result);
+                 const BlockHandle& handle, BlockContents* result,
+                 const port::ZstdUncompressDict* dict = nullptr,
+                 SecondaryCache* secondary_cache = nullptr,
+                 uint64_t secondary_cache_id = 0);
+
+// Read the blocks identified by "handles[0..n-1]" from "file" with a single
+// RandomAccessFile::MultiRead() call.  For each block, stores what
+// ReadBlock() would have produced in results[i] and statuses[i].  Blocks
+// found in "secondary_cache" are not read.
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                const BlockHandle* handles, size_t n, BlockContents* results,
+                Status* statuses,
+                const port::ZstdUncompressDict* dict = nullptr,
+                SecondaryCache* secondary_cache = nullptr,
+                uint64_t secondary_cache_id = 0);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -6,36 +6,18 @@
 
 namespace leveldb {
 
-Iterator::Iterator() {
-  cleanup_head_.function = nullptr;
-  cleanup_head_.next = nullptr;
-}
+Iterator::Iterator() = default;
 
-Iterator::~Iterator() {
-  if (!cleanup_head_.IsEmpty()) {
-    cleanup_head_.Run();
-    for (CleanupNode* node = cleanup_head_.next; node != nullptr;) {
-      node->Run();
-      CleanupNode* next_node = node->next;
-      delete node;
-      node = next_node;
-    }
-  }
-}
+Iterator::~Iterator() = default;
 
-void Iterator::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
-  assert(func != nullptr);
-  CleanupNode* node;
-  if (cleanup_head_.IsEmpty()) {
-    node = &cleanup_head_;
-  } else {
-    node = new CleanupNode();
-    node->next = cleanup_head_.next;
-    cleanup_head_.next = node;
+int Iterator::NextBatch(int n, IteratorBatch* batch) {
+  int count = 0;
+  while (count < n && Valid()) {
+    batch->Add(key(), value());
+    Next();
+    count++;
   }
-  node->function = func;
-  node->arg1 = arg1;
-  node->arg2 = arg2;
+  return count;
 }
 
 namespace {
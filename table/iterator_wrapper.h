@@ -58,6 +58,12 @@ class IteratorWrapper {
     iter_->Prev();
     Update();
   }
+  int NextBatch(int n, IteratorBatch* batch) {
+    assert(iter_);
+    const int count = iter_->NextBatch(n, batch);
+    Update();
+    return count;
+  }
   void Seek(const Slice& k) {
     assert(iter_);
     iter_->Seek(k);
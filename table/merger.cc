@@ -11,12 +11,19 @@
 namespace leveldb {
 
 namespace {
+// Merges the children with a binary heap of the valid children, ordered so
+// that the child holding key() is at the root: smallest key first while
+// moving forward, largest key first while moving backward.  Advancing
+// current_ only has to sift the root down, so each step costs O(log n)
+// comparisons instead of the O(n) of a linear scan over all children.
 class MergingIterator : public Iterator {
  public:
   MergingIterator(const Comparator* comparator, Iterator** children, int n)
       : comparator_(comparator),
         children_(new IteratorWrapper[n]),
         n_(n),
+        heap_(new IteratorWrapper*[n]),
+        heap_size_(0),
         current_(nullptr),
         direction_(kForward) {
     for (int i = 0; i < n; i++) {
@@ -24,7 +31,10 @@ class MergingIterator : public Iterator {
     }
   }
 
-  ~MergingIterator() override { delete[] children_; }
+  ~MergingIterator() override {
+    delete[] heap_;
+    delete[] children_;
+  }
 
   bool Valid() const override { return (current_ != nullptr); }
 
@@ -32,24 +42,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void Next() override {
@@ -59,7 +69,8 @@ class MergingIterator : public Iterator {
     // If we are moving in the forward direction, it is already
     // true for all of the non-current_ children since current_ is
     // the smallest child and key() == current_->key().  Otherwise,
-    // we explicitly position the non-current_ children.
+    // we explicitly position the non-current_ children and rebuild
+    // the heap in the new order.
     if (direction_ != kForward) {
       for (int i = 0; i < n_; i++) {
         IteratorWrapper* child = &children_[i];
@@ -72,10 +83,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      BuildHeap();
+    } else {
+      current_->Next();
+      UpdateTop();
     }
-
-    current_->Next();
-    FindSmallest();
   }
 
   void Prev() override {
@@ -85,7 +98,8 @@ class MergingIterator : public Iterator {
     // If we are moving in the reverse direction, it is already
     // true for all of the non-current_ children since current_ is
     // the largest child and key() == current_->key().  Otherwise,
-    // we explicitly position the non-current_ children.
+    // we explicitly position the non-current_ children and rebuild
+    // the heap in the new order.
     if (direction_ != kReverse) {
       for (int i = 0; i < n_; i++) {
         IteratorWrapper* child = &children_[i];
@@ -101,10 +115,34 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      BuildHeap();
+    } else {
+      current_->Prev();
+      UpdateTop();
     }
+  }
 
-    current_->Prev();
-    FindLargest();
+  int NextBatch(int n, IteratorBatch* batch) override {
+    int count = 0;
+    if (count < n && Valid() && direction_ != kForward) {
+      batch->Add(key(), value());
+      Next();
+      count++;
+    }
+    while (count < n && Valid()) {
+      if (heap_size_ == 1) {
+        // Only one child is left, so its entries can be copied in a run.
+        count += current_->NextBatch(n - count, batch);
+        UpdateTop();
+      } else {
+        batch->Add(current_->key(), current_->value());
+        current_->Next();
+        UpdateTop();
+        count++;
+      }
+    }
+    return count;
   }
 
   Slice key() const override {
@@ -132,47 +170,80 @@ class MergingIterator : public Iterator {
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // Returns true if "a" must be visited before "b" in the current
+  // direction.  Equal keys are visited in child order when moving forward
+  // and in reverse child order when moving backward.
+  bool Before(IteratorWrapper* a, IteratorWrapper* b) const {
+    const int r = comparator_->Compare(a->key(), b->key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  // Restores the heap order below heap_[pos].
+  void SiftDown(int pos);
+
+  // Rebuilds the heap from the valid children.
+  void BuildHeap();
+
+  // Restores the heap after the root child was moved, removing it if it
+  // is no longer valid.
+  void UpdateTop();
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
+  IteratorWrapper** heap_;  // Valid children, heap_[0] == current_
+  int heap_size_;
   IteratorWrapper* current_;
   Direction direction_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
-  for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+void MergingIterator::SiftDown(int pos) {
+  IteratorWrapper* const item = heap_[pos];
+  while (true) {
+    int child = 2 * pos + 1;
+    if (child >= heap_size_) {
+      break;
+    }
+    if (child + 1 < heap_size_ && Before(heap_[child + 1], heap_[child])) {
+      child++;
+    }
+    if (!Before(heap_[child], item)) {
+      break;
     }
+    heap_[pos] = heap_[child];
+    pos = child;
   }
-  current_ = smallest;
+  heap_[pos] = item;
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::BuildHeap() {
+  heap_size_ = 0;
+  for (int i = 0; i < n_; i++) {
+    if (children_[i].Valid()) {
+      heap_[heap_size_++] = &children_[i];
     }
   }
-  current_ = largest;
+  for (int i = heap_size_ / 2 - 1; i >= 0; i--) {
+    SiftDown(i);
+  }
+  current_ = (heap_size_ > 0) ? heap_[0] : nullptr;
+}
+
+void MergingIterator::UpdateTop() {
+  assert(heap_size_ > 0 && heap_[0] == current_);
+  if (!current_->Valid()) {
+    heap_[0] = heap_[--heap_size_];
+  }
+  if (heap_size_ > 0) {
+    SiftDown(0);
+    current_ = heap_[0];
+  } else {
+    current_ = nullptr;
+  }
 }
 }  // namespace
 
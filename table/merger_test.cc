@@ -0,0 +1,203 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+typedef std::vector<std::pair<std::string, std::string>> KVList;
+
+// Iterates over a sorted list of key/value pairs.
+class KVListIterator : public Iterator {
+ public:
+  explicit KVListIterator(const KVList* list)
+      : list_(list), pos_(list->size()) {}
+
+  bool Valid() const override { return pos_ < list_->size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = list_->empty() ? list_->size() : list_->size() - 1;
+  }
+  void Seek(const Slice& target) override {
+    pos_ = 0;
+    while (pos_ < list_->size() &&
+           Slice((*list_)[pos_].first).compare(target) < 0) {
+      pos_++;
+    }
+  }
+  void Next() override { pos_++; }
+  void Prev() override { pos_ = (pos_ == 0) ? list_->size() : pos_ - 1; }
+  Slice key() const override { return (*list_)[pos_].first; }
+  Slice value() const override { return (*list_)[pos_].second; }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const KVList* const list_;
+  size_t pos_;
+};
+
+class MergerTest : public testing::Test {
+ public:
+  // Spreads "num_keys" random keys over "n" children, with the child index
+  // as their value.  If "duplicates" is set, some keys are present in
+  // several children.
+  void Build(int n, int num_keys, bool duplicates, Random* rnd) {
+    lists_.assign(n, KVList());
+    model_.clear();
+    std::set<std::string> keys;
+    for (int i = 0; i < num_keys; i++) {
+      std::string key = test::RandomKey(rnd, 1 + rnd->Uniform(4));
+      if (!keys.insert(key).second && !duplicates) {
+        continue;
+      }
+      const int copies = (duplicates && rnd->OneIn(4)) ? 2 : 1;
+      for (int c = 0; c < copies; c++) {
+        const int child = rnd->Uniform(n);
+        lists_[child].emplace_back(key, std::to_string(child));
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      KVList* list = &lists_[i];
+      std::sort(list->begin(), list->end());
+      list->erase(std::unique(list->begin(), list->end()), list->end());
+      model_.insert(model_.end(), list->begin(), list->end());
+    }
+    // Equal keys are yielded in child order, which is their value order.
+    std::sort(model_.begin(), model_.end(),
+              [](const KVList::value_type& a, const KVList::value_type& b) {
+                if (a.first != b.first) return a.first < b.first;
+                return std::stoi(a.second) < std::stoi(b.second);
+              });
+  }
+
+  Iterator* NewIterator() {
+    std::vector<Iterator*> children;
+    for (const KVList& list : lists_) {
+      children.push_back(new KVListIterator(&list));
+    }
+    return NewMergingIterator(BytewiseComparator(), children.data(),
+                              children.size());
+  }
+
+  std::string ToString(const Iterator* iter) {
+    if (!iter->Valid()) {
+      return "END";
+    }
+    return iter->key().ToString() + "->" + iter->value().ToString();
+  }
+
+  std::string ToString(int pos) {
+    if (pos < 0 || pos >= static_cast<int>(model_.size())) {
+      return "END";
+    }
+    return model_[pos].first + "->" + model_[pos].second;
+  }
+
+  std::vector<KVList> lists_;
+  KVList model_;
+};
+
+TEST_F(MergerTest, Empty) {
+  for (int n = 0; n < 3; n++) {
+    lists_.assign(n, KVList());
+    Iterator* iter = NewIterator();
+    iter->SeekToFirst();
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToLast();
+    ASSERT_TRUE(!iter->Valid());
+    iter->Seek("a");
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+  }
+}
+
+TEST_F(MergerTest, Scans) {
+  Random rnd(301);
+  for (int n : {2, 3, 7, 64}) {
+    Build(n, 50 * n, true, &rnd);
+    Iterator* iter = NewIterator();
+
+    iter->SeekToFirst();
+    for (size_t i = 0; i < model_.size(); i++) {
+      ASSERT_EQ(ToString(i), ToString(iter)) << n;
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+
+    iter->SeekToLast();
+    for (int i = model_.size() - 1; i >= 0; i--) {
+      ASSERT_EQ(ToString(i), ToString(iter)) << n;
+      iter->Prev();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+  }
+}
+
+TEST_F(MergerTest, RandomWalk) {
+  Random rnd(test::RandomSeed());
+  for (int n : {2, 5, 16, 64}) {
+    // Switching direction skips the other copies of key(), so only
+    // distinct keys can be compared against the model.
+    Build(n, 20 * n, false, &rnd);
+    Iterator* iter = NewIterator();
+    int pos = model_.size();
+    for (int step = 0; step < 2000; step++) {
+      if (pos < static_cast<int>(model_.size())) {
+        ASSERT_EQ(ToString(pos), ToString(iter)) << n << " " << step;
+      } else {
+        ASSERT_TRUE(!iter->Valid());
+      }
+      switch (rnd.Uniform(6)) {
+        case 0:
+          iter->SeekToFirst();
+          pos = 0;
+          break;
+        case 1:
+          iter->SeekToLast();
+          pos = model_.size() - 1;
+          break;
+        case 2: {
+          std::string target = test::RandomKey(&rnd, 1 + rnd.Uniform(4));
+          iter->Seek(target);
+          pos = std::lower_bound(model_.begin(), model_.end(),
+                                 std::make_pair(target, std::string())) -
+                model_.begin();
+          break;
+        }
+        case 3:
+        case 4:
+          if (iter->Valid()) {
+            iter->Next();
+            pos++;
+          }
+          break;
+        case 5:
+          if (iter->Valid()) {
+            iter->Prev();
+            pos--;
+          }
+          break;
+      }
+      if (pos < 0) {
+        pos = model_.size();
+      }
+    }
+    delete iter;
+  }
+}
+
+}  // namespace leveldb
@@ -4,11 +4,14 @@
 
 #include "leveldb/table.h"
 
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/secondary_cache.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -20,19 +23,42 @@ namespace leveldb {
 struct Table::Rep {
   ~Rep() {
     delete filter;
+    delete full_filter;
     delete[] filter_data;
+    delete filter_index_block;
     delete index_block;
+    delete range_del_block;
+    delete compression_dict;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  uint64_t secondary_cache_id;
+  const FilterPolicy* filter_policy;  // Policy that built the filters
+  // At most one of filter, full_filter and filter_index_block is set,
+  // depending on the format of the table's filters.
   FilterBlockReader* filter;
-  const char* filter_data;
+  FullFilterBlockReader* full_filter;
+  const char* filter_data;  // Data of filter or full_filter, if owned
+  Block* filter_index_block;  // Locations of partitioned filters
+  // With cache_index_and_filter_blocks, the index block and the filter
+  // are left null above and kept in the block cache instead.
+  bool index_in_cache;
+  bool filter_in_cache;
+  BlockHandle index_handle;
+  BlockHandle filter_handle;
+  FilterFormat filter_format;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  // With kPartitionedIndex, index_block is the top-level index, whose
+  // entries point at the index partitions.
+  bool index_partitioned;
+  Block* range_del_block;  // nullptr if the table has no range tombstones
+  // Dictionary of the zstd compressed data blocks, or nullptr
+  port::ZstdUncompressDict* compression_dict;
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -46,7 +72,7 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   char footer_space[Footer::kEncodedLength];
   Slice footer_input;
   Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
-                        &footer_i nput, footer_space);
+                        &footer_input, footer_space);
   if (!s.ok()) return s;
 
   Footer footer;
@@ -65,52 +91,100 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   if (s.ok()) {
     // We've successfully read the footer and the index block: we're
     // ready to serve requests.
-    Block* index_block = new Block(index_block_contents);
     Rep* rep = new Table::Rep;
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
+    rep->index_block = nullptr;
+    rep->index_partitioned = false;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->secondary_cache_id =
+        (options.secondary_cache ? options.secondary_cache->NewId() : 0);
     rep->filter_data = nullptr;
+    rep->filter_policy = nullptr;
     rep->filter = nullptr;
+    rep->full_filter = nullptr;
+    rep->filter_index_block = nullptr;
+    rep->index_in_cache = false;
+    rep->filter_in_cache = false;
+    rep->index_handle = footer.index_handle();
+    rep->filter_format = kFullFilter;
+    rep->range_del_block = nullptr;
+    rep->compression_dict = nullptr;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    rep->index_in_cache = (*table)->CacheMetaBlock(
+        footer.index_handle(), index_block_contents, /*parse=*/true);
+    if (!rep->index_in_cache) {
+      rep->index_block = new Block(index_block_contents);
+    }
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
+Status Table::ReadMeta(const Footer& footer) {
+  // An empty block holds just one restart point and the restart count.
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return Status::OK();  // No metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // Propagate errors: without the metaindex we cannot tell whether the
+    // table holds range tombstones, and ignoring them would resurrect
+    // deleted keys.
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  // Tables hold filters of the policy and in the format that were
+  // configured for their level when they were written.
+  std::vector<const FilterPolicy*> policies =
+      rep_->options.filter_policy_per_level;
+  policies.insert(policies.begin(), rep_->options.filter_policy);
+  for (const FilterPolicy* policy : policies) {
+    if (policy == nullptr || rep_->filter_policy != nullptr) continue;
+    for (FilterFormat format :
+         {kFullFilter, kPartitionedFilter, kBlockBasedFilter}) {
+      std::string key = FilterMetaKey(format, policy);
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        rep_->filter_policy = policy;
+        ReadFilter(format, iter->value());
+        break;
+      }
+    }
+  }
+  iter->Seek(kIndexPartitionsName);
+  rep_->index_partitioned =
+      iter->Valid() && iter->key() == Slice(kIndexPartitionsName);
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    s = ReadRangeDelBlock(iter->value());
+  }
+  if (s.ok()) {
+    iter->Seek(kZstdDictBlockName);
+    if (iter->Valid() && iter->key() == Slice(kZstdDictBlockName)) {
+      s = ReadCompressionDict(iter->value());
+    }
   }
   delete iter;
   delete meta;
+  return s;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(FilterFormat format, const Slice& filter_handle_value) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -127,10 +201,70 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
+  rep_->filter_handle = filter_handle;
+  rep_->filter_format = format;
+  rep_->filter_in_cache = CacheMetaBlock(
+      filter_handle, block, /*parse=*/format == kPartitionedFilter);
+  if (rep_->filter_in_cache) {
+    return;
+  }
+  if (format == kPartitionedFilter) {
+    rep_->filter_index_block = new Block(block);
+    return;
+  }
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  if (format == kFullFilter) {
+    rep_->full_filter =
+        new FullFilterBlockReader(rep_->filter_policy, block.data);
+  } else {
+    rep_->filter =
+        new FilterBlockReader(rep_->filter_policy, block.data);
+  }
+}
+
+Status Table::ReadRangeDelBlock(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
+  }
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, handle, &block);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(block);
+  }
+  return s;
+}
+
+Status Table::ReadCompressionDict(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
+  }
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, handle, &block);
+  if (s.ok()) {
+    // Digest the dictionary once, rather than for every block read.
+    rep_->compression_dict =
+        new port::ZstdUncompressDict(block.data.data(), block.data.size());
+    if (block.heap_allocated) {
+      delete[] block.data.data();
+    }
+  }
+  return s;
 }
 
 Table::~Table() { delete rep_; }
@@ -144,20 +278,182 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+static void DeleteCachedBlockContents(const Slice& key, void* value) {
+  BlockContents* contents = reinterpret_cast<BlockContents*>(value);
+  if (contents->heap_allocated) {
+    delete[] contents->data.data();
+  }
+  delete contents;
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+Cache::Handle* Table::InsertMetaBlock(const BlockHandle& handle,
+                                      const BlockContents& contents,
+                                      bool parse) const {
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (parse) {
+    Block* block = new Block(contents);
+    return block_cache->InsertWithPriority(key, block, block->size(),
+                                           &DeleteCachedBlock,
+                                           Cache::Priority::kHigh);
+  }
+  BlockContents* copy = new BlockContents(contents);
+  return block_cache->InsertWithPriority(key, copy, copy->data.size(),
+                                         &DeleteCachedBlockContents,
+                                         Cache::Priority::kHigh);
+}
+
+bool Table::CacheMetaBlock(const BlockHandle& handle,
+                           const BlockContents& contents, bool parse) const {
+  if (!rep_->options.cache_index_and_filter_blocks ||
+      rep_->options.block_cache == nullptr || !contents.cachable) {
+    return false;
+  }
+  rep_->options.block_cache->Release(InsertMetaBlock(handle, contents, parse));
+  return true;
+}
+
+Status Table::LookupMetaBlock(const ReadOptions& options,
+                              const BlockHandle& handle, bool parse,
+                              Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  *cache_handle =
+      block_cache->Lookup(Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+  if (*cache_handle != nullptr) {
+    return Status::OK();
+  }
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, options, handle, &contents);
+  if (s.ok()) {
+    *cache_handle = InsertMetaBlock(handle, contents, parse);
+  }
+  return s;
+}
+
+Iterator* Table::NewMetaBlockIterator(const ReadOptions& options, Block* block,
+                                      const BlockHandle& handle) const {
+  if (block != nullptr) {
+    return block->NewIterator(rep_->options.comparator);
+  }
+  Cache::Handle* cache_handle;
+  Status s = LookupMetaBlock(options, handle, /*parse=*/true, &cache_handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Cache* block_cache = rep_->options.block_cache;
+  Iterator* iter = reinterpret_cast<Block*>(block_cache->Value(cache_handle))
+                       ->NewIterator(rep_->options.comparator);
+  iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  return iter;
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter =
+      NewMetaBlockIterator(options, rep_->index_block, rep_->index_handle);
+  if (!rep_->index_partitioned) {
+    return iter;
+  }
+  return NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                             const_cast<Table*>(this), options);
+}
+
+// Convert an entry of the top-level index into an iterator over the index
+// partition it points at.  Partitions are kept in the block cache, if any,
+// like the partitions of partitioned filters.
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Cache* block_cache = table->rep_->options.block_cache;
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Cache::Handle* cache_handle = nullptr;
+  char cache_key_buffer[16];
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != nullptr) {
+    EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    cache_handle = block_cache->Lookup(cache_key);
+  }
+  if (cache_handle == nullptr) {
+    BlockContents contents;
+    s = ReadBlock(table->rep_->file, options, handle, &contents);
+    if (!s.ok()) {
+      return NewErrorIterator(s);
+    }
+    Block* block = new Block(contents);
+    if (block_cache == nullptr || !contents.cachable || !options.fill_cache) {
+      Iterator* iter = block->NewIterator(table->rep_->options.comparator);
+      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+      return iter;
+    }
+    const Cache::Priority priority =
+        table->rep_->options.cache_index_and_filter_blocks
+            ? Cache::Priority::kHigh
+            : Cache::Priority::kLow;
+    cache_handle = block_cache->InsertWithPriority(
+        cache_key, block, block->size(), &DeleteCachedBlock, priority);
+  }
+  Iterator* iter = reinterpret_cast<Block*>(block_cache->Value(cache_handle))
+                       ->NewIterator(table->rep_->options.comparator);
+  iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  return iter;
+}
+
+bool Table::BlockFilterMayMatch(const ReadOptions& options,
+                                uint64_t block_offset, const Slice& key) {
+  if (rep_->filter != nullptr) {
+    return rep_->filter->KeyMayMatch(block_offset, key);
+  }
+  if (!rep_->filter_in_cache || rep_->filter_format != kBlockBasedFilter) {
+    return true;
+  }
+  Cache::Handle* cache_handle;
+  if (!LookupMetaBlock(options, rep_->filter_handle, /*parse=*/false,
+                       &cache_handle)
+           .ok()) {
+    return true;  // Errors are treated as potential matches
+  }
+  Cache* block_cache = rep_->options.block_cache;
+  const BlockContents* contents =
+      reinterpret_cast<BlockContents*>(block_cache->Value(cache_handle));
+  bool may_match = FilterBlockReader(rep_->filter_policy, contents->data)
+                       .KeyMayMatch(block_offset, key);
+  block_cache->Release(cache_handle);
+  return may_match;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
+  return DataBlockReader(reinterpret_cast<Table*>(arg), options, index_value,
+                         nullptr);
+}
+
+Iterator* Table::DataBlockReader(Table* table, const ReadOptions& options,
+                                 const Slice& index_value,
+                                 const Slice* get_target, bool* pinnable) {
   Cache* block_cache = table->rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
+  bool heap_allocated = false;
 
   BlockHandle handle;
   Slice input = index_value;
@@ -176,9 +472,13 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(table->rep_->file, options, handle, &contents,
+                      table->rep_->compression_dict,
+                      table->rep_->options.secondary_cache,
+                      table->rep_->secondary_cache_id);
         if (s.ok()) {
           block = new Block(contents);
+          heap_allocated = contents.heap_allocated;
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(key, block, block->size(),
                                                &DeleteCachedBlock);
@@ -186,16 +486,27 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(table->rep_->file, options, handle, &contents,
+                    table->rep_->compression_dict,
+                    table->rep_->options.secondary_cache,
+                    table->rep_->secondary_cache_id);
       if (s.ok()) {
         block = new Block(contents);
+        heap_allocated = contents.heap_allocated;
       }
     }
   }
+  if (pinnable != nullptr) {
+    // Blocks in the block cache and blocks read into the heap own their
+    // data, but blocks of memory-mapped files point into the mapping.
+    *pinnable = cache_handle != nullptr || heap_allocated;
+  }
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    const Comparator* cmp = table->rep_->options.comparator;
+    iter = get_target != nullptr ? block->NewIteratorForGet(cmp, *get_target)
+                                 : block->NewIterator(cmp);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -208,31 +519,42 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                             const_cast<Table*>(this), options);
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return nullptr;
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                                                const Slice&, Cleanable*),
+                          Cleanable* table_pin) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (!FilterMayMatch(options, k, k)) {
+    return s;
+  }
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
     // 先在布隆过滤器中查找
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (handle.DecodeFrom(&handle_value).ok() &&
+        !BlockFilterMayMatch(options, handle.offset(), k)) {
       // Not found
     } else {
       // 去sst中查找
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
+      bool pinnable;
+      Iterator* block_iter =
+          DataBlockReader(this, options, iiter->value(), &k, &pinnable);
       if (block_iter->Valid()) {
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
+        (*handle_result)(arg, block_iter->key(), block_iter->value(),
+                         pinnable ? block_iter : table_pin);
       }
       s = block_iter->status();
       delete block_iter;
@@ -245,9 +567,218 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+void Table::InternalMultiGet(const ReadOptions& options, int n,
+                             const Slice* keys, void* const* args,
+                             void (*handle_result)(void*, const Slice&,
+                                                   const Slice&, Cleanable*),
+                             Status* statuses) {
+  const Comparator* cmp = rep_->options.comparator;
+  Cache* block_cache = rep_->options.block_cache;
+
+  // A data block needed by one or more of the keys.
+  struct BlockState {
+    BlockHandle handle;
+    char cache_key[16];
+    Block* block = nullptr;
+    Cache::Handle* cache_handle = nullptr;
+    Status status;
+  };
+  std::vector<BlockState> blocks;
+  std::vector<int> key_block(n, -1);  // Index into blocks, or -1 if none
+
+  // Find the data block of every key, leaving out keys that the filter
+  // rules out.  Keys are sorted, so keys sharing a block are adjacent and the
+  // index entry found for the previous key is still right as long as it is
+  // not smaller than the current key.
+  Iterator* iiter = NewIndexIterator(options);
+  for (int i = 0; i < n; i++) {
+    const Slice& k = keys[i];
+    statuses[i] = Status::OK();
+    if (!FilterMayMatch(options, k, k)) {
+      continue;
+    }
+    if (!iiter->Valid() || cmp->Compare(iiter->key(), k) < 0) {
+      iiter->Seek(k);
+    }
+    if (!iiter->Valid()) {
+      // Past the last block: this and all later keys are absent.
+      for (; i < n; i++) {
+        statuses[i] = iiter->status();
+      }
+      break;
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    Status s = handle.DecodeFrom(&handle_value);
+    if (!s.ok()) {
+      statuses[i] = s;
+      continue;
+    }
+    if (!BlockFilterMayMatch(options, handle.offset(), k)) {
+      // Not found
+      continue;
+    }
+    if (blocks.empty() || blocks.back().handle.offset() != handle.offset()) {
+      blocks.emplace_back();
+      blocks.back().handle = handle;
+    }
+    key_block[i] = static_cast<int>(blocks.size()) - 1;
+  }
+  delete iiter;
+
+  // Take what we can from the block cache and read all other blocks with a
+  // single batched read.
+  std::vector<size_t> missing;
+  std::vector<BlockHandle> missing_handles;
+  for (size_t b = 0; b < blocks.size(); b++) {
+    if (block_cache != nullptr) {
+      EncodeFixed64(blocks[b].cache_key, rep_->cache_id);
+      EncodeFixed64(blocks[b].cache_key + 8, blocks[b].handle.offset());
+      Slice key(blocks[b].cache_key, sizeof(blocks[b].cache_key));
+      blocks[b].cache_handle = block_cache->Lookup(key);
+      if (blocks[b].cache_handle != nullptr) {
+        blocks[b].block =
+            reinterpret_cast<Block*>(block_cache->Value(blocks[b].cache_handle));
+        continue;
+      }
+    }
+    missing.push_back(b);
+    missing_handles.push_back(blocks[b].handle);
+  }
+  if (!missing.empty()) {
+    std::vector<BlockContents> contents(missing.size());
+    std::vector<Status> read_statuses(missing.size());
+    ReadBlocks(rep_->file, options, missing_handles.data(), missing.size(),
+               contents.data(), read_statuses.data(), rep_->compression_dict,
+               rep_->options.secondary_cache, rep_->secondary_cache_id);
+    for (size_t j = 0; j < missing.size(); j++) {
+      BlockState* state = &blocks[missing[j]];
+      state->status = read_statuses[j];
+      if (!state->status.ok()) {
+        continue;
+      }
+      state->block = new Block(contents[j]);
+      if (block_cache != nullptr && contents[j].cachable &&
+          options.fill_cache) {
+        Slice key(state->cache_key, sizeof(state->cache_key));
+        state->cache_handle = block_cache->Insert(
+            key, state->block, state->block->size(), &DeleteCachedBlock);
+      }
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (key_block[i] < 0) continue;
+    const BlockState& state = blocks[key_block[i]];
+    if (state.block == nullptr) {
+      statuses[i] = state.status;
+      continue;
+    }
+    Iterator* block_iter = state.block->NewIteratorForGet(cmp, keys[i]);
+    if (block_iter->Valid()) {
+      (*handle_result)(args[i], block_iter->key(), block_iter->value(),
+                       nullptr);
+    }
+    statuses[i] = block_iter->status();
+    delete block_iter;
+  }
+
+  for (const BlockState& state : blocks) {
+    if (state.cache_handle != nullptr) {
+      block_cache->Release(state.cache_handle);
+    } else {
+      delete state.block;
+    }
+  }
+}
+
+bool Table::FilterMayMatch(const ReadOptions& options, const Slice& target,
+                           const Slice& filter_key) {
+  if (rep_->full_filter != nullptr) {
+    return rep_->full_filter->KeyMayMatch(filter_key);
+  }
+  if (rep_->filter_in_cache && rep_->filter_format == kFullFilter) {
+    Cache::Handle* cache_handle;
+    if (!LookupMetaBlock(options, rep_->filter_handle, /*parse=*/false,
+                         &cache_handle)
+             .ok()) {
+      return true;  // Errors are treated as potential matches
+    }
+    Cache* block_cache = rep_->options.block_cache;
+    const BlockContents* contents =
+        reinterpret_cast<BlockContents*>(block_cache->Value(cache_handle));
+    bool may_match = FullFilterBlockReader(rep_->filter_policy, contents->data)
+                         .KeyMayMatch(filter_key);
+    block_cache->Release(cache_handle);
+    return may_match;
+  }
+  if (rep_->filter_index_block == nullptr &&
+      !(rep_->filter_in_cache && rep_->filter_format == kPartitionedFilter)) {
+    return true;
+  }
+
+  // Errors are treated as potential matches.
+  Iterator* iter = NewMetaBlockIterator(options, rep_->filter_index_block,
+                                        rep_->filter_handle);
+  iter->Seek(target);
+  bool may_match;
+  if (iter->Valid()) {
+    Slice handle_value = iter->value();
+    BlockHandle handle;
+    may_match = !handle.DecodeFrom(&handle_value).ok() ||
+                PartitionMayMatch(options, handle, filter_key);
+  } else {
+    // "target" is past the last key of the table unless the index is
+    // corrupt.
+    may_match = !iter->status().ok();
+  }
+  delete iter;
+  return may_match;
+}
+
+bool Table::PartitionMayMatch(const ReadOptions& options,
+                              const BlockHandle& handle, const Slice& k) {
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != nullptr) {
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      const BlockContents* contents = reinterpret_cast<BlockContents*>(
+          block_cache->Value(cache_handle));
+      bool may_match =
+          FullFilterBlockReader(rep_->filter_policy, contents->data)
+              .KeyMayMatch(k);
+      block_cache->Release(cache_handle);
+      return may_match;
+    }
+  }
+
+  BlockContents* contents = new BlockContents;
+  if (!ReadBlock(rep_->file, options, handle, contents).ok()) {
+    delete contents;
+    return true;
+  }
+  bool may_match =
+      FullFilterBlockReader(rep_->filter_policy, contents->data)
+          .KeyMayMatch(k);
+  if (block_cache != nullptr && contents->cachable && options.fill_cache) {
+    const Cache::Priority priority = rep_->options.cache_index_and_filter_blocks
+                                         ? Cache::Priority::kHigh
+                                         : Cache::Priority::kLow;
+    block_cache->Release(block_cache->InsertWithPriority(
+        cache_key, contents, contents->data.size(),
+        &DeleteCachedBlockContents, priority));
+  } else {
+    DeleteCachedBlockContents(Slice(), contents);
+  }
+  return may_match;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -4,12 +4,19 @@
 
 #include "leveldb/table_builder.h"
 
+#include <algorithm>
 #include <cassert>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "port/port.h"
+#include "table/block.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -18,20 +25,38 @@
 
 namespace leveldb {
 
+// With Options::zstd_max_dict_bytes, the dictionary is trained on up to
+// this many times its size of data blocks.
+static const size_t kDictSampleRatio = 100;
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
-        index_block(&index_block_options),
+        data_block(&options, BlockBuilder::kDataBlock),
+        index_block(&index_block_options, BlockBuilder::kIndexBlock),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_block(opt.filter_policy == nullptr ||
+                             opt.filter_format != kBlockBasedFilter
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        full_filter_block(
+            opt.filter_policy == nullptr ||
+                    opt.filter_format == kBlockBasedFilter
+                ? nullptr
+                : new FullFilterBlockBuilder(
+                      opt.filter_policy,
+                      opt.filter_format == kPartitionedFilter
+                          ? std::max<size_t>(opt.filter_partition_size, 1)
+                          : 0)),
+        pending_index_entry(false),
+        buffering(opt.compression == kZstdCompression &&
+                  opt.zstd_max_dict_bytes > 0),
+        buffered_bytes(0),
+        compression_dict(nullptr) {
     index_block_options.block_restart_interval = 1;
   }
 
@@ -45,7 +70,8 @@ struct TableBuilder::Rep {
   std::string last_key;
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
-  FilterBlockBuilder* filter_block;
+  FilterBlockBuilder* filter_block;          // kBlockBasedFilter
+  FullFilterBlockBuilder* full_filter_block;  // Other filter formats
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -59,7 +85,23 @@ struct TableBuilder::Rep {
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
+  // With kPartitionedIndex, the index partitions finished so far, with
+  // their last keys.  index_block holds the entries of the next one.
+  std::vector<std::pair<std::string, std::string>> index_partitions;
+
   std::string compressed_output;
+
+  // Entries of the range deletion block, sorted in Finish()
+  std::vector<std::pair<std::string, std::string>> range_tombstones;
+
+  // With a zstd dictionary, the first data blocks are held back until
+  // the dictionary has been trained on them.  Meanwhile, no index or
+  // filter entries are made for their keys.
+  bool buffering;
+  std::vector<std::string> buffered_blocks;
+  size_t buffered_bytes;
+  std::string dict;  // Empty if training failed
+  port::ZstdCompressDict* compression_dict;
 };
 
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
@@ -72,6 +114,8 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
+  delete rep_->compression_dict;
   delete rep_;
 }
 
@@ -103,15 +147,12 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     assert(r->data_block.empty());
     // 在上一个block最后一个key和当前key之中寻找一个更短的key
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
     // 作为index部分
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
-    r->pending_index_entry = false;
+    AddIndexEntry();
   }
 
-  if (r->filter_block != nullptr) {
-    r->filter_block->AddKey(key);
+  if (!r->buffering) {
+    AddFilterKey(key);
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -126,59 +167,183 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_tombstones.emplace_back(key.ToString(), value.ToString());
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
-  WriteBlock(&r->data_block, &r->pending_handle);
+  if (r->buffering) {
+    Slice raw = r->data_block.Finish();
+    r->buffered_blocks.emplace_back(raw.data(), raw.size());
+    r->buffered_bytes += raw.size();
+    r->data_block.Reset();
+    if (r->buffered_bytes >=
+        kDictSampleRatio * r->options.zstd_max_dict_bytes) {
+      EnterUnbuffered();
+    }
+    return;
+  }
+  WriteBlock(r->data_block.Finish(), true, &r->pending_handle);
+  r->data_block.Reset();
   if (ok()) {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
+  StartFilterBlock();
+}
+
+void TableBuilder::AddFilterKey(const Slice& key) {
+  Rep* r = rep_;
+  if (r->filter_block != nullptr) {
+    r->filter_block->AddKey(key);
+  } else if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
+  }
+}
+
+void TableBuilder::StartFilterBlock() {
+  Rep* r = rep_;
   if (r->filter_block != nullptr) {
     r->filter_block->StartBlock(r->offset);
+  } else if (r->full_filter_block != nullptr) {
+    r->full_filter_block->StartBlock();
+  }
+}
+
+void TableBuilder::AddIndexEntry() {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  r->pending_handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(r->last_key, Slice(handle_encoding));
+  r->pending_index_entry = false;
+  if (r->options.index_format == kPartitionedIndex &&
+      r->index_block.CurrentSizeEstimate() >=
+          std::max<size_t>(r->options.index_partition_size, 1)) {
+    CutIndexPartition();
+  }
+}
+
+void TableBuilder::CutIndexPartition() {
+  Rep* r = rep_;
+  r->index_partitions.emplace_back(r->last_key,
+                                   r->index_block.Finish().ToString());
+  r->index_block.Reset();
+}
+
+void TableBuilder::EnterUnbuffered() {
+  Rep* r = rep_;
+  assert(r->buffering);
+  r->buffering = false;
+
+  // Train the dictionary on the buffered blocks.  If that fails, the
+  // blocks are compressed without one.
+  std::string samples;
+  std::vector<size_t> sample_lengths;
+  samples.reserve(r->buffered_bytes);
+  for (const std::string& raw : r->buffered_blocks) {
+    samples.append(raw);
+    sample_lengths.push_back(raw.size());
+  }
+  if (port::Zstd_TrainDictionary(samples, sample_lengths,
+                                 r->options.zstd_max_dict_bytes, &r->dict)) {
+    r->compression_dict = new port::ZstdCompressDict(
+        r->dict.data(), r->dict.size(), r->options.zstd_compression_level);
+  }
+
+  // Write the buffered blocks, making the index and filter entries for
+  // their keys that Add() skipped.
+  for (const std::string& raw : r->buffered_blocks) {
+    if (!ok()) break;
+    BlockContents contents;
+    contents.data = raw;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    Block block(contents);
+    Iterator* iter = block.NewIterator(r->options.comparator);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      const Slice key = iter->key();
+      if (r->pending_index_entry) {
+        r->options.comparator->FindShortestSeparator(&r->last_key, key);
+        AddIndexEntry();
+      }
+      AddFilterKey(key);
+      r->last_key.assign(key.data(), key.size());
+    }
+    delete iter;
+
+    WriteBlock(raw, true, &r->pending_handle);
+    if (ok()) {
+      r->pending_index_entry = true;
+      r->status = r->file->Flush();
+    }
+    StartFilterBlock();
   }
+  r->buffered_blocks.clear();
+  r->buffered_bytes = 0;
 }
 
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  WriteBlock(block->Finish(), false, handle);
+  // 清空block的数据
+  block->Reset();
+}
+
+void TableBuilder::WriteBlock(const Slice& raw, bool data_block,
+                              BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
 
   Slice block_contents;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
   // 检测是否需要压缩
+  std::string* compressed = &r->compressed_output;
+  bool ok = false;
   switch (type) {
     case kNoCompression:
-      block_contents = raw;
       break;
 
-    case kSnappyCompression: {
+    case kSnappyCompression:
       // 进行Snappy压缩
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
+      ok = port::Snappy_Compress(raw.data(), raw.size(), compressed);
+      break;
+
+    case kZstdCompression:
+      // Only data blocks use the dictionary: the others are read before
+      // it is loaded.
+      if (data_block && r->compression_dict != nullptr) {
+        ok = r->compression_dict->Compress(raw.data(), raw.size(), compressed);
       } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
+        ok = port::Zstd_Compress(r->options.zstd_compression_level, raw.data(),
+                                 raw.size(), compressed);
       }
       break;
-    }
+
+    case kLZ4Compression:
+      ok = port::LZ4_Compress(raw.data(), raw.size(), compressed);
+      break;
+  }
+  if (ok && compressed->size() < raw.size() - (raw.size() / 8u)) {
+    block_contents = *compressed;
+  } else {
+    // Compression not requested or not supported, or compressed less
+    // than 12.5%, so just store uncompressed form
+    block_contents = raw;
+    type = kNoCompression;
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  // 清空block的数据
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -207,27 +372,108 @@ Status TableBuilder::status() const { return rep_->status; }
 Status TableBuilder::Finish() {
   Rep* r = rep_;
   Flush();
+  if (ok() && r->buffering) {
+    EnterUnbuffered();
+  }
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, range_del_block_handle, dict_block_handle,
+      metaindex_block_handle, index_block_handle;
+
+  // Metaindex entries, which must be added in sorted order
+  std::map<std::string, BlockHandle> meta_handles;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+    meta_handles[FilterMetaKey(kBlockBasedFilter, r->options.filter_policy)] =
+        filter_block_handle;
+  }
+  if (ok() && r->full_filter_block != nullptr) {
+    const std::vector<FullFilterBlockBuilder::Partition>& partitions =
+        r->full_filter_block->Finish();
+    if (r->options.filter_format != kPartitionedFilter) {
+      WriteRawBlock(partitions[0].filter, kNoCompression,
+                    &filter_block_handle);
+    } else {
+      // Write the partitions, then an index from the last key of each
+      // partition to its location.
+      BlockBuilder filter_index_block(&r->index_block_options);
+      for (const auto& partition : partitions) {
+        if (!ok()) break;
+        BlockHandle handle;
+        WriteRawBlock(partition.filter, kNoCompression, &handle);
+        std::string handle_encoding;
+        handle.EncodeTo(&handle_encoding);
+        filter_index_block.Add(partition.last_key, handle_encoding);
+      }
+      if (ok()) {
+        WriteBlock(&filter_index_block, &filter_block_handle);
+      }
+    }
+    meta_handles[FilterMetaKey(r->options.filter_format,
+                               r->options.filter_policy)] = filter_block_handle;
+  }
+
+  // Write range deletion block
+  if (ok() && !r->range_tombstones.empty()) {
+    const Comparator* cmp = r->options.comparator;
+    std::stable_sort(r->range_tombstones.begin(), r->range_tombstones.end(),
+                     [cmp](const std::pair<std::string, std::string>& a,
+                           const std::pair<std::string, std::string>& b) {
+                       return cmp->Compare(a.first, b.first) < 0;
+                     });
+    BlockBuilder range_del_block(&r->options);
+    for (const auto& entry : r->range_tombstones) {
+      range_del_block.Add(entry.first, entry.second);
+    }
+    WriteBlock(&range_del_block, &range_del_block_handle);
+    meta_handles[kRangeDelBlockName] = range_del_block_handle;
+  }
+
+  // Write zstd dictionary block
+  if (ok() && !r->dict.empty()) {
+    WriteRawBlock(r->dict, kNoCompression, &dict_block_handle);
+    meta_handles[kZstdDictBlockName] = dict_block_handle;
+  }
+
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddIndexEntry();
+  }
+
+  // Write index partitions, then a top-level index from the last key of
+  // each partition to its location.
+  BlockBuilder top_level_index(&r->index_block_options,
+                               BlockBuilder::kIndexBlock);
+  if (ok() && !r->index_block.empty() && !r->index_partitions.empty()) {
+    CutIndexPartition();
+  }
+  if (ok() && !r->index_partitions.empty()) {
+    BlockHandle partitions_handle;
+    partitions_handle.set_offset(r->offset);
+    for (const auto& partition : r->index_partitions) {
+      if (!ok()) break;
+      BlockHandle handle;
+      WriteBlock(partition.second, false, &handle);
+      std::string handle_encoding;
+      handle.EncodeTo(&handle_encoding);
+      top_level_index.Add(partition.first, handle_encoding);
+    }
+    partitions_handle.set_size(r->offset - partitions_handle.offset());
+    meta_handles[kIndexPartitionsName] = partitions_handle;
+    r->index_partitions.clear();
   }
 
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
-      key.append(r->options.filter_policy->Name());
+    for (const auto& entry : meta_handles) {
       std::string handle_encoding;
-      filter_block_handle.EncodeTo(&handle_encoding);
-      meta_index_block.Add(key, handle_encoding);
+      entry.second.EncodeTo(&handle_encoding);
+      meta_index_block.Add(entry.first, handle_encoding);
     }
 
     // TODO(postrelease): Add stats and other meta blocks
@@ -236,14 +482,8 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
-    WriteBlock(&r->index_block, &index_block_handle);
+    WriteBlock(top_level_index.empty() ? &r->index_block : &top_level_index,
+               &index_block_handle);
   }
 
   // Write footer
@@ -270,6 +510,12 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
-uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->range_tombstones.size();
+}
+
+uint64_t TableBuilder::FileSize() const {
+  return rep_->offset + rep_->buffered_bytes;
+}
 
 }  // namespace leveldb
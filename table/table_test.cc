@@ -14,10 +14,12 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "util/logging.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -181,7 +183,9 @@ class BlockConstructor : public Constructor {
   Status FinishImpl(const Options& options, const KVMap& data) override {
     delete block_;
     block_ = nullptr;
-    BlockBuilder builder(&options);
+    BlockBuilder builder(&options, options.index_format == kBlockIndex
+                                       ? BlockBuilder::kDataBlock
+                                       : BlockBuilder::kIndexBlock);
 
     for (const auto& kvp : data) {
       builder.Add(kvp.first, kvp.second);
@@ -299,15 +303,16 @@ class KeyConvertingIterator : public Iterator {
 
 class MemTableConstructor : public Constructor {
  public:
-  explicit MemTableConstructor(const Comparator* cmp)
+  MemTableConstructor(const Comparator* cmp, MemTableRepType rep)
       : Constructor(cmp), internal_comparator_(cmp) {
-    memtable_ = new MemTable(internal_comparator_);
+    options_.memtable_rep = rep;
+    memtable_ = new MemTable(internal_comparator_, options_);
     memtable_->Ref();
   }
   ~MemTableConstructor() override { memtable_->Unref(); }
   Status FinishImpl(const Options& options, const KVMap& data) override {
     memtable_->Unref();
-    memtable_ = new MemTable(internal_comparator_);
+    memtable_ = new MemTable(internal_comparator_, options_);
     memtable_->Ref();
     int seq = 1;
     for (const auto& kvp : data) {
@@ -322,6 +327,7 @@ class MemTableConstructor : public Constructor {
 
  private:
   const InternalKeyComparator internal_comparator_;
+  Options options_;
   MemTable* memtable_;
 };
 
@@ -370,12 +376,21 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  BLOCK_TEST,
+  MEMTABLE_TEST,
+  VECTOR_MEMTABLE_TEST,
+  HASH_MEMTABLE_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool hash_index;  // Omitted (false) in most entries
+  IndexFormat index_format;  // Omitted (kBlockIndex) in most entries
 };
 
 static const TestArgs kTestArgList[] = {
@@ -385,6 +400,12 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 16},
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
+    {TABLE_TEST, false, 16, true},
+    {TABLE_TEST, true, 1, true},
+    {TABLE_TEST, false, 16, false, kFixedIndex},
+    {TABLE_TEST, true, 16, false, kFixedIndex},
+    {TABLE_TEST, false, 16, false, kPartitionedIndex},
+    {TABLE_TEST, true, 1, true, kPartitionedIndex},
 
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
@@ -392,14 +413,25 @@ static const TestArgs kTestArgList[] = {
     {BLOCK_TEST, true, 16},
     {BLOCK_TEST, true, 1},
     {BLOCK_TEST, true, 1024},
+    {BLOCK_TEST, false, 16, true},
+    {BLOCK_TEST, true, 1, true},
+    // Blocks with the fixed-width layout of index blocks
+    {BLOCK_TEST, false, 16, false, kFixedIndex},
+    {BLOCK_TEST, true, 16, false, kFixedIndex},
 
     // Restart interval does not matter for memtables
     {MEMTABLE_TEST, false, 16},
     {MEMTABLE_TEST, true, 16},
+    {VECTOR_MEMTABLE_TEST, false, 16},
+    {VECTOR_MEMTABLE_TEST, true, 16},
+    {HASH_MEMTABLE_TEST, false, 16},
+    {HASH_MEMTABLE_TEST, true, 16},
 
     // Do not bother with restart interval variations for DB
     {DB_TEST, false, 16},
     {DB_TEST, true, 16},
+    {DB_TEST, false, 16, true},
+    {DB_TEST, false, 16, false, kPartitionedIndex},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -413,6 +445,10 @@ class Harness : public testing::Test {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.data_block_hash_index = args.hash_index;
+    options_.index_format = args.index_format;
+    // Small enough for tables of a few data blocks to be partitioned
+    options_.index_partition_size = 64;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -427,7 +463,16 @@ class Harness : public testing::Test {
         constructor_ = new BlockConstructor(options_.comparator);
         break;
       case MEMTABLE_TEST:
-        constructor_ = new MemTableConstructor(options_.comparator);
+        constructor_ =
+            new MemTableConstructor(options_.comparator, kSkipListRep);
+        break;
+      case VECTOR_MEMTABLE_TEST:
+        constructor_ =
+            new MemTableConstructor(options_.comparator, kVectorRep);
+        break;
+      case HASH_MEMTABLE_TEST:
+        constructor_ =
+            new MemTableConstructor(options_.comparator, kHashSkipListRep);
         break;
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
@@ -487,7 +532,7 @@ class Harness : public testing::Test {
     KVMap::const_iterator model_iter = data.begin();
     if (kVerbose) std::fprintf(stderr, "---\n");
     for (int i = 0; i < 200; i++) {
-      const int toss = rnd->Uniform(5);
+      const int toss = rnd->Uniform(6);
       switch (toss) {
         case 0: {
           if (iter->Valid()) {
@@ -543,6 +588,27 @@ class Harness : public testing::Test {
           ASSERT_EQ(ToString(data, model_iter), ToString(iter));
           break;
         }
+
+        case 5: {
+          if (iter->Valid()) {
+            const int n = 1 + rnd->Uniform(20);
+            if (kVerbose) std::fprintf(stderr, "NextBatch %d\n", n);
+            IteratorBatch batch;
+            const int count = iter->NextBatch(n, &batch);
+            ASSERT_EQ(count, batch.size());
+            for (int j = 0; j < count; j++) {
+              ASSERT_EQ(ToString(data, model_iter),
+                        "'" + batch.key(j).ToString() + "->" +
+                            batch.value(j).ToString() + "'");
+              ++model_iter;
+            }
+            if (count < n) {
+              ASSERT_TRUE(model_iter == data.end());
+            }
+            ASSERT_EQ(ToString(data, model_iter), ToString(iter));
+          }
+          break;
+        }
       }
     }
     delete iter;
@@ -639,6 +705,76 @@ TEST_F(Harness, ZeroRestartPointsInBlock) {
 }
 
 // Test the empty key
+// Checks that NewIteratorForGet() finds what Seek() finds for a point
+// lookup of "target": the same entry, or no entry matching "target".
+static void CheckPointLookup(Block* block, const Comparator* cmp,
+                             const Slice& target) {
+  Iterator* seek_iter = block->NewIterator(cmp);
+  seek_iter->Seek(target);
+  Iterator* get_iter = block->NewIteratorForGet(cmp, target);
+  ASSERT_LEVELDB_OK(get_iter->status());
+  const Slice lookup_key = cmp->PointLookupKey(target);
+  if (get_iter->Valid()) {
+    ASSERT_TRUE(seek_iter->Valid());
+    if (cmp->PointLookupKey(seek_iter->key()) == lookup_key) {
+      ASSERT_EQ(seek_iter->key().ToString(), get_iter->key().ToString());
+      ASSERT_EQ(seek_iter->value().ToString(), get_iter->value().ToString());
+    } else {
+      ASSERT_NE(lookup_key, cmp->PointLookupKey(get_iter->key()));
+    }
+  } else if (seek_iter->Valid()) {
+    ASSERT_NE(lookup_key, cmp->PointLookupKey(seek_iter->key()));
+  }
+  delete get_iter;
+  delete seek_iter;
+}
+
+TEST(BlockTest, HashIndexPointLookups) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  for (int restart_interval : {1, 2, 16}) {
+    Options options;
+    options.comparator = &cmp;
+    options.block_restart_interval = restart_interval;
+    options.data_block_hash_index = true;
+    BlockBuilder builder(&options, BlockBuilder::kDataBlock);
+    // Even keys, with up to three versions that may straddle restart points.
+    for (int i = 0; i < 400; i += 2) {
+      for (int version = i % 3; version >= 0; version--) {
+        std::string key = "k" + NumberToString(1000 + i);
+        InternalKey ikey(key, 10 + version, kTypeValue);
+        builder.Add(ikey.Encode(), key + "." + NumberToString(version));
+      }
+    }
+    std::string data = builder.Finish().ToString();
+    BlockContents contents;
+    contents.data = data;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    Block block(contents);
+
+    // Seek() finds an entry for all of these, and point lookups as well
+    // unless the hash index rules out the key.
+    int skipped = 0;
+    for (int i = 0; i < 398; i++) {
+      std::string key = "k" + NumberToString(1000 + i);
+      for (SequenceNumber snapshot : {9, 11, 100}) {
+        LookupKey lkey(key, snapshot);
+        CheckPointLookup(&block, &cmp, lkey.internal_key());
+        Iterator* iter = block.NewIteratorForGet(&cmp, lkey.internal_key());
+        if (!iter->Valid()) skipped++;
+        delete iter;
+      }
+    }
+    if (restart_interval == 1) {
+      // Over 253 restart points: built without a hash index.
+      ASSERT_EQ(0, skipped);
+    } else {
+      // Most missing keys are ruled out without a search.
+      ASSERT_GT(skipped, 200);
+    }
+  }
+}
+
 TEST_F(Harness, SimpleEmptyKey) {
   for (int i = 0; i < kNumTestArgs; i++) {
     Init(kTestArgList[i]);
@@ -723,7 +859,7 @@ TEST_F(Harness, RandomizedLongDB) {
 
 TEST(MemTableTest, Simple) {
   InternalKeyComparator cmp(BytewiseComparator());
-  MemTable* memtable = new MemTable(cmp);
+  MemTable* memtable = new MemTable(cmp, Options());
   memtable->Ref();
   WriteBatch batch;
   WriteBatchInternal::SetSequence(&batch, 100);
@@ -745,6 +881,77 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+TEST(MemTableTest, GetWithEachRep) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(2);
+  ASSERT_EQ(std::string("leveldb.FixedPrefix.2"), prefix_extractor->Name());
+  ASSERT_TRUE(!prefix_extractor->InDomain("k"));
+  ASSERT_EQ("k1", prefix_extractor->Transform("k1x").ToString());
+
+  const MemTableRepType kReps[] = {kSkipListRep, kVectorRep, kHashSkipListRep};
+  for (MemTableRepType rep : kReps) {
+    Options options;
+    options.memtable_rep = rep;
+    options.memtable_hash_bucket_count = 7;
+    options.prefix_extractor = prefix_extractor;
+    MemTable* memtable = new MemTable(cmp, options);
+    memtable->Ref();
+    for (int i = 0; i < 200; i++) {
+      const std::string key = "k" + NumberToString(i % 100);
+      memtable->Add(i + 1, (i % 7 == 0) ? kTypeDeletion : kTypeValue, key,
+                    "v" + NumberToString(i));
+    }
+    memtable->Add(201, kTypeValue, "k", "short");
+
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+        memtable->MarkReadOnly();
+      }
+      for (int i = 100; i < 200; i++) {
+        const std::string key = "k" + NumberToString(i % 100);
+        std::string value;
+        Status s;
+        ASSERT_TRUE(memtable->Get(LookupKey(key, 1000), &value, &s));
+        if (i % 7 == 0) {
+          ASSERT_TRUE(s.IsNotFound());
+        } else {
+          ASSERT_EQ("v" + NumberToString(i), value);
+        }
+        // The older version is visible at its own sequence number.
+        value.clear();
+        s = Status::OK();
+        ASSERT_TRUE(memtable->Get(LookupKey(key, i - 99), &value, &s));
+        if ((i - 100) % 7 == 0) {
+          ASSERT_TRUE(s.IsNotFound());
+        } else {
+          ASSERT_EQ("v" + NumberToString(i - 100), value);
+        }
+      }
+      std::string value;
+      Status s;
+      ASSERT_TRUE(memtable->Get(LookupKey("k", 1000), &value, &s));
+      ASSERT_EQ("short", value);
+      ASSERT_TRUE(!memtable->Get(LookupKey("k100", 1000), &value, &s));
+      ASSERT_TRUE(!memtable->Get(LookupKey("k1", 0), &value, &s));
+
+      Iterator* iter = memtable->NewIterator();
+      int count = 0;
+      std::string last;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (count > 0) {
+          ASSERT_LT(cmp.Compare(last, iter->key()), 0);
+        }
+        last = iter->key().ToString();
+        count++;
+      }
+      ASSERT_EQ(201, count);
+      delete iter;
+    }
+    memtable->Unref();
+  }
+  delete prefix_extractor;
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -784,16 +991,30 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
-static bool SnappyCompressionSupported() {
+static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
-  return port::Snappy_Compress(in.data(), in.size(), &out);
+  if (type == kSnappyCompression) {
+    return port::Snappy_Compress(in.data(), in.size(), &out);
+  } else if (type == kZstdCompression) {
+    return port::Zstd_Compress(/*level=*/1, in.data(), in.size(), &out);
+  } else if (type == kLZ4Compression) {
+    return port::LZ4_Compress(in.data(), in.size(), &out);
+  }
+  return false;
 }
 
-TEST(TableTest, ApproximateOffsetOfCompressed) {
-  if (!SnappyCompressionSupported()) {
-    std::fprintf(stderr, "skipping compression tests\n");
-    return;
+class CompressionTableTest
+    : public ::testing::TestWithParam<std::tuple<CompressionType>> {};
+
+INSTANTIATE_TEST_SUITE_P(CompressionTests, CompressionTableTest,
+                         ::testing::Values(kSnappyCompression,
+                                           kZstdCompression, kLZ4Compression));
+
+TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
+  CompressionType type = ::testing::get<0>(GetParam());
+  if (!CompressionSupported(type)) {
+    GTEST_SKIP() << "skipping compression test: " << type;
   }
 
   Random rnd(301);
@@ -807,7 +1028,7 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   KVMap kvmap;
   Options options;
   options.block_size = 1024;
-  options.compression = kSnappyCompression;
+  options.compression = type;
   c.Finish(options, &keys, &kvmap);
 
   // Expected upper and lower bounds of space used by compressible strings.
@@ -826,4 +1047,93 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+
+// Builds a table of small JSON-like values with the given options and
+// returns its size after checking that it reads back.
+static uint64_t BuildJsonTable(const Options& options, int n) {
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < n; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "user%08d", i);
+    char value[200];
+    std::snprintf(value, sizeof(value),
+                  "{\"id\":%d,\"name\":\"user%u\",\"email\":\"u%u@example."
+                  "com\",\"active\":%s,\"score\":%u}",
+                  i, rnd.Uniform(100000), rnd.Uniform(100000),
+                  rnd.OneIn(2) ? "true" : "false", rnd.Uniform(1000));
+    c.Add(key, value);
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  c.Finish(options, &keys, &kvmap);
+
+  Iterator* iter = c.NewIterator();
+  iter->SeekToFirst();
+  for (const auto& kvp : kvmap) {
+    EXPECT_TRUE(iter->Valid());
+    if (!iter->Valid()) break;
+    EXPECT_EQ(kvp.first, iter->key().ToString());
+    EXPECT_EQ(kvp.second, iter->value().ToString());
+    iter->Next();
+  }
+  EXPECT_TRUE(!iter->Valid());
+  EXPECT_LEVELDB_OK(iter->status());
+  delete iter;
+  return c.ApproximateOffsetOf("z");
+}
+
+TEST(TableTest, IndexFormats) {
+  // The index format changes where the index lives, not the data blocks.
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  options.index_partition_size = 128;
+  std::vector<uint64_t> offsets[3];
+  for (IndexFormat format : {kBlockIndex, kFixedIndex, kPartitionedIndex}) {
+    TableConstructor c(BytewiseComparator());
+    for (int i = 0; i < 2000; i++) {
+      c.Add("k" + NumberToString(10000 + i), std::string(20, 'v'));
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    options.index_format = format;
+    c.Finish(options, &keys, &kvmap);
+    for (int i = 0; i < 2000; i += 7) {
+      offsets[format].push_back(
+          c.ApproximateOffsetOf("k" + NumberToString(10000 + i) + "a"));
+    }
+    // Past the last key: the offset of the metaindex block, which follows
+    // the index partitions.
+    offsets[format].push_back(c.ApproximateOffsetOf("z"));
+  }
+  ASSERT_GT(offsets[kBlockIndex][100], 10000);
+  ASSERT_EQ(offsets[kBlockIndex], offsets[kFixedIndex]);
+  const uint64_t metaindex_offset = offsets[kBlockIndex].back();
+  ASSERT_GT(offsets[kPartitionedIndex].back(), metaindex_offset);
+  offsets[kPartitionedIndex].back() = metaindex_offset;
+  ASSERT_EQ(offsets[kBlockIndex], offsets[kPartitionedIndex]);
+}
+
+TEST(TableTest, ZstdDictionary) {
+  Options options;
+  options.block_size = 1024;
+  options.compression = kZstdCompression;
+  const uint64_t plain_size = BuildJsonTable(options, 20000);
+
+  options.zstd_max_dict_bytes = 4096;
+  const uint64_t dict_size = BuildJsonTable(options, 20000);
+  // Fewer blocks than the training budget: trained in Finish().
+  BuildJsonTable(options, 100);
+  // Too few samples to train on: written without a dictionary.
+  BuildJsonTable(options, 1);
+
+  if (CompressionSupported(kZstdCompression)) {
+    std::fprintf(stderr, "zstd: %llu bytes, with dictionary: %llu bytes\n",
+                 static_cast<unsigned long long>(plain_size),
+                 static_cast<unsigned long long>(dict_size));
+    ASSERT_LT(dict_size, plain_size);
+  }
+}
+
 }  // namespace leveldb
@@ -27,6 +27,7 @@ class TwoLevelIterator : public Iterator {
   void SeekToLast() override;
   void Next() override;
   void Prev() override;
+  int NextBatch(int n, IteratorBatch* batch) override;
 
   bool Valid() const override { return data_iter_.Valid(); }
   Slice key() const override {
@@ -111,6 +112,16 @@ void TwoLevelIterator::Next() {
   SkipEmptyDataBlocksForward();
 }
 
+int TwoLevelIterator::NextBatch(int n, IteratorBatch* batch) {
+  // Copy whole runs of each data block.
+  int count = 0;
+  while (count < n && Valid()) {
+    count += data_iter_.NextBatch(n - count, batch);
+    SkipEmptyDataBlocksForward();
+  }
+  return count;
+}
+
 void TwoLevelIterator::Prev() {
   assert(Valid());
   data_iter_.Prev();
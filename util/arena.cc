@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
@@ -62,6 +64,16 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  MutexLock l(&mu_);
+  return Allocate(bytes);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  MutexLock l(&mu_);
+  return AllocateAligned(bytes);
+}
+
 // 分配block_bytes字节的内存块出来
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
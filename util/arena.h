@@ -11,6 +11,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
 // Arena用于LevelDb中的内存管理
@@ -29,6 +32,12 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Thread-safe versions of Allocate() and AllocateAligned().  They may
+  // be called by several threads at once, but not at the same time as
+  // the versions above.
+  char* AllocateConcurrently(size_t bytes) LOCKS_EXCLUDED(mu_);
+  char* AllocateAlignedConcurrently(size_t bytes) LOCKS_EXCLUDED(mu_);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -55,6 +64,9 @@ class Arena {
   //               accessed without any locking. Is this OK?
   // 记录Arena中使用的内存大小
   std::atomic<size_t> memory_usage_;
+
+  // Serializes the *Concurrently() allocations.
+  port::Mutex mu_;
 };
 
 inline char* Arena::Allocate(size_t bytes) {
@@ -4,7 +4,12 @@
 
 #include "util/arena.h"
 
+#include <atomic>
+#include <utility>
+#include <vector>
+
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -58,4 +63,59 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+namespace {
+
+struct ConcurrentAllocator {
+  Arena* arena;
+  int id;
+  std::vector<std::pair<size_t, char*>> allocated;
+  std::atomic<bool> done;
+};
+
+void ConcurrentAllocateBody(void* arg) {
+  ConcurrentAllocator* a = reinterpret_cast<ConcurrentAllocator*>(arg);
+  Random rnd(301 + a->id);
+  for (int i = 0; i < 10000; i++) {
+    size_t s = rnd.OneIn(100) ? 1 + rnd.Uniform(3000) : 1 + rnd.Uniform(50);
+    char* r = rnd.OneIn(2) ? a->arena->AllocateAlignedConcurrently(s)
+                           : a->arena->AllocateConcurrently(s);
+    for (size_t b = 0; b < s; b++) {
+      r[b] = a->id;
+    }
+    a->allocated.push_back(std::make_pair(s, r));
+  }
+  a->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST(ArenaTest, Concurrent) {
+  const int kThreads = 4;
+  Arena arena;
+  ConcurrentAllocator allocators[kThreads];
+  for (int id = 0; id < kThreads; id++) {
+    allocators[id].arena = &arena;
+    allocators[id].id = id;
+    allocators[id].done.store(false, std::memory_order_release);
+    Env::Default()->StartThread(ConcurrentAllocateBody, &allocators[id]);
+  }
+  for (int id = 0; id < kThreads; id++) {
+    while (!allocators[id].done.load(std::memory_order_acquire)) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+  }
+
+  // No two threads were handed overlapping memory.
+  size_t bytes = 0;
+  for (int id = 0; id < kThreads; id++) {
+    for (const auto& allocation : allocators[id].allocated) {
+      for (size_t b = 0; b < allocation.first; b++) {
+        ASSERT_EQ(id, allocation.second[b]);
+      }
+      bytes += allocation.first;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
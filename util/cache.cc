@@ -7,6 +7,7 @@
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <initializer_list>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -37,6 +38,18 @@ namespace {
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// The LRU order is segmented so that one scan cannot flush the working set.
+// Items enter the cache "probationary" and become "protected" when a
+// Lookup() finds them.  Unreferenced items wait on the list of their
+// segment, and eviction empties the probationary list before touching the
+// protected one.  The protected segment is limited to a fraction of the
+// capacity: beyond it, its oldest unreferenced items go back to the newest
+// end of the probationary list and get one more chance to be looked up.
+//
+// Items inserted with high priority form a third segment, evicted last.  It
+// too is limited to a fraction of the capacity, beyond which its oldest
+// unreferenced items join the protected segment.
 
 // An entry is a variable length heap-allocated structure.  Entries
 // are kept in a circular doubly linked list ordered by access time.
@@ -58,6 +71,8 @@ struct LRUHandle {
   size_t key_length;
   // 表示是否再缓存中
   bool in_cache;     // Whether entry is in the cache.
+  bool in_protected;  // Whether entry is in the protected segment.
+  bool in_high_pri;   // Whether entry is in the high-priority segment.
   // 引用计数;因为当前节点会被多个组件使用不能简单删除
   uint32_t refs;     // References, including cache reference, if present.
   // 记录当前可以的hash值
@@ -166,12 +181,18 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double protected_ratio,
+                   double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    protected_capacity_ = static_cast<size_t>(capacity * protected_ratio);
+    high_pri_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        bool high_pri);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -180,6 +201,14 @@ class LRUCache {
     MutexLock l(&mutex_);
     return usage_;
   }
+  uint64_t LookupHits() const {
+    MutexLock l(&mutex_);
+    return hits_;
+  }
+  uint64_t LookupMisses() const {
+    MutexLock l(&mutex_);
+    return misses_;
+  }
 
  private:
   //  从in-use链表中移除
@@ -191,22 +220,46 @@ class LRUCache {
   // 减少引用计数
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Moves the oldest unreferenced protected entries to the probationary
+  // segment until the protected segment fits its capacity.
+  void DemoteProtected() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Moves the oldest unreferenced high-priority entries to the protected
+  // segment until the high-priority segment fits its capacity.
+  void DemoteHighPri() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   // LRU的容量
   size_t capacity_;
+  // Capacity of the protected segment; 0 disables it.
+  size_t protected_capacity_;
+  // Capacity of the high-priority segment; 0 disables it.
+  size_t high_pri_capacity_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   // 当前LRU使用的内从
   size_t usage_ GUARDED_BY(mutex_);
-
-  // Dummy head of LRU list.
+  // Charges of the protected entries, including the ones in use.
+  size_t protected_usage_ GUARDED_BY(mutex_);
+  // Charges of the high-priority entries, including the ones in use.
+  size_t high_pri_usage_ GUARDED_BY(mutex_);
+  uint64_t hits_ GUARDED_BY(mutex_);
+  uint64_t misses_ GUARDED_BY(mutex_);
+
+  // Dummy head of LRU list of the probationary segment.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
   // 只在缓存中的节点reference=1
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of LRU list of the protected segment.
+  // Entries have refs==1, in_cache==true and in_protected==true.
+  LRUHandle protected_ GUARDED_BY(mutex_);
+
+  // Dummy head of LRU list of the high-priority segment.
+  // Entries have refs==1, in_cache==true and in_high_pri==true.
+  LRUHandle high_pri_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   // 被外部引用且在缓存中的节点 reference>1
@@ -216,23 +269,37 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      protected_capacity_(0),
+      high_pri_capacity_(0),
+      usage_(0),
+      protected_usage_(0),
+      high_pri_usage_(0),
+      hits_(0),
+      misses_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  protected_.next = &protected_;
+  protected_.prev = &protected_;
+  high_pri_.next = &high_pri_;
+  high_pri_.prev = &high_pri_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &protected_, &high_pri_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of the segment lists.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -257,9 +324,44 @@ void LRUCache::Unref(LRUHandle* e) {
     free(e);
     // 引用计数为1需要从in-case队列中移到普通队列
   } else if (e->in_cache && e->refs == 1) {
-    // No longer in use; move to lru_ list.
+    // No longer in use; move to the list of its segment.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    if (e->in_high_pri) {
+      LRU_Append(&high_pri_, e);
+      DemoteHighPri();
+    } else if (e->in_protected) {
+      LRU_Append(&protected_, e);
+      DemoteProtected();
+    } else {
+      LRU_Append(&lru_, e);
+    }
+  }
+}
+
+void LRUCache::DemoteHighPri() {
+  while (high_pri_usage_ > high_pri_capacity_ &&
+         high_pri_.next != &high_pri_) {
+    LRUHandle* old = high_pri_.next;
+    assert(old->refs == 1);
+    old->in_high_pri = false;
+    high_pri_usage_ -= old->charge;
+    old->in_protected = true;
+    protected_usage_ += old->charge;
+    LRU_Remove(old);
+    LRU_Append(&protected_, old);
+  }
+  DemoteProtected();
+}
+
+void LRUCache::DemoteProtected() {
+  while (protected_usage_ > protected_capacity_ &&
+         protected_.next != &protected_) {
+    LRUHandle* old = protected_.next;
+    assert(old->refs == 1);
+    old->in_protected = false;
+    protected_usage_ -= old->charge;
+    LRU_Remove(old);
+    LRU_Append(&lru_, old);
   }
 }
 // 将节点从链表中移除
@@ -279,8 +381,17 @@ void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
-  if (e != nullptr) {
+  if (e == nullptr) {
+    misses_++;
+  } else {
+    hits_++;
     Ref(e);
+    // A second access: move the entry to the protected segment, which it
+    // joins when it is released.
+    if (!e->in_protected && !e->in_high_pri && protected_capacity_ > 0) {
+      e->in_protected = true;
+      protected_usage_ += e->charge;
+    }
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
@@ -293,7 +404,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                                void* value),
+                                bool high_pri) {
   MutexLock l(&mutex_);
 
   // 创建新的节点对象
@@ -305,6 +417,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->in_protected = false;
+  e->in_high_pri = false;
   // 因为会被返回使用所以引用计数为1
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
@@ -316,6 +430,10 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
+    if (high_pri && high_pri_capacity_ > 0) {
+      e->in_high_pri = true;
+      high_pri_usage_ += charge;
+    }
     // 如果节点已将在缓存中需要将老的节点释放掉。
     FinishErase(table_.Insert(e));
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
@@ -323,8 +441,17 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->next = nullptr;
   }
   // 当缓存容量不足时;开始释放普通队列中的缓存
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (lru_.next != &lru_) {
+      old = lru_.next;
+    } else if (protected_.next != &protected_) {
+      old = protected_.next;
+    } else if (high_pri_.next != &high_pri_) {
+      old = high_pri_.next;
+    } else {
+      break;
+    }
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -344,6 +471,14 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->in_protected) {
+      e->in_protected = false;
+      protected_usage_ -= e->charge;
+    }
+    if (e->in_high_pri) {
+      e->in_high_pri = false;
+      high_pri_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != nullptr;
@@ -356,12 +491,14 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
-    assert(e->refs == 1);
-    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
-    if (!erased) {  // to avoid unused variable when compiled NDEBUG
-      assert(erased);
+  for (LRUHandle* list : {&lru_, &protected_, &high_pri_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
     }
   }
 }
@@ -386,10 +523,12 @@ class ShardedLRUCache : public Cache {
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+  ShardedLRUCache(size_t capacity, double protected_ratio,
+                  double high_pri_pool_ratio)
+      : last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, protected_ratio, high_pri_pool_ratio);
     }
   }
   ~ShardedLRUCache() override {}
@@ -397,7 +536,15 @@ class ShardedLRUCache : public Cache {
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      false);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority == Priority::kHigh);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -430,10 +577,36 @@ class ShardedLRUCache : public Cache {
     }
     return total;
   }
+  uint64_t LookupHits() const override {
+    uint64_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].LookupHits();
+    }
+    return total;
+  }
+  uint64_t LookupMisses() const override {
+    uint64_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].LookupMisses();
+    }
+    return total;
+  }
 };
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) {
+  return NewLRUCache(capacity, LRUCacheOptions());
+}
+
+Cache* NewLRUCache(size_t capacity, const LRUCacheOptions& options) {
+  double protected_ratio = options.protected_ratio;
+  double high_pri_pool_ratio = options.high_pri_pool_ratio;
+  if (protected_ratio < 0) protected_ratio = 0;
+  if (protected_ratio > 1) protected_ratio = 1;
+  if (high_pri_pool_ratio < 0) high_pri_pool_ratio = 0;
+  if (high_pri_pool_ratio > 1) high_pri_pool_ratio = 1;
+  return new ShardedLRUCache(capacity, protected_ratio, high_pri_pool_ratio);
+}
 
 }  // namespace leveldb
@@ -4,10 +4,13 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "util/coding.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -24,7 +27,9 @@ static int DecodeKey(const Slice& k) {
 static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
 static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
 
-class CacheTest : public testing::Test {
+enum CacheType { kLRU, kClock };
+
+class CacheTest : public testing::TestWithParam<CacheType> {
  public:
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
@@ -36,7 +41,13 @@ class CacheTest : public testing::Test {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+  CacheTest() : cache_(NewCache(kCacheSize)) { current_ = this; }
+
+  // The tests charge 1 for most entries: size the CLOCK table for that.
+  static Cache* NewCache(size_t capacity) {
+    return GetParam() == kLRU ? NewLRUCache(capacity)
+                              : NewClockCache(capacity, 0, 1);
+  }
 
   ~CacheTest() { delete cache_; }
 
@@ -64,7 +75,10 @@ class CacheTest : public testing::Test {
 };
 CacheTest* CacheTest::current_;
 
-TEST_F(CacheTest, HitAndMiss) {
+INSTANTIATE_TEST_SUITE_P(CacheTypes, CacheTest,
+                         ::testing::Values(kLRU, kClock));
+
+TEST_P(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -85,9 +99,12 @@ TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(1, deleted_keys_.size());
   ASSERT_EQ(100, deleted_keys_[0]);
   ASSERT_EQ(101, deleted_values_[0]);
+
+  ASSERT_EQ(5, cache_->LookupHits());
+  ASSERT_EQ(5, cache_->LookupMisses());
 }
 
-TEST_F(CacheTest, Erase) {
+TEST_P(CacheTest, Erase) {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,7 +123,7 @@ TEST_F(CacheTest, Erase) {
   ASSERT_EQ(1, deleted_keys_.size());
 }
 
-TEST_F(CacheTest, EntriesArePinned) {
+TEST_P(CacheTest, EntriesArePinned) {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,7 +148,7 @@ TEST_F(CacheTest, EntriesArePinned) {
   ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy) {
+TEST_P(CacheTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
   Insert(300, 301);
@@ -150,7 +167,75 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize) {
+TEST_P(CacheTest, ScanResistance) {
+  if (GetParam() != kLRU) {
+    GTEST_SKIP() << "only the LRU cache is segmented";
+  }
+
+  // A working set that was read more than once...
+  const int kHot = kCacheSize / 4;
+  for (int i = 0; i < kHot; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+
+  // ...survives a scan over twice the capacity that is never reread.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < kHot; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i)) << i;
+  }
+}
+
+TEST_P(CacheTest, UnsegmentedLRU) {
+  if (GetParam() != kLRU) {
+    GTEST_SKIP() << "only the LRU cache is segmented";
+  }
+
+  LRUCacheOptions options;
+  options.protected_ratio = 0;
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, options);
+
+  // Without a protected segment, a scan evicts entries read before.
+  const int kHot = kCacheSize / 4;
+  for (int i = 0; i < kHot; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < kHot; i++) {
+    ASSERT_EQ(-1, Lookup(i)) << i;
+  }
+}
+
+TEST_P(CacheTest, HighPriorityEntries) {
+  if (GetParam() != kLRU) {
+    GTEST_SKIP() << "only the LRU cache has a high-priority pool";
+  }
+
+  const int kHigh = kCacheSize / 4;
+  for (int i = 0; i < kHigh; i++) {
+    cache_->Release(cache_->InsertWithPriority(EncodeKey(i), EncodeValue(1000 + i),
+                                               1, &CacheTest::Deleter,
+                                               Cache::Priority::kHigh));
+  }
+
+  // Entries of normal priority cannot evict them, even when read often.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+    ASSERT_EQ(20000 + i, Lookup(10000 + i));
+    ASSERT_EQ(20000 + i, Lookup(10000 + i));
+  }
+  for (int i = 0; i < kHigh; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i)) << i;
+  }
+}
+
+TEST_P(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
   for (int i = 0; i < kCacheSize + 100; i++) {
@@ -167,7 +252,7 @@ TEST_F(CacheTest, UseExceedsCacheSize) {
   }
 }
 
-TEST_F(CacheTest, HeavyEntries) {
+TEST_P(CacheTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -194,13 +279,13 @@ TEST_F(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId) {
+TEST_P(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
-TEST_F(CacheTest, Prune) {
+TEST_P(CacheTest, Prune) {
   Insert(1, 100);
   Insert(2, 200);
 
@@ -213,12 +298,86 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache) {
+TEST_P(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = NewCache(0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
 }
 
+namespace {
+
+std::atomic<int> concurrent_deletions(0);
+
+void ConcurrentDeleter(const Slice& key, void* v) {
+  ASSERT_EQ(DecodeKey(key), DecodeValue(v));
+  concurrent_deletions.fetch_add(1);
+}
+
+struct ConcurrentReader {
+  Cache* cache;
+  int id;
+  int inserts;
+  int mismatches;
+  std::atomic<bool> done;
+};
+
+void ConcurrentReaderBody(void* arg) {
+  ConcurrentReader* r = reinterpret_cast<ConcurrentReader*>(arg);
+  Random rnd(301 + r->id);
+  for (int i = 0; i < 20000; i++) {
+    const int k = rnd.Uniform(500);
+    const std::string key = EncodeKey(k);
+    Cache::Handle* h = r->cache->Lookup(key);
+    if (h == nullptr) {
+      h = r->cache->Insert(key, EncodeValue(k), 1 + rnd.Uniform(4),
+                           &ConcurrentDeleter);
+      r->inserts++;
+    } else if (rnd.OneIn(10)) {
+      r->cache->Erase(key);
+    }
+    if (DecodeValue(r->cache->Value(h)) != k) {
+      r->mismatches++;
+    }
+    r->cache->Release(h);
+  }
+  r->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_P(CacheTest, ConcurrentAccess) {
+  const int kThreads = 4;
+  const int kCapacity = 300;
+  delete cache_;
+  cache_ = NewCache(kCapacity);
+  concurrent_deletions.store(0);
+
+  ConcurrentReader readers[kThreads];
+  for (int id = 0; id < kThreads; id++) {
+    readers[id].cache = cache_;
+    readers[id].id = id;
+    readers[id].inserts = 0;
+    readers[id].mismatches = 0;
+    readers[id].done.store(false, std::memory_order_release);
+    Env::Default()->StartThread(ConcurrentReaderBody, &readers[id]);
+  }
+  int inserts = 0;
+  for (int id = 0; id < kThreads; id++) {
+    while (!readers[id].done.load(std::memory_order_acquire)) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+    ASSERT_EQ(0, readers[id].mismatches);
+    inserts += readers[id].inserts;
+  }
+  // Entries pinned by other readers may push the cache over capacity.
+  ASSERT_LE(cache_->TotalCharge(), kCapacity + 4 * kThreads);
+
+  // Every entry is deleted exactly once.
+  delete cache_;
+  cache_ = nullptr;
+  ASSERT_EQ(inserts, concurrent_deletions.load());
+}
+
 }  // namespace leveldb
@@ -0,0 +1,91 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/cleanable.h"
+
+#include "leveldb/pinnable_slice.h"
+
+namespace leveldb {
+
+Cleanable::Cleanable() {
+  cleanup_head_.function = nullptr;
+  cleanup_head_.next = nullptr;
+}
+
+Cleanable::~Cleanable() { DoCleanup(); }
+
+void Cleanable::DoCleanup() {
+  if (!cleanup_head_.IsEmpty()) {
+    cleanup_head_.Run();
+    for (CleanupNode* node = cleanup_head_.next; node != nullptr;) {
+      node->Run();
+      CleanupNode* next_node = node->next;
+      delete node;
+      node = next_node;
+    }
+    cleanup_head_.function = nullptr;
+    cleanup_head_.next = nullptr;
+  }
+}
+
+void Cleanable::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
+  assert(func != nullptr);
+  CleanupNode* node;
+  if (cleanup_head_.IsEmpty()) {
+    node = &cleanup_head_;
+  } else {
+    node = new CleanupNode();
+    node->next = cleanup_head_.next;
+    cleanup_head_.next = node;
+  }
+  node->function = func;
+  node->arg1 = arg1;
+  node->arg2 = arg2;
+}
+
+void Cleanable::DelegateCleanupsTo(Cleanable* other) {
+  assert(other != this);
+  if (cleanup_head_.IsEmpty()) {
+    return;
+  }
+  other->RegisterCleanup(cleanup_head_.function, cleanup_head_.arg1,
+                         cleanup_head_.arg2);
+  for (CleanupNode* node = cleanup_head_.next; node != nullptr;) {
+    other->RegisterCleanup(node->function, node->arg1, node->arg2);
+    CleanupNode* next_node = node->next;
+    delete node;
+    node = next_node;
+  }
+  cleanup_head_.function = nullptr;
+  cleanup_head_.next = nullptr;
+}
+
+void PinnableSlice::PinSlice(const Slice& s, Cleanable* cleanable) {
+  assert(!pinned_);
+  Slice::operator=(s);
+  cleanable->DelegateCleanupsTo(this);
+  pinned_ = true;
+}
+
+void PinnableSlice::PinSlice(const Slice& s, CleanupFunction function,
+                             void* arg1, void* arg2) {
+  assert(!pinned_);
+  Slice::operator=(s);
+  RegisterCleanup(function, arg1, arg2);
+  pinned_ = true;
+}
+
+void PinnableSlice::PinSelf(const Slice& s) {
+  assert(!pinned_);
+  buf_->assign(s.data(), s.size());
+  Slice::operator=(*buf_);
+}
+
+void PinnableSlice::Reset() {
+  DoCleanup();
+  pinned_ = false;
+  clear();
+}
+
+}  // namespace leveldb
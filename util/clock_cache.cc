@@ -0,0 +1,526 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard keeps its entries in a fixed-size open-addressing hash table
+// with linear probing.  The state of a slot is a single atomic word, so
+// that Lookup() and Release() only need compare-and-swap operations on it
+// and never take a lock:
+//
+// - bits 0-1: kEmpty, kConstruction (owned by one thread, which is
+//   filling or freeing the slot), kVisible (in the cache) or kInvisible
+//   (erased from the cache but still referenced by clients);
+// - bits 2-3: the CLOCK counter, raised by every lookup and lowered by
+//   every pass of the eviction hand, which evicts the unreferenced visible
+//   entries whose counter is zero;
+// - bits 4-63: the number of references held by clients.
+//
+// The other fields of a slot are written by the thread that holds it in
+// kConstruction and published by the release store that makes it
+// visible.  Readers check the key only after acquiring a reference, which
+// keeps the slot from being freed or reused.
+//
+// Each slot also counts the entries that were inserted past it while it
+// was occupied ("displacements"); a lookup stops at the first empty slot
+// without displacements.
+//
+// An entry that finds no free slot, because the table is full of
+// referenced entries or the capacity is zero, is handed out "detached":
+// it is never visible to lookups and is freed by its last Release().
+
+static const uint64_t kStateMask = 3;
+static const uint64_t kEmpty = 0;
+static const uint64_t kConstruction = 1;
+static const uint64_t kVisible = 2;
+static const uint64_t kInvisible = 3;
+
+static const int kClockShift = 2;
+static const uint64_t kClockMask = uint64_t{3} << kClockShift;
+static const uint64_t kMaxClock = 3;
+
+static const int kRefsShift = 4;
+static const uint64_t kOneRef = uint64_t{1} << kRefsShift;
+
+inline uint64_t State(uint64_t meta) { return meta & kStateMask; }
+inline uint64_t Clock(uint64_t meta) {
+  return (meta & kClockMask) >> kClockShift;
+}
+inline uint64_t Refs(uint64_t meta) { return meta >> kRefsShift; }
+inline uint64_t WithClock(uint64_t meta, uint64_t clock) {
+  return (meta & ~kClockMask) | (clock << kClockShift);
+}
+
+struct ClockHandle {
+  std::atomic<uint64_t> meta{kEmpty};
+  std::atomic<uint32_t> displacements{0};
+  // Written only in kConstruction; read with relaxed loads by lookups to
+  // skip slots of other keys before acquiring a reference.
+  std::atomic<uint32_t> hash{0};
+  bool detached = false;
+  void* value = nullptr;
+  void (*deleter)(const Slice&, void* value) = nullptr;
+  size_t charge = 0;
+  size_t key_length = 0;
+  char* key_data = nullptr;
+
+  Slice key() const { return Slice(key_data, key_length); }
+
+  // Passes the entry to its deleter and drops its key.
+  void Free() {
+    (*deleter)(key(), value);
+    delete[] key_data;
+    key_data = nullptr;
+    value = nullptr;
+  }
+};
+
+static inline size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t result = 1;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
+// A single shard of sharded cache.
+class ClockCacheShard {
+ public:
+  ClockCacheShard() : slots_(nullptr), mask_(0), max_occupancy_(0) {}
+  ~ClockCacheShard();
+
+  ClockCacheShard(const ClockCacheShard&) = delete;
+  ClockCacheShard& operator=(const ClockCacheShard&) = delete;
+
+  // Must be called once, before any other method.
+  void Init(size_t capacity, size_t num_slots);
+
+  // High-priority entries start with the largest CLOCK counter, so that
+  // they survive more passes of the eviction hand.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        bool high_pri);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
+  uint64_t LookupHits() const { return hits_.load(std::memory_order_relaxed); }
+  uint64_t LookupMisses() const {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Returns the visible entry for "key" with a new reference, or nullptr.
+  // Lookups raise the CLOCK counter of the entry they find.
+  ClockHandle* Find(const Slice& key, uint32_t hash, bool touch);
+
+  // Acquires a reference on "h" if it is visible.
+  static bool TryRef(ClockHandle* h, bool touch);
+
+  // Drops a reference, and frees the entry if it was the last one of an
+  // erased entry.
+  void Unref(ClockHandle* h);
+
+  // Hides the visible entry "h", on which the caller holds a reference.
+  void MakeInvisible(ClockHandle* h);
+
+  // Frees the entry in slot "h", which the caller holds in kConstruction
+  // after taking it out of the cache, and empties the slot.
+  void FreeSlot(ClockHandle* h);
+
+  // Moves the eviction hand until an entry has been evicted or every
+  // entry has been passed over a few times.  Returns true on eviction.
+  bool EvictOne();
+
+  // Claims an empty slot for "hash", or returns nullptr if the table is
+  // full.
+  ClockHandle* ClaimSlot(uint32_t hash);
+
+  ClockHandle* slots_;
+  size_t mask_;
+  size_t max_occupancy_;
+  size_t capacity_;
+
+  std::atomic<size_t> usage_{0};      // Charges of the visible entries
+  std::atomic<size_t> occupancy_{0};  // Non-empty slots
+  std::atomic<size_t> clock_hand_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+void ClockCacheShard::Init(size_t capacity, size_t num_slots) {
+  assert(slots_ == nullptr);
+  capacity_ = capacity;
+  slots_ = new ClockHandle[num_slots];
+  mask_ = num_slots - 1;
+  // Linear probing slows down as the table fills up.
+  max_occupancy_ = num_slots - num_slots / 4;
+}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (size_t i = 0; i <= mask_ && slots_ != nullptr; i++) {
+    ClockHandle* h = &slots_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    assert(Refs(meta) == 0);  // Error if caller has an unreleased handle
+    if (State(meta) != kEmpty) {
+      h->Free();
+    }
+  }
+  delete[] slots_;
+}
+
+bool ClockCacheShard::TryRef(ClockHandle* h, bool touch) {
+  uint64_t meta = h->meta.load(std::memory_order_acquire);
+  while (true) {
+    if (State(meta) != kVisible) {
+      return false;
+    }
+    uint64_t updated = meta + kOneRef;
+    if (touch && Clock(meta) < kMaxClock) {
+      updated = WithClock(updated, Clock(meta) + 1);
+    }
+    if (h->meta.compare_exchange_weak(meta, updated,
+                                      std::memory_order_acq_rel)) {
+      return true;
+    }
+  }
+}
+
+void ClockCacheShard::Unref(ClockHandle* h) {
+  const uint64_t meta =
+      h->meta.fetch_sub(kOneRef, std::memory_order_acq_rel) - kOneRef;
+  if (Refs(meta) == 0 && State(meta) == kInvisible) {
+    // Nobody can acquire an invisible entry, so this was the last
+    // reference and the exchange cannot fail.
+    uint64_t expected = meta;
+    if (h->meta.compare_exchange_strong(expected, kConstruction,
+                                        std::memory_order_acq_rel)) {
+      FreeSlot(h);
+    }
+  }
+}
+
+void ClockCacheShard::MakeInvisible(ClockHandle* h) {
+  uint64_t meta = h->meta.load(std::memory_order_acquire);
+  while (State(meta) == kVisible) {
+    if (h->meta.compare_exchange_weak(meta, (meta & ~kStateMask) | kInvisible,
+                                      std::memory_order_acq_rel)) {
+      usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+void ClockCacheShard::FreeSlot(ClockHandle* h) {
+  h->Free();
+  const size_t index = h - slots_;
+  for (size_t i = h->hash.load(std::memory_order_relaxed) & mask_;
+       i != index; i = (i + 1) & mask_) {
+    slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  h->meta.store(kEmpty, std::memory_order_release);
+}
+
+ClockHandle* ClockCacheShard::Find(const Slice& key, uint32_t hash,
+                                   bool touch) {
+  size_t index = hash & mask_;
+  for (size_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* h = &slots_[index];
+    const uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (State(meta) == kEmpty &&
+        h->displacements.load(std::memory_order_relaxed) == 0) {
+      return nullptr;
+    }
+    if (State(meta) == kVisible &&
+        h->hash.load(std::memory_order_relaxed) == hash &&
+        TryRef(h, touch)) {
+      // The slot cannot change until the reference is dropped.
+      if (h->hash.load(std::memory_order_relaxed) == hash &&
+          key == h->key()) {
+        return h;
+      }
+      Unref(h);
+    }
+    index = (index + 1) & mask_;
+  }
+  return nullptr;
+}
+
+bool ClockCacheShard::EvictOne() {
+  const size_t max_steps = (mask_ + 1) * (kMaxClock + 1);
+  for (size_t step = 0; step < max_steps; step++) {
+    ClockHandle* h = &slots_[clock_hand_.fetch_add(
+                                 1, std::memory_order_relaxed) &
+                             mask_];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (State(meta) != kVisible || Refs(meta) != 0) {
+      continue;
+    }
+    if (Clock(meta) > 0) {
+      // Failure means the entry was just used: leave it.
+      h->meta.compare_exchange_strong(meta, WithClock(meta, Clock(meta) - 1),
+                                      std::memory_order_acq_rel);
+      continue;
+    }
+    if (h->meta.compare_exchange_strong(meta, kConstruction,
+                                        std::memory_order_acq_rel)) {
+      usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      FreeSlot(h);
+      return true;
+    }
+  }
+  return false;
+}
+
+ClockHandle* ClockCacheShard::ClaimSlot(uint32_t hash) {
+  if (occupancy_.fetch_add(1, std::memory_order_relaxed) >= max_occupancy_) {
+    occupancy_.fetch_sub(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  const size_t home = hash & mask_;
+  size_t index = home;
+  for (size_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* h = &slots_[index];
+    uint64_t expected = kEmpty;
+    if (h->meta.compare_exchange_strong(expected, kConstruction,
+                                        std::memory_order_acq_rel)) {
+      return h;
+    }
+    h->displacements.fetch_add(1, std::memory_order_relaxed);
+    index = (index + 1) & mask_;
+  }
+  // Only reachable if the slots freed concurrently kept moving ahead of
+  // the probe: undo the displacements.
+  for (size_t i = home, n = 0; n <= mask_; i = (i + 1) & mask_, n++) {
+    slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  return nullptr;
+}
+
+Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash,
+                                       void* value, size_t charge,
+                                       void (*deleter)(const Slice& key,
+                                                       void* value),
+                                       bool high_pri) {
+  while (usage_.load(std::memory_order_relaxed) + charge > capacity_ ||
+         occupancy_.load(std::memory_order_relaxed) >= max_occupancy_) {
+    if (!EvictOne()) {
+      break;  // Everything is in use
+    }
+  }
+
+  ClockHandle* h = nullptr;
+  if (capacity_ > 0) {
+    h = ClaimSlot(hash);
+  }
+  if (h == nullptr) {
+    h = new ClockHandle;
+    h->detached = true;
+  }
+  h->hash.store(hash, std::memory_order_relaxed);
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_length = key.size();
+  h->key_data = new char[key.size()];
+  std::memcpy(h->key_data, key.data(), key.size());
+  if (h->detached) {
+    h->meta.store(kInvisible | kOneRef, std::memory_order_relaxed);
+    return reinterpret_cast<Cache::Handle*>(h);
+  }
+
+  usage_.fetch_add(charge, std::memory_order_relaxed);
+  const uint64_t clock = high_pri ? kMaxClock : 1;
+  h->meta.store(kVisible | (clock << kClockShift) | kOneRef,
+                std::memory_order_release);
+
+  // Hide the older entries for the key, anywhere on its probe sequence.
+  size_t index = hash & mask_;
+  for (size_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* other = &slots_[index];
+    if (other == h) {
+      index = (index + 1) & mask_;
+      continue;
+    }
+    const uint64_t meta = other->meta.load(std::memory_order_acquire);
+    if (State(meta) == kEmpty &&
+        other->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+    if (State(meta) == kVisible &&
+        other->hash.load(std::memory_order_relaxed) == hash &&
+        TryRef(other, false)) {
+      if (other->hash.load(std::memory_order_relaxed) == hash &&
+          key == other->key()) {
+        MakeInvisible(other);
+      }
+      Unref(other);
+    }
+    index = (index + 1) & mask_;
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  ClockHandle* h = Find(key, hash, true);
+  (h != nullptr ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCacheShard::Release(Cache::Handle* handle) {
+  ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+  if (h->detached) {
+    h->Free();
+    delete h;
+  } else {
+    Unref(h);
+  }
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  ClockHandle* h = Find(key, hash, false);
+  if (h != nullptr) {
+    MakeInvisible(h);
+    Unref(h);
+  }
+}
+
+void ClockCacheShard::Prune() {
+  for (size_t i = 0; i <= mask_; i++) {
+    ClockHandle* h = &slots_[i];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (State(meta) == kVisible && Refs(meta) == 0 &&
+        h->meta.compare_exchange_strong(meta, kConstruction,
+                                        std::memory_order_acq_rel)) {
+      usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      FreeSlot(h);
+    }
+  }
+}
+
+class ShardedClockCache : public Cache {
+ public:
+  ShardedClockCache(size_t capacity, int num_shard_bits,
+                    size_t estimated_entry_charge)
+      : shards_(new ClockCacheShard[size_t{1} << num_shard_bits]),
+        num_shard_bits_(num_shard_bits),
+        last_id_(0) {
+    const size_t num_shards = size_t{1} << num_shard_bits;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    // Room for twice the expected number of entries, which keeps the
+    // occupancy of a full cache around one half.
+    const size_t expected_entries =
+        per_shard / std::max<size_t>(estimated_entry_charge, 1);
+    const size_t num_slots =
+        RoundUpToPowerOfTwo(std::max<size_t>(2 * expected_entries, 16));
+    for (size_t s = 0; s < num_shards; s++) {
+      shards_[s].Init(per_shard, num_slots);
+    }
+  }
+  ~ShardedClockCache() override { delete[] shards_; }
+
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                       false);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                       priority == Priority::kHigh);
+  }
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Lookup(key, hash);
+  }
+  void Release(Handle* handle) override {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shards_[Shard(h->hash.load(std::memory_order_relaxed))].Release(handle);
+  }
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    shards_[Shard(hash)].Erase(key, hash);
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  uint64_t NewId() override {
+    MutexLock l(&id_mutex_);
+    return ++(last_id_);
+  }
+  void Prune() override {
+    for (size_t s = 0; s < (size_t{1} << num_shard_bits_); s++) {
+      shards_[s].Prune();
+    }
+  }
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (size_t s = 0; s < (size_t{1} << num_shard_bits_); s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+  uint64_t LookupHits() const override {
+    uint64_t total = 0;
+    for (size_t s = 0; s < (size_t{1} << num_shard_bits_); s++) {
+      total += shards_[s].LookupHits();
+    }
+    return total;
+  }
+  uint64_t LookupMisses() const override {
+    uint64_t total = 0;
+    for (size_t s = 0; s < (size_t{1} << num_shard_bits_); s++) {
+      total += shards_[s].LookupMisses();
+    }
+    return total;
+  }
+
+ private:
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  // The shard takes the high bits of the hash, the slot its low bits.
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ == 0 ? 0 : hash >> (32 - num_shard_bits_);
+  }
+
+  ClockCacheShard* const shards_;
+  const int num_shard_bits_;
+  port::Mutex id_mutex_;
+  uint64_t last_id_;
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                     size_t estimated_entry_charge) {
+  if (num_shard_bits < 0) num_shard_bits = 0;
+  if (num_shard_bits > 16) num_shard_bits = 16;
+  return new ShardedClockCache(capacity, num_shard_bits,
+                               estimated_entry_charge);
+}
+
+}  // namespace leveldb
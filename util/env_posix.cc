@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -21,6 +22,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <queue>
 #include <set>
 #include <string>
@@ -36,6 +38,11 @@
 #include "util/env_posix_test_helper.h"
 #include "util/posix_logger.h"
 
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -49,6 +56,28 @@ constexpr const int kDefaultMmapLimit = (sizeof(void*) >= 8) ? 1000 : 0;
 // Can be set using EnvPosixTestHelper::SetReadOnlyMMapLimit().
 int g_mmap_limit = kDefaultMmapLimit;
 
+// Whether the LEVELDB_USE_IO_URING environment variable, read once at
+// startup, leaves io_uring enabled.  Only "0" disables it.
+bool IoUringEnabledByEnvironment() {
+  const char* env = std::getenv("LEVELDB_USE_IO_URING");
+  return env == nullptr || std::strcmp(env, "0") != 0;
+}
+
+// Can be set using EnvPosixTestHelper::SetUseIoUring().
+std::atomic<bool> g_use_io_uring{IoUringEnabledByEnvironment()};
+
+#if HAVE_IO_URING
+int SysIoUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                    unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+// Can be replaced using EnvPosixTestHelper::SetIoUringEnter().
+std::atomic<EnvPosixTestHelper::IoUringEnterFunction> g_io_uring_enter{
+    &SysIoUringEnter};
+#endif  // HAVE_IO_URING
+
 // Common flags defined for all posix open operations
 #if defined(HAVE_O_CLOEXEC)
 constexpr const int kOpenBaseFlags = O_CLOEXEC;
@@ -129,6 +158,247 @@ class Limiter {
   std::atomic<int> acquires_allowed_;
 };
 
+// Reads "req" from "fd" with pread(), as PosixRandomAccessFile::Read() does.
+void PosixPread(int fd, const std::string& filename, ReadRequest* req) {
+  ssize_t read_size =
+      ::pread(fd, req->scratch, req->n, static_cast<off_t>(req->offset));
+  req->result = Slice(req->scratch, (read_size < 0) ? 0 : read_size);
+  req->status = (read_size < 0) ? PosixError(filename, errno) : Status::OK();
+}
+
+#if HAVE_IO_URING
+// A minimal io_uring instance used to submit a batch of reads with a single
+// system call and wait for all of them.  Each thread owns its own ring, so
+// no locking is needed; see IoUring::ForCurrentThread().
+class IoUring {
+ public:
+  // Returns the calling thread's ring, creating it on first use, or nullptr
+  // if io_uring is disabled or not supported by the running kernel.
+  static IoUring* ForCurrentThread() {
+    static std::atomic<bool> unsupported{false};
+    if (!g_use_io_uring.load(std::memory_order_relaxed) ||
+        unsupported.load(std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    thread_local std::unique_ptr<IoUring> ring;
+    if (ring == nullptr) {
+      ring.reset(new IoUring());
+      if (!ring->ok()) {
+        ring.reset();
+        unsupported.store(true, std::memory_order_relaxed);
+        return nullptr;
+      }
+    }
+    return ring->broken_ ? nullptr : ring.get();
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sqes_ != nullptr) ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) ::munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0) ::close(ring_fd_);
+  }
+
+  // Performs all of "reqs[0..n-1]" on "fd".  Requests the kernel rejects are
+  // retried with pread() so that callers see the same errors as Read().
+  void Read(int fd, const std::string& filename, ReadRequest* reqs,
+            size_t n) {
+    size_t submitted = 0;
+    while (submitted < n && !broken_) {
+      const size_t batch = std::min<size_t>(n - submitted, sq_entries_);
+      unsigned tail = *sq_tail_;
+      for (size_t i = 0; i < batch; i++) {
+        ReadRequest* req = &reqs[submitted + i];
+        // Requests that never complete are redone with pread() below.
+        req->status = Status::IOError(filename, "read not completed");
+        const unsigned index = tail & *sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uintptr_t>(req->scratch);
+        sqe->len = static_cast<uint32_t>(req->n);
+        sqe->off = req->offset;
+        sqe->user_data = submitted + i;
+        sq_array_[index] = index;
+        tail++;
+      }
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+      size_t to_submit = batch;
+      size_t in_flight = 0;
+      bool wait_first = false;
+      while (to_submit > 0) {
+        const int ret =
+            Enter(wait_first ? 0 : to_submit, (in_flight > 0) ? 1 : 0);
+        wait_first = false;
+        if (ret >= 0) {
+          to_submit -= std::min<size_t>(to_submit, ret);
+          in_flight += ret;
+        } else if (errno == EINTR) {
+          // Retry.
+        } else if ((errno == EAGAIN || errno == EBUSY) && in_flight > 0) {
+          // The kernel is short of resources until completions are
+          // consumed: wait for one before submitting again.
+          wait_first = true;
+        } else {
+          // Take back the entries the kernel has not consumed, so that
+          // they are neither waited for nor submitted by a later call,
+          // and stop using this ring.
+          __atomic_store_n(sq_tail_, __atomic_load_n(sq_head_,
+                                                     __ATOMIC_ACQUIRE),
+                           __ATOMIC_RELEASE);
+          broken_ = true;
+          break;
+        }
+        in_flight -= std::min(in_flight, Reap(reqs));
+      }
+      // Reads in flight write into the callers' buffers, so they must be
+      // waited for even after a failure.
+      Drain(reqs, in_flight);
+      submitted += batch;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      if (i >= submitted || !reqs[i].status.ok()) {
+        // Redo failed or unsubmitted reads with pread() so that callers
+        // see the same errors as Read().
+        PosixPread(fd, filename, &reqs[i]);
+      }
+    }
+  }
+
+ private:
+  static constexpr unsigned kQueueDepth = 64;
+
+  IoUring()
+      : ring_fd_(-1),
+        sq_ring_(nullptr),
+        cq_ring_(nullptr),
+        sqes_(nullptr),
+        sq_ring_size_(0),
+        cq_ring_size_(0),
+        sqes_size_(0),
+        sq_entries_(0),
+        broken_(false) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, kQueueDepth, &params));
+    if (ring_fd_ < 0) {
+      return;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    void* sq = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+      return;
+    }
+    sq_ring_ = static_cast<char*>(sq);
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      void* cq = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_,
+                        IORING_OFF_CQ_RING);
+      if (cq == MAP_FAILED) {
+        return;
+      }
+      cq_ring_ = static_cast<char*>(cq);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sq_head_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring_ + params.cq_off.cqes);
+    sq_entries_ = params.sq_entries;
+  }
+
+  bool ok() const { return sqes_ != nullptr; }
+
+  // Submits "to_submit" entries and waits for "min_complete" completions.
+  // Returns the number of entries submitted, or -1 with errno set.
+  int Enter(size_t to_submit, unsigned min_complete) {
+    return g_io_uring_enter.load(std::memory_order_relaxed)(
+        ring_fd_, static_cast<unsigned>(to_submit), min_complete,
+        IORING_ENTER_GETEVENTS);
+  }
+
+  // Waits for the "in_flight" reads of the current batch to complete.
+  void Drain(ReadRequest* reqs, size_t in_flight) {
+    while (in_flight > 0) {
+      if (Enter(0, 1) < 0 && errno != EINTR) {
+        // The ring cannot be waited on; poll its completion queue.
+        ::usleep(100);
+      }
+      in_flight -= std::min(in_flight, Reap(reqs));
+    }
+  }
+
+  // Consumes the available completions and returns how many there were.
+  size_t Reap(ReadRequest* reqs) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    size_t count = 0;
+    for (; head != tail; head++, count++) {
+      const io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+      ReadRequest* req = &reqs[cqe->user_data];
+      if (cqe->res < 0) {
+        req->result = Slice(req->scratch, 0);
+        req->status = Status::IOError("io_uring read", std::strerror(-cqe->res));
+      } else {
+        req->result = Slice(req->scratch, cqe->res);
+        req->status = Status::OK();
+      }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  int ring_fd_;
+  char* sq_ring_;
+  char* cq_ring_;
+  io_uring_sqe* sqes_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  size_t sqes_size_;
+  unsigned sq_entries_;
+  bool broken_;  // Set after a submission failure; reads fall back to pread
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+};
+#endif  // HAVE_IO_URING
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -223,6 +493,46 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     return status;
   }
 
+  // Submits the whole batch through io_uring when it is available, so that
+  // the reads proceed in parallel; falls back to one pread() per request.
+  void MultiRead(ReadRequest* reqs, size_t n) const override {
+    int fd = fd_;
+    if (!has_permanent_fd_) {
+      fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+      if (fd < 0) {
+        Status status = PosixError(filename_, errno);
+        for (size_t i = 0; i < n; i++) {
+          reqs[i].result = Slice();
+          reqs[i].status = status;
+        }
+        return;
+      }
+    }
+
+    assert(fd != -1);
+
+#if HAVE_IO_URING
+    IoUring* ring = (n > 1) ? IoUring::ForCurrentThread() : nullptr;
+    if (ring != nullptr) {
+      ring->Read(fd, filename_, reqs, n);
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        PosixPread(fd, filename_, &reqs[i]);
+      }
+    }
+#else
+    for (size_t i = 0; i < n; i++) {
+      PosixPread(fd, filename_, &reqs[i]);
+    }
+#endif  // HAVE_IO_URING
+
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+  }
+
  private:
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
@@ -691,6 +1001,12 @@ class PosixEnv : public Env {
   void Schedule(void (*background_work_function)(void* background_work_arg),
                 void* background_work_arg) override;
 
+  void ScheduleHighPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg) override;
+
+  void SetBackgroundThreads(int number) override;
+
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
     std::thread new_thread(thread_main, thread_main_arg);
@@ -747,6 +1063,16 @@ class PosixEnv : public Env {
  private:
   void BackgroundThreadMain();
 
+  // Queues a work item and starts a new background thread if all existing
+  // ones are busy and the pool has room for another.
+  void ScheduleWork(void (*background_work_function)(void* background_work_arg),
+                    void* background_work_arg, bool high_priority);
+
+  // Starts background threads until there is one for every queued work item
+  // or the pool is at its limit.
+  void MaybeStartBackgroundThreads()
+      EXCLUSIVE_LOCKS_REQUIRED(background_work_mutex_);
+
   static void BackgroundThreadEntryPoint(PosixEnv* env) {
     env->BackgroundThreadMain();
   }
@@ -767,8 +1093,13 @@ class PosixEnv : public Env {
 
   port::Mutex background_work_mutex_;
   port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  int max_background_threads_ GUARDED_BY(background_work_mutex_);
+  int started_background_threads_ GUARDED_BY(background_work_mutex_);
+  int idle_background_threads_ GUARDED_BY(background_work_mutex_);
 
+  // Work items in the high priority queue are always run first.
+  std::queue<BackgroundWorkItem> high_priority_work_queue_
+      GUARDED_BY(background_work_mutex_);
   std::queue<BackgroundWorkItem> background_work_queue_
       GUARDED_BY(background_work_mutex_);
 
@@ -807,47 +1138,91 @@ int MaxOpenFiles() {
 
 PosixEnv::PosixEnv()
     : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+      max_background_threads_(1),
+      started_background_threads_(0),
+      idle_background_threads_(0),
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
 void PosixEnv::Schedule(
     void (*background_work_function)(void* background_work_arg),
     void* background_work_arg) {
-  background_work_mutex_.Lock();
+  ScheduleWork(background_work_function, background_work_arg,
+               /*high_priority=*/false);
+}
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
-    background_thread.detach();
+void PosixEnv::ScheduleHighPriority(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg) {
+  ScheduleWork(background_work_function, background_work_arg,
+               /*high_priority=*/true);
+}
+
+void PosixEnv::SetBackgroundThreads(int number) {
+  background_work_mutex_.Lock();
+  if (number > max_background_threads_) {
+    max_background_threads_ = number;
+    MaybeStartBackgroundThreads();
   }
+  background_work_mutex_.Unlock();
+}
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
+void PosixEnv::ScheduleWork(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg, bool high_priority) {
+  background_work_mutex_.Lock();
+
+  if (high_priority) {
+    high_priority_work_queue_.emplace(background_work_function,
+                                      background_work_arg);
+  } else {
+    background_work_queue_.emplace(background_work_function,
+                                   background_work_arg);
   }
+  MaybeStartBackgroundThreads();
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
+  // Some background thread may be waiting for work.
+  background_work_cv_.Signal();
   background_work_mutex_.Unlock();
 }
 
+void PosixEnv::MaybeStartBackgroundThreads() {
+  background_work_mutex_.AssertHeld();
+  const size_t queued =
+      high_priority_work_queue_.size() + background_work_queue_.size();
+  while (started_background_threads_ < max_background_threads_ &&
+         queued > static_cast<size_t>(idle_background_threads_)) {
+    ++started_background_threads_;
+    ++idle_background_threads_;  // Counted as idle until it picks up work.
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+    background_thread.detach();
+  }
+}
+
 void PosixEnv::BackgroundThreadMain() {
   while (true) {
     background_work_mutex_.Lock();
 
     // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
+    while (high_priority_work_queue_.empty() &&
+           background_work_queue_.empty()) {
       background_work_cv_.Wait();
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    std::queue<BackgroundWorkItem>* queue = high_priority_work_queue_.empty()
+                                                ? &background_work_queue_
+                                                : &high_priority_work_queue_;
+    auto background_work_function = queue->front().function;
+    void* background_work_arg = queue->front().arg;
+    queue->pop();
+    --idle_background_threads_;
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
+
+    background_work_mutex_.Lock();
+    ++idle_background_threads_;
+    background_work_mutex_.Unlock();
   }
 }
 
@@ -918,6 +1293,19 @@ void EnvPosixTestHelper::SetReadOnlyMMapLimit(int limit) {
   g_mmap_limit = limit;
 }
 
+void EnvPosixTestHelper::SetUseIoUring(bool use_io_uring) {
+  g_use_io_uring.store(use_io_uring, std::memory_order_relaxed);
+}
+
+void EnvPosixTestHelper::SetIoUringEnter(IoUringEnterFunction enter) {
+#if HAVE_IO_URING
+  g_io_uring_enter.store((enter != nullptr) ? enter : &SysIoUringEnter,
+                         std::memory_order_relaxed);
+#else
+  (void)enter;
+#endif  // HAVE_IO_URING
+}
+
 Env* Env::Default() {
   static PosixDefaultEnv env_container;
   return env_container.env();
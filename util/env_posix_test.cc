@@ -3,13 +3,18 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -176,6 +181,14 @@ class EnvPosixTest : public testing::Test {
     EnvPosixTestHelper::SetReadOnlyMMapLimit(mmap_limit);
   }
 
+  static void SetUseIoUring(bool use_io_uring) {
+    EnvPosixTestHelper::SetUseIoUring(use_io_uring);
+  }
+
+  static void SetIoUringEnter(EnvPosixTestHelper::IoUringEnterFunction enter) {
+    EnvPosixTestHelper::SetIoUringEnter(enter);
+  }
+
   EnvPosixTest() : env_(Env::Default()) {}
 
   Env* env_;
@@ -212,6 +225,153 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestMultiRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read.txt";
+  std::string data;
+  for (int i = 0; data.size() < 100000; i++) {
+    data.append(std::to_string(i));
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Use up the mmap regions so that the file is read with pread/io_uring.
+  leveldb::RandomAccessFile* mmapped_files[kMMapLimit];
+  for (int i = 0; i < kMMapLimit; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &mmapped_files[i]));
+  }
+
+  for (bool use_io_uring : {true, false}) {
+    SetUseIoUring(use_io_uring);
+    leveldb::RandomAccessFile* file;
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &file));
+
+    // Include a read that runs past the end of the file and one that
+    // starts beyond it; both must behave as Read() does.
+    const int kNumReads = 100;
+    std::vector<ReadRequest> reqs(kNumReads);
+    std::vector<std::string> scratch(kNumReads);
+    for (int i = 0; i < kNumReads; i++) {
+      reqs[i].offset = (i * 7919) % data.size();
+      reqs[i].n = 1 + (i * 104729) % 5000;
+      if (i == kNumReads - 2) reqs[i].offset = data.size() - 10;
+      if (i == kNumReads - 1) reqs[i].offset = data.size() + 10;
+      scratch[i].resize(reqs[i].n);
+      reqs[i].scratch = &scratch[i][0];
+    }
+    file->MultiRead(reqs.data(), reqs.size());
+
+    std::string expected_scratch;
+    for (int i = 0; i < kNumReads; i++) {
+      ASSERT_LEVELDB_OK(reqs[i].status);
+      Slice expected;
+      expected_scratch.resize(reqs[i].n);
+      ASSERT_LEVELDB_OK(file->Read(reqs[i].offset, reqs[i].n, &expected,
+                                   &expected_scratch[0]));
+      ASSERT_EQ(expected.ToString(), reqs[i].result.ToString());
+    }
+    delete file;
+  }
+  SetUseIoUring(true);
+
+  for (int i = 0; i < kMMapLimit; i++) {
+    delete mmapped_files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+#if HAVE_IO_URING
+
+// Calls made to FaultyIoUringEnter() so far, and the error that it fails
+// the second one with.
+static std::atomic<int> faulty_enter_calls(0);
+static std::atomic<int> faulty_enter_errno(0);
+
+// The number of entries the third call was asked to submit.
+static std::atomic<unsigned> faulty_enter_third_submit(0);
+
+// Submits a single entry of the first batch and fails the next call with
+// faulty_enter_errno, as if the kernel had rejected the rest.
+static int FaultyIoUringEnter(int ring_fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+  const int call = faulty_enter_calls.fetch_add(1);
+  if (call == 0) {
+    to_submit = std::min(to_submit, 1u);
+  } else if (call == 1) {
+    errno = faulty_enter_errno.load();
+    return -1;
+  } else if (call == 2) {
+    faulty_enter_third_submit.store(to_submit);
+  }
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+TEST_F(EnvPosixTest, TestMultiReadSubmitFault) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read_fault.txt";
+  std::string data;
+  for (int i = 0; data.size() < 100000; i++) {
+    data.append(std::to_string(i));
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Use up the mmap regions so that the file is read with pread/io_uring.
+  leveldb::RandomAccessFile* mmapped_files[kMMapLimit];
+  for (int i = 0; i < kMMapLimit; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &mmapped_files[i]));
+  }
+  leveldb::RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &file));
+
+  // EINVAL makes the ring give up on the rest of the reads, EAGAIN makes
+  // it wait for a completion before it submits them.  Reads of more than
+  // a ring's worth leave later batches unsubmitted.  Each thread has its
+  // own ring, so a broken one is not used by other tests.
+  SetIoUringEnter(&FaultyIoUringEnter);
+  for (int error : {EINVAL, EAGAIN}) {
+    faulty_enter_calls.store(0);
+    faulty_enter_errno.store(error);
+    faulty_enter_third_submit.store(~0u);
+    std::thread reader([&]() {
+      const int kNumReads = 200;
+      for (int round = 0; round < 2; round++) {
+        std::vector<ReadRequest> reqs(kNumReads);
+        std::vector<std::string> scratch(kNumReads);
+        for (int i = 0; i < kNumReads; i++) {
+          reqs[i].offset = (i * 7919 + round) % data.size();
+          reqs[i].n = 1 + (i * 104729) % 5000;
+          scratch[i].resize(reqs[i].n);
+          reqs[i].scratch = &scratch[i][0];
+        }
+        file->MultiRead(reqs.data(), reqs.size());
+
+        for (int i = 0; i < kNumReads; i++) {
+          ASSERT_LEVELDB_OK(reqs[i].status);
+          ASSERT_EQ(data.substr(reqs[i].offset, reqs[i].n),
+                    reqs[i].result.ToString());
+        }
+      }
+    });
+    reader.join();
+    if (error == EAGAIN && faulty_enter_calls.load() > 2) {
+      // The ring had a read in flight, so it waited for a completion
+      // rather than submitting again.
+      ASSERT_EQ(0, faulty_enter_third_submit.load());
+    }
+  }
+  SetIoUringEnter(nullptr);
+
+  delete file;
+  for (int i = 0; i < kMMapLimit; i++) {
+    delete mmapped_files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+#endif  // HAVE_IO_URING
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -11,6 +11,13 @@ class EnvPosixTest;
 
 // A helper for the POSIX Env to facilitate testing.
 class EnvPosixTestHelper {
+ public:
+  // Signature of the io_uring_enter() system call, without its signal mask
+  // arguments.  Returns the number of entries submitted, or -1 with errno
+  // set.
+  using IoUringEnterFunction = int (*)(int ring_fd, unsigned to_submit,
+                                       unsigned min_complete, unsigned flags);
+
  private:
   friend class EnvPosixTest;
 
@@ -21,6 +28,15 @@ class EnvPosixTestHelper {
   // Set the maximum number of read-only files that will be mapped via mmap.
   // Must be called before creating an Env.
   static void SetReadOnlyMMapLimit(int limit);
+
+  // Choose whether RandomAccessFile::MultiRead() may use io_uring when the
+  // kernel supports it.  May be called at any time.
+  static void SetUseIoUring(bool use_io_uring);
+
+  // Make the io_uring of RandomAccessFile::MultiRead() call "enter" instead
+  // of the system call, or the system call again if "enter" is null.  May
+  // be called at any time.
+  static void SetIoUringEnter(IoUringEnterFunction enter);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,268 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Ribbon filter (Dillinger & Walzer, "Ribbon filter: practically smaller
+// than Bloom and Xor", 2021) stores r bits per slot for slightly more
+// slots than keys.  Each key hashes to a start slot s, a 64-bit
+// coefficient row c and an r-bit result; the filter is a solution S of
+// the linear system over GF(2) where, for every key, the XOR of S[s + k]
+// over the set bits k of c equals its result.  A lookup recomputes that
+// XOR and compares it to the key's result, which matches a missing key
+// with probability 2^-r.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// Width of the coefficient rows: each key spans 64 consecutive slots.
+static const size_t kRibbonWidth = 64;
+
+static const int kMaxResultBits = 16;
+
+// Trailer: number of slots (fixed32), hash seed (fixed32), result bits.
+static const size_t kRibbonTrailerSize = 9;
+
+// Result bits of a filter whose construction failed; it matches any key.
+static const char kMatchAll = static_cast<char>(0xff);
+
+// Construction gives up after this many seeds.
+static const uint32_t kMaxSeeds = 32;
+
+static uint64_t RibbonKeyHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0x5c1e6b2d))
+          << 32) |
+         Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+// Finalizer of MurmurHash3: a bijection that mixes all bits of h.
+static uint64_t Mix64(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+static int CountTrailingZeros(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  while ((v & 1) == 0) {
+    v >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static uint32_t Parity(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_parityll(v);
+#else
+  v ^= v >> 32;
+  v ^= v >> 16;
+  v ^= v >> 8;
+  v ^= v >> 4;
+  v ^= v >> 2;
+  v ^= v >> 1;
+  return static_cast<uint32_t>(v & 1);
+#endif
+}
+
+// The equation of a key under a seed.
+struct Equation {
+  Equation(uint64_t key_hash, uint32_t seed, size_t num_slots,
+           int result_bits) {
+    const uint64_t h = Mix64(key_hash + seed * 0x9e3779b97f4a7c15ull);
+    const uint64_t num_starts = num_slots - kRibbonWidth + 1;
+    start = static_cast<size_t>(((h >> 32) * num_starts) >> 32);
+    coeff = Mix64(h ^ 0x2f0b3e9a5c1d4e87ull) | 1;  // Slot "start" is in
+    result = static_cast<uint32_t>(h) & ((1u << result_bits) - 1);
+  }
+
+  size_t start;
+  uint64_t coeff;
+  uint32_t result;
+};
+
+// Bits [pos, pos + 64) of a bit plane.
+static uint64_t ReadPlane(const char* plane, size_t pos) {
+  const char* p = plane + pos / 8;
+  const int shift = pos % 8;
+  uint64_t bits = DecodeFixed64(p);
+  if (shift != 0) {
+    bits = (bits >> shift) |
+           (static_cast<uint64_t>(static_cast<uint8_t>(p[8])) << (64 - shift));
+  }
+  return bits;
+}
+
+class RibbonFilterPolicy : public FilterPolicy {
+ public:
+  explicit RibbonFilterPolicy(int bits_per_key) {
+    // A bloom filter with b bits per key has a false positive rate of
+    // about 2^(-0.69 * b); match it with as many result bits.
+    result_bits_ = static_cast<int>(std::lround(bits_per_key * 0.69));
+    if (result_bits_ < 1) result_bits_ = 1;
+    if (result_bits_ > kMaxResultBits) result_bits_ = kMaxResultBits;
+  }
+
+  const char* Name() const override { return "leveldb.RibbonFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    if (n == 0) {
+      AppendTrailer(0, 0, static_cast<char>(result_bits_), dst);
+      return;
+    }
+    std::vector<uint64_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = RibbonKeyHash(keys[i]);
+    }
+
+    // With 64-bit rows, banding needs about 3% more slots than keys up to
+    // 10000 keys, plus 1% for every doubling beyond that.  Every failure
+    // adds another 1% of slack.
+    double slack = 0.03;
+    if (n > 10000) slack += 0.01 * std::log2(n / 10000.0);
+    std::vector<uint64_t> coeffs;
+    std::vector<uint32_t> results;
+    for (uint32_t seed = 0; seed < kMaxSeeds; seed++) {
+      const size_t num_slots =
+          static_cast<size_t>(n * (1.0 + slack + 0.01 * seed)) + kRibbonWidth;
+      if (Band(hashes, seed, num_slots, &coeffs, &results)) {
+        BackSubstitute(coeffs, results, seed, dst);
+        return;
+      }
+    }
+    AppendTrailer(0, 0, kMatchAll, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    const size_t len = filter.size();
+    if (len < kRibbonTrailerSize) return false;
+
+    const char* trailer = filter.data() + len - kRibbonTrailerSize;
+    const size_t num_slots = DecodeFixed32(trailer);
+    const uint32_t seed = DecodeFixed32(trailer + 4);
+    const int result_bits = static_cast<uint8_t>(trailer[8]);
+    if (result_bits == 0 || result_bits > kMaxResultBits) {
+      // Failed construction, or reserved for new encodings: consider it a
+      // match.
+      return true;
+    }
+    if (num_slots == 0) {
+      return false;  // No keys
+    }
+    const size_t plane_bytes = (num_slots + 7) / 8;
+    if (num_slots < kRibbonWidth ||
+        len != result_bits * plane_bytes + kRibbonTrailerSize) {
+      return true;  // Corrupt: consider it a match
+    }
+
+    const Equation eq(RibbonKeyHash(key), seed, num_slots, result_bits);
+    const char* plane = filter.data();
+    for (int j = 0; j < result_bits; j++, plane += plane_bytes) {
+      if (Parity(eq.coeff & ReadPlane(plane, eq.start)) !=
+          ((eq.result >> j) & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  static void AppendTrailer(uint32_t num_slots, uint32_t seed,
+                            char result_bits, std::string* dst) {
+    PutFixed32(dst, num_slots);
+    PutFixed32(dst, seed);
+    dst->push_back(result_bits);
+  }
+
+  // Gaussian elimination of the equations into row echelon form, where
+  // the row stored at slot i has its lowest bit for slot i.  Returns
+  // false if the equations are inconsistent.
+  bool Band(const std::vector<uint64_t>& hashes, uint32_t seed,
+            size_t num_slots, std::vector<uint64_t>* coeffs,
+            std::vector<uint32_t>* results) const {
+    coeffs->assign(num_slots, 0);
+    results->assign(num_slots, 0);
+    for (uint64_t hash : hashes) {
+      const Equation eq(hash, seed, num_slots, result_bits_);
+      size_t i = eq.start;
+      uint64_t c = eq.coeff;
+      uint32_t r = eq.result;
+      while (true) {
+        if ((*coeffs)[i] == 0) {
+          (*coeffs)[i] = c;
+          (*results)[i] = r;
+          break;
+        }
+        c ^= (*coeffs)[i];
+        r ^= (*results)[i];
+        if (c == 0) {
+          // Implied by earlier equations (e.g. a duplicate key) unless
+          // the results disagree.
+          if (r != 0) return false;
+          break;
+        }
+        const int shift = CountTrailingZeros(c);
+        i += shift;
+        c >>= shift;
+      }
+    }
+    return true;
+  }
+
+  // Solves the banded equations from the last slot down and appends the
+  // solution as result_bits_ bit planes, followed by the trailer.
+  void BackSubstitute(const std::vector<uint64_t>& coeffs,
+                      const std::vector<uint32_t>& results, uint32_t seed,
+                      std::string* dst) const {
+    const size_t num_slots = coeffs.size();
+    const size_t plane_bytes = (num_slots + 7) / 8;
+    const size_t init_size = dst->size();
+    dst->resize(init_size + result_bits_ * plane_bytes, 0);
+    char* planes = &(*dst)[init_size];
+
+    // window[j] holds bits [i, i + 64) of plane j.
+    uint64_t window[kMaxResultBits] = {0};
+    for (size_t i = num_slots; i-- > 0;) {
+      for (int j = 0; j < result_bits_; j++) {
+        window[j] <<= 1;
+        // Free slots (no row) may hold anything: leave them zero.
+        if (coeffs[i] != 0) {
+          const uint64_t bit =
+              Parity(coeffs[i] & window[j]) ^ ((results[i] >> j) & 1);
+          window[j] |= bit;
+          if (bit) {
+            planes[j * plane_bytes + i / 8] |= static_cast<char>(1 << (i % 8));
+          }
+        }
+      }
+    }
+    AppendTrailer(static_cast<uint32_t>(num_slots), seed,
+                  static_cast<char>(result_bits_), dst);
+  }
+
+  int result_bits_;
+};
+
+}  // namespace
+
+const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key) {
+  return new RibbonFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,469 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_cache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+SecondaryCache::~SecondaryCache() = default;
+
+namespace {
+
+// Compressed in-memory tier
+//
+// Entries live in a plain LRU cache, as a byte holding the CompressionType
+// they were compressed with followed by their compressed value.
+
+LRUCacheOptions PlainLRU() {
+  LRUCacheOptions options;
+  options.protected_ratio = 0;
+  options.high_pri_pool_ratio = 0;
+  return options;
+}
+
+class CompressedSecondaryCache : public SecondaryCache {
+ public:
+  CompressedSecondaryCache(size_t capacity, CompressionType compression)
+      : cache_(NewLRUCache(capacity, PlainLRU())),
+        capacity_(capacity),
+        compression_(compression),
+        hits_(0),
+        misses_(0) {}
+
+  ~CompressedSecondaryCache() override { delete cache_; }
+
+  void Insert(const Slice& key, const Slice& value) override {
+    if (value.size() > capacity_) {
+      return;
+    }
+    std::string* entry = new std::string;
+    bool compressed = false;
+    switch (compression_) {
+      case kSnappyCompression:
+        compressed = port::Snappy_Compress(value.data(), value.size(), entry);
+        break;
+      case kZstdCompression:
+        compressed = port::Zstd_Compress(kZstdLevel, value.data(),
+                                         value.size(), entry);
+        break;
+      case kLZ4Compression:
+        compressed = port::LZ4_Compress(value.data(), value.size(), entry);
+        break;
+      default:
+        break;
+    }
+    // The compression functions replace the contents of "entry".
+    if (compressed && entry->size() < value.size() - (value.size() / 8u)) {
+      entry->insert(entry->begin(), static_cast<char>(compression_));
+    } else {
+      entry->assign(1, static_cast<char>(kNoCompression));
+      entry->append(value.data(), value.size());
+    }
+    cache_->Release(
+        cache_->Insert(key, entry, entry->size(), &DeleteEntry));
+  }
+
+  bool Lookup(const Slice& key, std::string* value) override {
+    Cache::Handle* handle = cache_->Lookup(key);
+    if (handle == nullptr) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    const std::string* entry =
+        reinterpret_cast<std::string*>(cache_->Value(handle));
+    bool ok = Uncompress(*entry, value);
+    cache_->Release(handle);
+    if (!ok) {
+      cache_->Erase(key);
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  uint64_t NewId() override { return cache_->NewId(); }
+  size_t TotalCharge() const override { return cache_->TotalCharge(); }
+  uint64_t LookupHits() const override {
+    return hits_.load(std::memory_order_relaxed);
+  }
+  uint64_t LookupMisses() const override {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Favors speed: entries are compressed on every block read from a file.
+  static const int kZstdLevel = 1;
+
+  static void DeleteEntry(const Slice& key, void* value) {
+    delete reinterpret_cast<std::string*>(value);
+  }
+
+  static bool Uncompress(const std::string& entry, std::string* value) {
+    const char* data = entry.data() + 1;
+    const size_t n = entry.size() - 1;
+    size_t ulength = 0;
+    switch (static_cast<CompressionType>(entry[0])) {
+      case kNoCompression:
+        value->assign(data, n);
+        return true;
+      case kSnappyCompression:
+        if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+          return false;
+        }
+        value->resize(ulength);
+        return port::Snappy_Uncompress(data, n, &(*value)[0]);
+      case kZstdCompression:
+        if (!port::Zstd_GetUncompressedLength(data, n, &ulength)) {
+          return false;
+        }
+        value->resize(ulength);
+        return port::Zstd_Uncompress(data, n, &(*value)[0]);
+      case kLZ4Compression:
+        if (!port::LZ4_GetUncompressedLength(data, n, &ulength)) {
+          return false;
+        }
+        value->resize(ulength);
+        return port::LZ4_Uncompress(data, n, &(*value)[0]);
+    }
+    return false;
+  }
+
+  Cache* const cache_;
+  const size_t capacity_;
+  const CompressionType compression_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+// File tier
+//
+// Entries are appended to an in-memory buffer, which is written as a new
+// file (a "segment") once it reaches the segment size.  The cache keeps
+// the newest kNumSegments - 1 segment files, and drops the entries of the
+// oldest one when it deletes it.  Writes are thus sequential, and the
+// entries are evicted in insertion order.
+//
+// Files are written, opened and deleted without holding mutex_.  A sealed
+// segment keeps its buffer until its file is open, so that its entries
+// can be read meanwhile.
+
+class FileSecondaryCache : public SecondaryCache {
+ public:
+  FileSecondaryCache(Env* env, const std::string& dir, size_t capacity)
+      : env_(env),
+        dir_(dir),
+        segment_size_(capacity / kNumSegments),
+        next_segment_(1),
+        usage_(0),
+        last_id_(0),
+        hits_(0),
+        misses_(0) {
+    env_->CreateDir(dir_);  // Ignore error: it may already exist
+    std::vector<std::string> children;
+    if (env_->GetChildren(dir_, &children).ok()) {
+      for (const std::string& child : children) {
+        if (IsSegmentFileName(child)) {
+          env_->RemoveFile(dir_ + "/" + child);
+        }
+      }
+    }
+    active_.number = next_segment_++;
+  }
+
+  ~FileSecondaryCache() override {
+    std::vector<std::string> obsolete;
+    {
+      MutexLock l(&mutex_);
+      while (!segments_.empty()) {
+        DropOldestSegment(&obsolete);
+      }
+    }
+    RemoveFiles(obsolete);
+  }
+
+  void Insert(const Slice& key, const Slice& value) override {
+    if (value.size() > segment_size_) {
+      return;
+    }
+    Segment sealed;
+    std::vector<std::string> obsolete;
+    {
+      MutexLock l(&mutex_);
+      std::string k = key.ToString();
+      if (index_.count(k) != 0) {
+        return;
+      }
+      if (active_data_.size() + value.size() > segment_size_) {
+        SealActiveSegment(&sealed, &obsolete);
+      }
+      Location loc;
+      loc.segment = active_.number;
+      loc.offset = active_data_.size();
+      loc.size = value.size();
+      active_data_.append(value.data(), value.size());
+      active_.keys.push_back(k);
+      index_.emplace(std::move(k), loc);
+      usage_ += value.size();
+    }
+    RemoveFiles(obsolete);
+    if (sealed.data != nullptr) {
+      WriteSegment(sealed);
+    }
+  }
+
+  bool Lookup(const Slice& key, std::string* value) override {
+    std::shared_ptr<RandomAccessFile> file;
+    std::shared_ptr<const std::string> data;
+    Location loc;
+    {
+      MutexLock l(&mutex_);
+      auto it = index_.find(key.ToString());
+      if (it == index_.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      loc = it->second;
+      if (loc.segment == active_.number) {
+        value->assign(active_data_, loc.offset, loc.size);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      Segment* segment = FindSegment(loc.segment);
+      if (segment != nullptr) {
+        file = segment->file;
+        data = segment->data;
+      }
+    }
+
+    // Read outside of the lock: "file" stays open and "data" alive even
+    // if their segment is dropped meanwhile.
+    if (data != nullptr) {
+      value->assign(*data, loc.offset, loc.size);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    if (file == nullptr) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    value->resize(loc.size);
+    Slice result;
+    Status s = file->Read(loc.offset, loc.size, &result, &(*value)[0]);
+    if (!s.ok() || result.size() != loc.size) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (result.data() != value->data()) {
+      value->assign(result.data(), result.size());
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  uint64_t NewId() override {
+    MutexLock l(&mutex_);
+    return ++last_id_;
+  }
+  size_t TotalCharge() const override {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
+  uint64_t LookupHits() const override {
+    return hits_.load(std::memory_order_relaxed);
+  }
+  uint64_t LookupMisses() const override {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static const int kNumSegments = 8;
+
+  struct Location {
+    uint64_t segment;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  // A sealed segment has either its buffer, until its file is written and
+  // opened, or its file.
+  struct Segment {
+    uint64_t number = 0;
+    std::shared_ptr<RandomAccessFile> file;
+    std::shared_ptr<const std::string> data;
+    std::vector<std::string> keys;
+    size_t size = 0;
+  };
+
+  // True for the names of the files written by SegmentFileName().
+  static bool IsSegmentFileName(const std::string& name) {
+    if (name.size() < 6 + 3) {
+      return false;
+    }
+    const size_t digits = name.size() - 3;
+    if (name.compare(digits, 3, ".sc") != 0) {
+      return false;
+    }
+    for (size_t i = 0; i < digits; i++) {
+      if (name[i] < '0' || name[i] > '9') {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::string SegmentFileName(uint64_t number) const {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/%06llu.sc",
+                  static_cast<unsigned long long>(number));
+    return dir_ + buf;
+  }
+
+  Segment* FindSegment(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    for (Segment& segment : segments_) {
+      if (segment.number == number) {
+        return &segment;
+      }
+    }
+    return nullptr;
+  }
+
+  // Moves the active segment, with its buffer, to segments_ and copies
+  // it to *sealed for WriteSegment().  Starts a new active segment.
+  // Stores in *obsolete the files of the segments dropped to make room.
+  void SealActiveSegment(Segment* sealed, std::vector<std::string>* obsolete)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    while (segments_.size() >= kNumSegments - 1) {
+      DropOldestSegment(obsolete);
+    }
+
+    Segment segment;
+    segment.number = active_.number;
+    segment.keys.swap(active_.keys);
+    segment.size = active_data_.size();
+    segment.data = std::make_shared<const std::string>(std::move(active_data_));
+    sealed->number = segment.number;
+    sealed->data = segment.data;
+    segments_.push_back(std::move(segment));
+
+    active_data_.clear();
+    active_.number = next_segment_++;
+  }
+
+  // Writes the file of "sealed" and opens it for the segment, unless the
+  // segment was dropped meanwhile.  Entries that cannot be written are
+  // dropped.
+  // REQUIRES: mutex_ not held
+  void WriteSegment(const Segment& sealed) {
+    const std::string fname = SegmentFileName(sealed.number);
+    WritableFile* out;
+    Status s = env_->NewWritableFile(fname, &out);
+    if (s.ok()) {
+      s = out->Append(*sealed.data);
+      if (s.ok()) {
+        s = out->Close();
+      }
+      delete out;
+    }
+    RandomAccessFile* in = nullptr;
+    if (s.ok()) {
+      s = env_->NewRandomAccessFile(fname, &in);
+    }
+    std::shared_ptr<RandomAccessFile> file(in);
+
+    bool keep_file = false;
+    {
+      MutexLock l(&mutex_);
+      for (auto it = segments_.begin(); it != segments_.end(); ++it) {
+        if (it->number != sealed.number) {
+          continue;
+        }
+        if (s.ok()) {
+          it->file = std::move(file);
+          it->data.reset();
+          keep_file = true;
+        } else {
+          std::vector<std::string> unwritten;  // Stays empty: no file yet
+          DropSegment(*it, &unwritten);
+          segments_.erase(it);
+        }
+        break;
+      }
+    }
+    if (!keep_file) {
+      file.reset();
+      env_->RemoveFile(fname);
+    }
+  }
+
+  void DropOldestSegment(std::vector<std::string>* obsolete)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    DropSegment(segments_.front(), obsolete);
+    segments_.pop_front();
+  }
+
+  // Removes the entries of "segment", and stores its file in *obsolete if
+  // it was written.  The file of a segment still being written is removed
+  // by WriteSegment().
+  void DropSegment(const Segment& segment, std::vector<std::string>* obsolete)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    for (const std::string& key : segment.keys) {
+      index_.erase(key);
+    }
+    usage_ -= segment.size;
+    if (segment.file != nullptr) {
+      obsolete->push_back(SegmentFileName(segment.number));
+    }
+  }
+
+  // REQUIRES: mutex_ not held
+  void RemoveFiles(const std::vector<std::string>& files) {
+    for (const std::string& fname : files) {
+      env_->RemoveFile(fname);
+    }
+  }
+
+  Env* const env_;
+  const std::string dir_;
+  const size_t segment_size_;
+
+  mutable port::Mutex mutex_;
+  uint64_t next_segment_ GUARDED_BY(mutex_);
+  Segment active_ GUARDED_BY(mutex_);  // Its buffer is active_data_
+  std::string active_data_ GUARDED_BY(mutex_);
+  std::deque<Segment> segments_ GUARDED_BY(mutex_);  // Oldest first
+  std::unordered_map<std::string, Location> index_ GUARDED_BY(mutex_);
+  size_t usage_ GUARDED_BY(mutex_);
+  uint64_t last_id_ GUARDED_BY(mutex_);
+
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+}  // namespace
+
+SecondaryCache* NewCompressedSecondaryCache(size_t capacity,
+                                            CompressionType compression) {
+  return new CompressedSecondaryCache(capacity, compression);
+}
+
+SecondaryCache* NewFileSecondaryCache(Env* env, const std::string& dir,
+                                      size_t capacity) {
+  return new FileSecondaryCache(env, dir, capacity);
+}
+
+}  // namespace leveldb
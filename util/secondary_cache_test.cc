@@ -0,0 +1,152 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_cache.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "helpers/memenv/memenv.h"
+#include "leveldb/env.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+enum SecondaryCacheType { kCompressed, kFile };
+
+class SecondaryCacheTest : public testing::TestWithParam<SecondaryCacheType> {
+ public:
+  static constexpr size_t kCapacity = 64 * 1024;
+  static constexpr char kDir[] = "/secondary_cache";
+
+  SecondaryCacheTest()
+      : env_(NewMemEnv(Env::Default())), cache_(NewCache()) {}
+
+  SecondaryCache* NewCache() {
+    return GetParam() == kCompressed
+               ? NewCompressedSecondaryCache(kCapacity)
+               : NewFileSecondaryCache(env_.get(), kDir, kCapacity);
+  }
+
+  static std::string Key(int i) { return "key" + std::to_string(i); }
+
+  static std::string Value(int i, size_t size) {
+    Random rnd(i);
+    std::string value;
+    test::RandomString(&rnd, static_cast<int>(size), &value);
+    return value;
+  }
+
+  std::string Lookup(int i) {
+    std::string value;
+    return cache_->Lookup(Key(i), &value) ? value : "NOT_FOUND";
+  }
+
+  std::unique_ptr<Env> env_;
+  std::unique_ptr<SecondaryCache> cache_;
+};
+
+constexpr char SecondaryCacheTest::kDir[];
+
+TEST_P(SecondaryCacheTest, InsertAndLookup) {
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  cache_->Insert(Key(1), Value(1, 1000));
+  cache_->Insert(Key(2), Value(2, 1000));
+  cache_->Insert(Key(3), "");
+  ASSERT_EQ(Value(1, 1000), Lookup(1));
+  ASSERT_EQ(Value(2, 1000), Lookup(2));
+  ASSERT_EQ("", Lookup(3));
+  ASSERT_EQ("NOT_FOUND", Lookup(4));
+  ASSERT_EQ(3, cache_->LookupHits());
+  ASSERT_EQ(2, cache_->LookupMisses());
+  ASSERT_GE(cache_->TotalCharge(), 2000);
+}
+
+TEST_P(SecondaryCacheTest, Eviction) {
+  // Far more than the capacity: the file tier writes and deletes segments.
+  const int kNum = 1000;
+  for (int i = 0; i < kNum; i++) {
+    cache_->Insert(Key(i), Value(i, 1000));
+    ASSERT_LE(cache_->TotalCharge(), kCapacity + 100);
+  }
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+  for (int i = kNum - 20; i < kNum; i++) {
+    ASSERT_EQ(Value(i, 1000), Lookup(i)) << i;
+  }
+}
+
+TEST_P(SecondaryCacheTest, ConcurrentInsertAndLookup) {
+  // Lookups run while other threads write segments.
+  const int kThreads = 4;
+  const int kNum = 500;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      for (int i = t; i < kNum; i += kThreads) {
+        cache_->Insert(Key(i), Value(i, 1000));
+        for (int j = i; j >= 0 && j > i - 50; j--) {
+          const std::string value = Lookup(j);
+          if (value != "NOT_FOUND") {
+            ASSERT_EQ(Value(j, 1000), value) << j;
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCapacity + 100);
+}
+
+TEST_P(SecondaryCacheTest, OversizedEntries) {
+  cache_->Insert(Key(1), Value(1, 2 * kCapacity));
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  cache_->Insert(Key(2), Value(2, 100));
+  ASSERT_EQ(Value(2, 100), Lookup(2));
+}
+
+TEST_P(SecondaryCacheTest, NewId) {
+  uint64_t a = cache_->NewId();
+  uint64_t b = cache_->NewId();
+  ASSERT_NE(a, b);
+}
+
+TEST_P(SecondaryCacheTest, FilesAreRemoved) {
+  if (GetParam() != kFile) {
+    GTEST_SKIP() << "Only the file tier has files";
+  }
+  for (int i = 0; i < 200; i++) {
+    cache_->Insert(Key(i), Value(i, 1000));
+  }
+  std::vector<std::string> children;
+  ASSERT_TRUE(env_->GetChildren(kDir, &children).ok());
+  ASSERT_FALSE(children.empty());
+  cache_.reset();
+  ASSERT_TRUE(env_->GetChildren(kDir, &children).ok());
+  ASSERT_TRUE(children.empty());
+
+  // A new cache deletes the files left by a previous process, and only
+  // those.
+  ASSERT_TRUE(WriteStringToFile(env_.get(), Value(1, 1000),
+                                std::string(kDir) + "/000001.sc")
+                  .ok());
+  ASSERT_TRUE(WriteStringToFile(env_.get(), Value(2, 1000),
+                                std::string(kDir) + "/other.sc")
+                  .ok());
+  cache_.reset(NewCache());
+  ASSERT_TRUE(env_->GetChildren(kDir, &children).ok());
+  ASSERT_EQ(std::vector<std::string>({"other.sc"}), children);
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  ASSERT_TRUE(env_->RemoveFile(std::string(kDir) + "/other.sc").ok());
+}
+
+INSTANTIATE_TEST_SUITE_P(SecondaryCacheTypes, SecondaryCacheTest,
+                         ::testing::Values(kCompressed, kFile));
+
+}  // namespace leveldb
@@ -0,0 +1,160 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+namespace {
+
+// The values of one thread, indexed by ThreadLocalPtr id.  Only the thread
+// itself adds entries, so it can index them without a lock; a deque keeps
+// the entries in place as it grows.
+struct ThreadData {
+  std::deque<std::atomic<void*>> entries;
+};
+
+// Keeps track of the ids in use and of the threads that have values, so
+// that a value can be cleaned up when either goes away.
+class Registry {
+ public:
+  static Registry* Instance() {
+    static NoDestructor<Registry> singleton;
+    return singleton.get();
+  }
+
+  uint32_t NewId(void (*cleanup)(void*)) {
+    MutexLock l(&mutex_);
+    if (!free_ids_.empty()) {
+      const uint32_t id = free_ids_.back();
+      free_ids_.pop_back();
+      cleanups_[id] = cleanup;
+      return id;
+    }
+    cleanups_.push_back(cleanup);
+    return cleanups_.size() - 1;
+  }
+
+  void ReleaseId(uint32_t id) {
+    MutexLock l(&mutex_);
+    for (ThreadData* data : threads_) {
+      if (id < data->entries.size()) {
+        void* ptr = data->entries[id].exchange(nullptr);
+        if (ptr != nullptr && cleanups_[id] != nullptr) {
+          (*cleanups_[id])(ptr);
+        }
+      }
+    }
+    cleanups_[id] = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  // Returns the entry of the calling thread for "id".
+  std::atomic<void*>* Entry(uint32_t id) {
+    ThreadData* data = LocalData();
+    if (id >= data->entries.size()) {
+      MutexLock l(&mutex_);  // Scrape() may be iterating over the entries
+      while (data->entries.size() <= id) {
+        data->entries.emplace_back(nullptr);
+      }
+    }
+    return &data->entries[id];
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement) {
+    MutexLock l(&mutex_);
+    for (ThreadData* data : threads_) {
+      if (id < data->entries.size()) {
+        void* ptr = data->entries[id].exchange(replacement);
+        if (ptr != nullptr) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+ private:
+  friend class NoDestructor<Registry>;
+
+  // Cleans up the values of a thread when it exits.
+  struct ThreadDataHolder {
+    ThreadData* data = nullptr;
+    ~ThreadDataHolder() {
+      if (data != nullptr) {
+        Registry::Instance()->RemoveThread(data);
+      }
+    }
+  };
+
+  Registry() = default;
+
+  ThreadData* LocalData() {
+    static thread_local ThreadDataHolder holder;
+    if (holder.data == nullptr) {
+      holder.data = new ThreadData;
+      MutexLock l(&mutex_);
+      threads_.push_back(holder.data);
+    }
+    return holder.data;
+  }
+
+  void RemoveThread(ThreadData* data) {
+    {
+      MutexLock l(&mutex_);
+      threads_.erase(std::find(threads_.begin(), threads_.end(), data));
+      for (uint32_t id = 0; id < data->entries.size(); id++) {
+        void* ptr = data->entries[id].load();
+        if (ptr != nullptr && cleanups_[id] != nullptr) {
+          (*cleanups_[id])(ptr);
+        }
+      }
+    }
+    delete data;
+  }
+
+  port::Mutex mutex_;
+  std::vector<ThreadData*> threads_ GUARDED_BY(mutex_);
+  std::vector<void (*)(void*)> cleanups_ GUARDED_BY(mutex_);  // By id
+  std::vector<uint32_t> free_ids_ GUARDED_BY(mutex_);
+};
+
+}  // namespace
+
+ThreadLocalPtr::ThreadLocalPtr(void (*cleanup)(void* ptr))
+    : id_(Registry::Instance()->NewId(cleanup)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() { Registry::Instance()->ReleaseId(id_); }
+
+void* ThreadLocalPtr::Get() const {
+  return Registry::Instance()->Entry(id_)->load(std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  Registry::Instance()->Entry(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Registry::Instance()->Entry(id_)->exchange(ptr,
+                                                    std::memory_order_acquire);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void** expected) {
+  return Registry::Instance()->Entry(id_)->compare_exchange_strong(
+      *expected, ptr, std::memory_order_release, std::memory_order_relaxed);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Registry::Instance()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
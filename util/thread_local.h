@@ -0,0 +1,52 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace leveldb {
+
+// A pointer with a separate value in each thread.  Unlike a thread_local
+// variable, which exists once per thread for the whole program, each
+// ThreadLocalPtr object has values of its own.  Values start out null.
+//
+// Get(), Reset(), Swap() and CompareAndSwap() access the value of the
+// calling thread and take no lock.  Scrape() changes the values of all
+// threads.
+class ThreadLocalPtr {
+ public:
+  // If "cleanup" is non-null, it is called with each non-null value left
+  // when its thread exits or when the ThreadLocalPtr is destroyed.  It must
+  // not use any ThreadLocalPtr.
+  explicit ThreadLocalPtr(void (*cleanup)(void* ptr) = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  ~ThreadLocalPtr();
+
+  void* Get() const;
+  void Reset(void* ptr);
+
+  // Sets the value to "ptr" and returns the previous value.
+  void* Swap(void* ptr);
+
+  // Sets the value to "ptr" if it is *expected and returns true.
+  // Otherwise stores the value in *expected and returns false.
+  bool CompareAndSwap(void* ptr, void** expected);
+
+  // Sets the value of every thread to "replacement", and appends the
+  // previous values that were not null to *ptrs.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
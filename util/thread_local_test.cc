@@ -0,0 +1,104 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static std::atomic<int> cleanups(0);
+
+static void CountCleanup(void* ptr) {
+  cleanups.fetch_add(*reinterpret_cast<int*>(ptr));
+}
+
+TEST(ThreadLocalTest, ValuesArePerThread) {
+  ThreadLocalPtr tls;
+  int a = 1, b = 2;
+  ASSERT_EQ(nullptr, tls.Get());
+  tls.Reset(&a);
+  std::thread other([&tls, &b]() {
+    ASSERT_EQ(nullptr, tls.Get());
+    tls.Reset(&b);
+    ASSERT_EQ(&b, tls.Get());
+  });
+  other.join();
+  ASSERT_EQ(&a, tls.Get());
+
+  // Each object has its own values.
+  ThreadLocalPtr tls2;
+  ASSERT_EQ(nullptr, tls2.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+}
+
+TEST(ThreadLocalTest, CompareAndSwap) {
+  ThreadLocalPtr tls;
+  int a = 1, b = 2;
+  void* expected = nullptr;
+  ASSERT_TRUE(tls.CompareAndSwap(&a, &expected));
+  ASSERT_FALSE(tls.CompareAndSwap(&b, &expected));
+  ASSERT_EQ(&a, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(&b, &expected));
+  ASSERT_EQ(&b, tls.Get());
+}
+
+TEST(ThreadLocalTest, Scrape) {
+  ThreadLocalPtr tls;
+  int values[4] = {1, 2, 3, 4};
+  std::atomic<int> ready(0);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < 4; i++) {
+    threads.emplace_back([&, i]() {
+      tls.Reset(&values[i]);
+      ready.fetch_add(1);
+      while (!done.load()) {
+        std::this_thread::yield();
+      }
+      // Replaced by Scrape()
+      ASSERT_EQ(&values[0], tls.Get());
+    });
+  }
+  while (ready.load() < 3) {
+    std::this_thread::yield();
+  }
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, &values[0]);
+  done.store(true);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(3, ptrs.size());
+  for (int i = 1; i < 4; i++) {
+    ASSERT_NE(ptrs.end(), std::find(ptrs.begin(), ptrs.end(), &values[i]));
+  }
+}
+
+TEST(ThreadLocalTest, CleanupOnThreadExitAndDestruction) {
+  cleanups.store(0);
+  int one = 1, ten = 10;
+  {
+    ThreadLocalPtr tls(&CountCleanup);
+    std::thread other([&tls, &one]() { tls.Reset(&one); });
+    other.join();
+    ASSERT_EQ(1, cleanups.load());
+
+    // Null values are not cleaned up.
+    std::thread idle([&tls]() { tls.Get(); });
+    idle.join();
+    ASSERT_EQ(1, cleanups.load());
+
+    tls.Reset(&ten);
+  }
+  ASSERT_EQ(11, cleanups.load());
+}
+
+}  // namespace leveldb